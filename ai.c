@@ -0,0 +1,514 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "game.h"
+
+/* Adds to the counts of every position one placement covers.
+ *
+ * @param (struct naval_ai* ai) (ai being updated)
+ * @param (int c) (class of the placement)
+ * @param (int dir) (0 for a row of positions, 1 for a column)
+ * @param (int x) (x coordinate of the first position)
+ * @param (int y) (y coordinate of the first position)
+ * @param (int legal) (amount added to the density)
+ * @param (int hits) (amount added to the target)
+ */
+static void add_placement(struct naval_ai* ai, int c, int dir, int x, int y,
+        int legal, int hits)
+{
+    long weight = ai->afloat[c];
+
+    for (int i = 0; i < ai->sizes[c]; i++) {
+        int px = dir ? x : x + i;
+        int py = dir ? y + i : y;
+
+        ai->density[c][py][px] += legal;
+        ai->target[c][py][px] += hits;
+        ai->total[py][px] += weight * legal;
+        ai->targetTotal[py][px] += weight * hits;
+    }
+}
+
+/* Updates every placement running through position x, y after it was
+ * found to be blocked or hit.
+ *
+ * @param (struct naval_ai* ai) (ai being updated)
+ * @param (int x) (x coordinate of the position)
+ * @param (int y) (y coordinate of the position)
+ * @param (int blocked) (change to the blocked count of the placements)
+ * @param (int hits) (change to the hit count of the placements)
+ */
+static void update_through(struct naval_ai* ai, int x, int y, int blocked,
+        int hits)
+{
+    for (int c = 0; c < ai->classes; c++) {
+        int size = ai->sizes[c];
+
+        for (int dir = 0; dir < 1 + (size > 1); dir++) {
+            int limit = dir ? ai->height : ai->width;
+            int at = dir ? y : x;
+
+            for (int start = at - size + 1; start <= at; start++) {
+                int sx = dir ? x : start;
+                int sy = dir ? start : y;
+                unsigned char* b;
+                unsigned char* h;
+
+                if (start < 1 || start + size - 1 > limit) {
+                    continue;
+                }
+                b = &ai->blocked[c][dir][sy][sx];
+                h = &ai->hits[c][dir][sy][sx];
+                if (*b == 0 && blocked > 0) {
+                    add_placement(ai, c, dir, sx, sy, -1, -*h);
+                } else if (*b == 0) {
+                    add_placement(ai, c, dir, sx, sy, 0, hits);
+                }
+                *b += blocked;
+                *h += hits;
+            }
+        }
+    }
+}
+
+/* Starts targeting the opposing board of a game that has not been played.
+ *
+ * @param (const struct naval_game* game) (game with the rules loaded)
+ * @param (int player) (PLAYER or CPU, side the ai fires for)
+ *
+ * @return (struct naval_ai*) (the new ai, NULL if out of memory or the
+ *         board is larger than MAX)
+ */
+struct naval_ai* naval_ai_create(const struct naval_game* game, int player)
+{
+    struct naval_ai* ai;
+
+    if (game->width > MAX || game->height > MAX) {
+        return NULL;
+    }
+    STATS_ALLOC(1);
+    if ((ai = calloc(1, sizeof(struct naval_ai))) == NULL) {
+        return NULL;
+    }
+    ai->player = player;
+    ai->width = game->width;
+    ai->height = game->height;
+    ai->numShips = game->numShips;
+    for (int ship = 0; ship < game->numShips; ship++) {
+        int size = game->shipSizes[ship];
+        int c = 0;
+
+        ai->shipClass[ship] = -1;
+        if (size <= 0) {
+            continue;
+        }
+        while (c < ai->classes && ai->sizes[c] != size) {
+            c++;
+        }
+        if (c == ai->classes) {
+            ai->sizes[ai->classes++] = size;
+        }
+        ai->shipClass[ship] = c;
+        ai->afloat[c]++;
+    }
+    for (int c = 0; c < ai->classes; c++) {
+        int size = ai->sizes[c];
+
+        for (int dir = 0; dir < 1 + (size > 1); dir++) {
+            for (int y = 1; y + (dir ? size - 1 : 0) <= ai->height; y++) {
+                for (int x = 1; x + (dir ? 0 : size - 1) <= ai->width; x++) {
+                    add_placement(ai, c, dir, x, y, 1, 0);
+                }
+            }
+        }
+    }
+    return ai;
+}
+
+/* Frees an ai created with naval_ai_create.
+ *
+ * @param (struct naval_ai* ai) (ai to be freed)
+ */
+void naval_ai_destroy(struct naval_ai* ai)
+{
+    if (ai != NULL) {
+        endgame_free(ai);
+    }
+    free(ai);
+}
+
+/* Picks the unshot position covered by the most legal placements of the
+ * ships still afloat. While some hits are not yet put down to a sunk ship
+ * only placements through those hits count, weighted by the hits they
+ * cover, which keeps firing around them until the ship goes down.
+ *
+ * @param (const struct naval_ai* ai) (ai choosing the shot)
+ * @param (int* x) (set to the x coordinate of the shot)
+ * @param (int* y) (set to the y coordinate of the shot)
+ *
+ * @return (int) (1 if a position was picked, 0 if every one was shot)
+ */
+int naval_ai_choose(const struct naval_ai* ai, int* x, int* y)
+{
+    long best = -1;
+    long bestTarget = -1;
+
+    for (int i = 1; i < (ai->height + 1); i++) {
+        for (int j = 1; j < (ai->width + 1); j++) {
+            long score = ai->total[i][j];
+            long target = ai->pending ? ai->targetTotal[i][j] : 0;
+
+            if (ai->known[i][j] != CELL_UNKNOWN) {
+                continue;
+            }
+            if (target > bestTarget || (target == bestTarget &&
+                    score > best)) {
+                best = score;
+                bestTarget = target;
+                *x = j;
+                *y = i;
+            }
+        }
+    }
+    return best >= 0;
+}
+
+// Work of settle_sinkings: the runs tried for the sinking shots not yet put
+// down to a ship and what every consistent choice of them agrees on
+struct sinkings {
+    unsigned char taken[MAX + 2][MAX + 2];
+    unsigned char loose[MAX + 2][MAX + 2];
+    int used[MAX_SHIPS];
+    int runs[MAX_SHIPS][4];
+    int found[MAX_SHIPS][4];
+    int agreed[MAX_SHIPS];
+    int open;
+    int tight;
+};
+
+/* Checks if a ship may lie on a run of positions as the one the sinking
+ * shot at x, y sank: every position a hit no other ship was given, fired
+ * at no later than the sinking shot and sunk by no other shot.
+ *
+ * @param (const struct naval_ai* ai) (ai that fired the shots)
+ * @param (const struct sinkings* work) (runs given to other ships)
+ * @param (int size) (size of the ship)
+ * @param (int dir) (0 for a row of positions, 1 for a column)
+ * @param (int sx) (x coordinate of the first position)
+ * @param (int sy) (y coordinate of the first position)
+ * @param (int x) (x coordinate of the sinking shot)
+ * @param (int y) (y coordinate of the sinking shot)
+ *
+ * @return (int) (1 if the ship may lie there, 0 otherwise)
+ */
+static int run_fits(const struct naval_ai* ai, const struct sinkings* work,
+        int size, int dir, int sx, int sy, int x, int y)
+{
+    for (int i = 0; i < size; i++) {
+        int px = dir ? sx : sx + i;
+        int py = dir ? sy + i : sy;
+
+        if (ai->known[py][px] != CELL_HIT || work->taken[py][px] ||
+                ai->shotOrder[py][px] > ai->shotOrder[y][x] ||
+                (ai->sank[py][px] && (px != x || py != y))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Checks if a hit given to no sunk ship may belong to a ship afloat: some
+ * placement of a class with ships left over covers it and an unshot
+ * position, and no miss, sinking shot or hit known to be sunk.
+ *
+ * @param (const struct naval_ai* ai) (ai that fired the shots)
+ * @param (const struct sinkings* work) (runs given to the sunk ships)
+ * @param (int x) (x coordinate of the hit)
+ * @param (int y) (y coordinate of the hit)
+ *
+ * @return (int) (1 if a ship afloat may cover the hit, 0 otherwise)
+ */
+static int hit_covered(const struct naval_ai* ai,
+        const struct sinkings* work, int x, int y)
+{
+    for (int c = 0; c < ai->classes; c++) {
+        int size = ai->sizes[c];
+
+        if (ai->afloat[c] <= work->used[c]) {
+            continue;
+        }
+        for (int dir = 0; dir < 1 + (size > 1); dir++) {
+            int limit = dir ? ai->height : ai->width;
+            int at = dir ? y : x;
+
+            for (int start = at - size + 1; start <= at; start++) {
+                int unshot = 0;
+                int i = 0;
+
+                if (start < 1 || start + size - 1 > limit) {
+                    continue;
+                }
+                for (; i < size; i++) {
+                    int px = dir ? x : start + i;
+                    int py = dir ? start + i : y;
+                    int cell = ai->known[py][px];
+
+                    if ((cell != CELL_UNKNOWN && cell != CELL_HIT) ||
+                            work->taken[py][px] || ai->sank[py][px] ||
+                            ai->settled[py][px]) {
+                        break;
+                    }
+                    unshot |= cell == CELL_UNKNOWN;
+                }
+                if (i == size && unshot) {
+                    return 1;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+/* Checks if the search can stop, with no sinking shot given a single
+ * run and every hit left to no sunk ship in some choice of runs.
+ *
+ * @param (const struct sinkings* work) (runs agreed on so far)
+ *
+ * @return (int) (1 if nothing more can be learnt, 0 otherwise)
+ */
+static int agreed_all(const struct sinkings* work)
+{
+    return work->open == 0 && work->tight == 0;
+}
+
+/* Tries every run for the sinking shots from the k-th on, given the runs
+ * of those before it. Once each has a run and every other hit may still
+ * belong to a ship afloat, the runs are compared with those of earlier
+ * choices and the hits left over are noted, stopping when neither can
+ * tell anything more.
+ *
+ * @param (const struct naval_ai* ai) (ai that fired the shots)
+ * @param (struct sinkings* work) (runs chosen so far and agreed on)
+ * @param (int k) (index of the sinking shot to find a run for)
+ */
+static void try_sinkings(const struct naval_ai* ai, struct sinkings* work,
+        int k)
+{
+    int x;
+    int y;
+
+    if (k == ai->unresolved) {
+        for (int i = 1; i < (ai->height + 1); i++) {
+            for (int j = 1; j < (ai->width + 1); j++) {
+                if (ai->known[i][j] == CELL_HIT && !work->taken[i][j] &&
+                        (ai->settled[i][j] || !hit_covered(ai, work, j, i))) {
+                    return;
+                }
+            }
+        }
+        for (int i = 1; i < (ai->height + 1); i++) {
+            for (int j = 1; j < (ai->width + 1); j++) {
+                if (ai->known[i][j] == CELL_HIT && !work->taken[i][j] &&
+                        !work->loose[i][j]) {
+                    work->loose[i][j] = 1;
+                    work->tight--;
+                }
+            }
+        }
+        for (int i = 0; i < k; i++) {
+            if (work->agreed[i] == 0) {
+                for (int f = 0; f < 4; f++) {
+                    work->found[i][f] = work->runs[i][f];
+                }
+                work->agreed[i] = 1;
+            } else if (work->agreed[i] == 1 && (work->found[i][0] !=
+                    work->runs[i][0] || work->found[i][1] != work->runs[i][1] ||
+                    work->found[i][2] != work->runs[i][2] ||
+                    work->found[i][3] != work->runs[i][3])) {
+                work->agreed[i] = 2;
+                work->open--;
+            }
+        }
+        return;
+    }
+    x = ai->sinkX[k];
+    y = ai->sinkY[k];
+    for (int c = 0; c < ai->classes && !agreed_all(work); c++) {
+        int size = ai->sizes[c];
+
+        if (ai->afloat[c] <= work->used[c]) {
+            continue;
+        }
+        for (int dir = 0; dir < 1 + (size > 1) && !agreed_all(work); dir++) {
+            int limit = dir ? ai->height : ai->width;
+            int at = dir ? y : x;
+
+            for (int start = at - size + 1; start <= at && !agreed_all(work);
+                    start++) {
+                int sx = dir ? x : start;
+                int sy = dir ? start : y;
+
+                if (start < 1 || start + size - 1 > limit ||
+                        !run_fits(ai, work, size, dir, sx, sy, x, y)) {
+                    continue;
+                }
+                for (int i = 0; i < size; i++) {
+                    work->taken[dir ? sy + i : sy][dir ? sx : sx + i] = 1;
+                }
+                work->used[c]++;
+                work->runs[k][0] = c;
+                work->runs[k][1] = dir;
+                work->runs[k][2] = sx;
+                work->runs[k][3] = sy;
+                try_sinkings(ai, work, k + 1);
+                work->used[c]--;
+                for (int i = 0; i < size; i++) {
+                    work->taken[dir ? sy + i : sy][dir ? sx : sx + i] = 0;
+                }
+            }
+        }
+    }
+}
+
+/* Stops chasing a hit that belongs to a sunk ship, although which one
+ * may not be known yet.
+ *
+ * @param (struct naval_ai* ai) (ai being updated)
+ * @param (int x) (x coordinate of the hit)
+ * @param (int y) (y coordinate of the hit)
+ */
+static void settle_hit(struct naval_ai* ai, int x, int y)
+{
+    if (!ai->settled[y][x]) {
+        ai->settled[y][x] = 1;
+        update_through(ai, x, y, 0, -1);
+        update_through(ai, x, y, 1, 0);
+        ai->pending--;
+    }
+}
+
+/* Takes a sunk ship off the ships afloat, its positions no longer hits to
+ * chase.
+ *
+ * @param (struct naval_ai* ai) (ai being updated)
+ * @param (int c) (class of the ship)
+ * @param (int dir) (0 for a row of positions, 1 for a column)
+ * @param (int sx) (x coordinate of the first position)
+ * @param (int sy) (y coordinate of the first position)
+ */
+static void sink_ship(struct naval_ai* ai, int c, int dir, int sx, int sy)
+{
+    for (int i = 1; i < (ai->height + 1); i++) {
+        for (int j = 1; j < (ai->width + 1); j++) {
+            ai->total[i][j] -= ai->density[c][i][j];
+            ai->targetTotal[i][j] -= ai->target[c][i][j];
+        }
+    }
+    ai->afloat[c]--;
+    for (int i = 0; i < ai->sizes[c]; i++) {
+        int px = dir ? sx : sx + i;
+        int py = dir ? sy + i : sy;
+
+        settle_hit(ai, px, py);
+        ai->known[py][px] = CELL_SUNK;
+    }
+}
+
+/* Works out which ships the sinking shots sank from the shots alone. Each
+ * ship lies on a run of hits through its sinking shot, fired no later than
+ * it, and the hits left over must still fit ships afloat. A sinking shot is
+ * put down to a ship once every such choice of runs gives it the same one.
+ * Until then only the hits that every choice gives to some sunk ship stop
+ * being chased, as shots around the others are what tell the runs apart.
+ *
+ * @param (struct naval_ai* ai) (ai that fired the shots)
+ */
+static void settle_sinkings(struct naval_ai* ai)
+{
+    struct sinkings work;
+
+    memset(&work, 0, sizeof(work));
+    work.open = ai->unresolved;
+    for (int i = 1; i < (ai->height + 1); i++) {
+        for (int j = 1; j < (ai->width + 1); j++) {
+            work.tight += ai->known[i][j] == CELL_HIT && !ai->settled[i][j];
+        }
+    }
+    try_sinkings(ai, &work, 0);
+    for (int i = 1; i < (ai->height + 1) && work.agreed[0] != 0; i++) {
+        for (int j = 1; j < (ai->width + 1); j++) {
+            if (ai->known[i][j] == CELL_HIT && !work.loose[i][j]) {
+                settle_hit(ai, j, i);
+            }
+        }
+    }
+    for (int i = ai->unresolved - 1; i >= 0; i--) {
+        if (work.agreed[i] == 1) {
+            sink_ship(ai, work.found[i][0], work.found[i][1],
+                    work.found[i][2], work.found[i][3]);
+            ai->unresolved--;
+            ai->sinkX[i] = ai->sinkX[ai->unresolved];
+            ai->sinkY[i] = ai->sinkY[ai->unresolved];
+        }
+    }
+}
+
+/* Records the outcome of a shot at position x, y, going by nothing but
+ * whether it missed, hit or sank a ship, as a player is told. Every shot
+ * may tell apart the ships sinking shots could have sunk, so the ones not
+ * yet put down to a ship are settled again.
+ *
+ * @param (struct naval_ai* ai) (ai that fired the shot)
+ * @param (int x) (x coordinate of the shot)
+ * @param (int y) (y coordinate of the shot)
+ * @param (int shot) (SHOT_MISS, SHOT_HIT or SHOT_SUNK)
+ */
+static void observe(struct naval_ai* ai, int x, int y, int shot)
+{
+    ai->shotOrder[y][x] = ++ai->shots;
+    ai->sank[y][x] = shot == SHOT_SUNK;
+    if (shot == SHOT_MISS) {
+        ai->known[y][x] = CELL_MISS;
+        update_through(ai, x, y, 1, 0);
+    } else {
+        ai->known[y][x] = CELL_HIT;
+        ai->pending++;
+        update_through(ai, x, y, 0, 1);
+    }
+    if (shot == SHOT_SUNK && ai->unresolved < MAX_SHIPS) {
+        ai->sinkX[ai->unresolved] = x;
+        ai->sinkY[ai->unresolved] = y;
+        ai->unresolved++;
+    }
+    if (ai->unresolved > 0) {
+        settle_sinkings(ai);
+    }
+}
+
+/* Chooses a shot for the ai's side, exactly once few ships are left when
+ * the endgame solver is on, fires it and learns from the outcome.
+ *
+ * @param (struct naval_ai* ai) (ai of the side moving)
+ * @param (struct naval_game* game) (game being played)
+ * @param (int* x) (set to the x coordinate of the shot)
+ * @param (int* y) (set to the y coordinate of the shot)
+ *
+ * @return (int) (one of enum Shots, SHOT_BAD if no position is left)
+ */
+int naval_ai_move(struct naval_ai* ai, struct naval_game* game, int* x,
+        int* y)
+{
+    int shot;
+
+    if (!endgame_choose(ai, x, y) && !(ai->thinkMs > 0 ?
+            mcts_choose(ai, x, y) : naval_ai_choose(ai, x, y))) {
+        return SHOT_BAD;
+    }
+    shot = naval_fire(game, ai->player, *x, *y);
+    if (shot == SHOT_MISS || shot == SHOT_HIT || shot == SHOT_SUNK) {
+        observe(ai, *x, *y, shot);
+    } else {
+        ai->known[*y][*x] = CELL_MISS;
+    }
+    return shot;
+}
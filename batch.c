@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "naval.h"
+#include "commands.h"
+
+/* Loads and plays the game described by one manifest line.
+ *
+ * @param (char* paths[]) (rules, player map, cpu map, cpu turns and player
+ *         moves filenames)
+ * @param (const struct options* options) (settings of the game)
+ * @param (struct naval_result* result) (filled in with the outcome)
+ *
+ * @return (int) (0 if the game was won, otherwise its error code, E_RULES
+ *         if out of memory)
+ */
+int play_entry(char* paths[], const struct options* options,
+        struct naval_result* result)
+{
+    static const int missing[ENTRY_FIELDS] = {E_RULES_MISSING,
+            E_PLAYER_MAP_MISSING, E_CPU_MAP_MISSING, E_CPU_TURNS_MISSING,
+            E_PLAYER_MOVES_MISSING};
+    FILE* files[ENTRY_FIELDS];
+    struct naval_game* game;
+    struct naval_ai* ai;
+    int error = 0;
+
+    memset(result, 0, sizeof(*result));
+    for (int i = 0; i < ENTRY_FIELDS; i++) {
+        // cpu turns are only read when the cpu's moves are scripted
+        if (i == 3 && options->cpu != CPU_SCRIPTED) {
+            files[i] = NULL;
+            continue;
+        }
+        files[i] = fopen(paths[i], "r");
+        if (files[i] == NULL && !error) {
+            error = missing[i];
+        }
+    }
+
+    // a game that cannot be allocated fails as its rules would
+    if ((game = naval_create()) == NULL && !error) {
+        error = E_RULES;
+    }
+    if (game != NULL) {
+        naval_set_engine(game, options->engine);
+    }
+    if (!error && !((error = naval_load_rules(game, files[0])) ||
+            (error = naval_load_map(game, PLAYER, files[1])) ||
+            (error = naval_load_map(game, CPU, files[2])))) {
+        if (options->cpu == CPU_SCRIPTED) {
+            error = naval_play(game, files[4], files[3], result);
+        } else if ((ai = naval_ai_create(game, CPU)) == NULL) {
+            error = E_CPU_GIVES_UP;
+        } else {
+            if (options->cpu == CPU_MCTS) {
+                naval_ai_search(ai, options->threads, options->thinkMs);
+            }
+            if (options->endgame > 0) {
+                naval_ai_endgame(ai, options->threads, options->endgame);
+            }
+            error = naval_play_ai(game, files[4], ai, result);
+            naval_ai_destroy(ai);
+        }
+    }
+    naval_destroy(game);
+
+    for (int i = 0; i < ENTRY_FIELDS; i++) {
+        if (files[i] != NULL) {
+            fclose(files[i]);
+        }
+    }
+    return error;
+}
+
+/* Splits a manifest line into its filenames in place.
+ *
+ * @param (char* line) (line read from the manifest)
+ * @param (char* paths[]) (filled in with up to ENTRY_FIELDS filenames)
+ *
+ * @return (int) (number of filenames found)
+ */
+int parse_entry(char* line, char* paths[])
+{
+    char* save;
+    int fields = 0;
+
+    for (char* token = strtok_r(line, " \t", &save); token != NULL &&
+            fields < ENTRY_FIELDS; token = strtok_r(NULL, " \t", &save)) {
+        paths[fields++] = token;
+    }
+    return fields;
+}
+
+/* Prints the result line of one game.
+ *
+ * @param (int game) (position of the game in the manifest, from 1)
+ * @param (const struct naval_result* result) (outcome of the game)
+ * @param (int error) (exit code the game ended with)
+ */
+void print_result(int game, const struct naval_result* result, int error)
+{
+    printf("%d %s %d %d %d %d %d\n", game,
+            (result->winner == PLAYER) ? "player" :
+            (result->winner == CPU) ? "cpu" : "none",
+            result->playerShots, result->cpuShots, result->playerSunk,
+            result->cpuSunk, error);
+}
+
+/* Plays every game listed in the manifest. Each line holds the rules, player
+ * map, cpu map and cpu turns filenames as on the command line, followed by a
+ * file of the player's moves in place of stdin. Prints one line per game:
+ *
+ *     game winner playerShots cpuShots playerSunk cpuSunk code
+ *
+ * where winner is player, cpu or none and code is the exit code the
+ * interactive game would have ended with.
+ *
+ * @param (const char* manifest) (filename of the manifest)
+ * @param (const struct options* options) (settings of every game)
+ *
+ * @return (int) (0 if the manifest was read, E_NOT_ENOUGH_PARAMETERS if it
+ *         is missing)
+ */
+int run_batch(const char* manifest, const struct options* options)
+{
+    FILE* file = fopen(manifest, "r");
+    char line[MANIFEST_LINE_MAX];
+    int game = 0;
+
+    if (file == NULL) {
+        return E_NOT_ENOUGH_PARAMETERS;
+    }
+    while (read_line(file, line, sizeof(line)) != 0 || !feof(file)) {
+        struct naval_result result;
+        char* paths[ENTRY_FIELDS];
+        int fields = parse_entry(line, paths);
+        int error;
+
+        if (fields == 0) {
+            continue;
+        }
+        if (fields < ENTRY_FIELDS) {
+            memset(&result, 0, sizeof(result));
+            error = E_NOT_ENOUGH_PARAMETERS;
+        } else {
+            error = play_entry(paths, options, &result);
+        }
+        print_result(++game, &result, error);
+    }
+    fclose(file);
+    return 0;
+}
@@ -0,0 +1,468 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "game.h"
+
+// Shortest time each benchmark runs for unless given on the command line
+#define BENCH_SECONDS 0.2
+// Longest rules or map text made up for a benchmark
+#define BENCH_TEXT_MAX 1024
+// Lines in the file read_line is timed on
+#define BENCH_LINES 4096
+
+// Board sizes and ship counts every end to end run is made for
+static const int boardSizes[] = {5, 8, 10, 12, 16, 20, 26};
+static const int shipCounts[] = {1, 2, 5, 10, 15};
+
+// Game set up for a benchmark, along with its text and a copy to restore
+struct fixture {
+    struct naval_game* game;
+    struct naval_game* blank;
+    char rules[BENCH_TEXT_MAX];
+    char map[BENCH_TEXT_MAX];
+    char moves[MAX * MAX][4];
+    int x[MAX * MAX];
+    int y[MAX * MAX];
+    int cells;
+    FILE* lines;
+    char* frame;
+    struct naval_generator* sequential;
+    struct naval_generator* uniform;
+    struct naval_placement placements[MAX_SHIPS];
+};
+
+// Kept so the compiler cannot drop calls whose results are unused
+static volatile long sink;
+
+/* Returns the time of a monotonic clock in seconds.
+ */
+static double now(void)
+{
+    struct timespec time;
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+/* Steps a linear congruential generator and returns a number below limit.
+ *
+ * @param (unsigned* seed) (state of the generator)
+ * @param (int limit) (one more than the largest number returned)
+ *
+ * @return (int) (number from 0 to limit - 1)
+ */
+static int next_random(unsigned* seed, int limit)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return (*seed >> 16) % limit;
+}
+
+/* Writes rules and a map text for a square board with ships of lengths 1
+ * to 5 in turn, placed at random. Lengths are capped so the ships cover
+ * about half the board at most, and ships that no longer fit are
+ * shortened.
+ *
+ * @param (struct fixture* fixture) (filled in with the rules and map)
+ * @param (int size) (width and height of the board)
+ * @param (int ships) (number of ships)
+ * @param (unsigned seed) (seed of the placements)
+ *
+ * @return (int) (0 on success, -1 if the ships do not fit)
+ */
+static int make_texts(struct fixture* fixture, int size, int ships,
+        unsigned seed)
+{
+    char taken[MAX + 2][MAX + 2] = {{0}};
+    int rulesLength = sprintf(fixture->rules, "%d %d\n%d\n", size, size,
+            ships);
+    int mapLength = 0;
+    int longest = size * size / (2 * ships);
+
+    longest = (longest < 1) ? 1 : (longest > 5) ? 5 : longest;
+    for (int ship = 0; ship < ships; ship++) {
+        int placed = 0;
+
+        for (int length = 1 + ship % longest; !placed && length > 0;
+                length--) {
+            for (int tries = 0; tries < 1000 && !placed; tries++) {
+                int dir = next_random(&seed, 2);
+                int x = 1 + next_random(&seed, size - (dir ? 0 : length - 1));
+                int y = 1 + next_random(&seed, size - (dir ? length - 1 : 0));
+                int free = 1;
+
+                for (int i = 0; i < length; i++) {
+                    free &= !taken[dir ? y + i : y][dir ? x : x + i];
+                }
+                if (!free) {
+                    continue;
+                }
+                for (int i = 0; i < length; i++) {
+                    taken[dir ? y + i : y][dir ? x : x + i] = 1;
+                }
+                rulesLength += sprintf(fixture->rules + rulesLength, "%d\n",
+                        length);
+                mapLength += sprintf(fixture->map + mapLength, "%c%d %c\n",
+                        'A' + x - 1, y, dir ? 'S' : 'E');
+                placed = 1;
+            }
+        }
+        if (!placed) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Sets up a loaded game with both maps the same, moves covering the board
+ * in a random order and the buffers the benchmarks work on.
+ *
+ * @param (struct fixture* fixture) (filled in with the game)
+ * @param (int size) (width and height of the board)
+ * @param (int ships) (number of ships)
+ * @param (int engine) (one of enum Engines)
+ *
+ * @return (int) (0 on success, -1 if the game could not be set up)
+ */
+static int make_fixture(struct fixture* fixture, int size, int ships,
+        int engine)
+{
+    memset(fixture, 0, sizeof(*fixture));
+    if (make_texts(fixture, size, ships, 1u + size * 31 + ships) ||
+            (fixture->game = naval_create()) == NULL) {
+        return -1;
+    }
+    naval_set_engine(fixture->game, engine);
+    if (naval_load_rules_buffer(fixture->game, fixture->rules,
+            strlen(fixture->rules)) ||
+            (fixture->blank = naval_copy(fixture->game)) == NULL) {
+        return -1;
+    }
+    if (naval_load_map_buffer(fixture->game, PLAYER, fixture->map,
+            strlen(fixture->map)) || naval_load_map_buffer(fixture->game, CPU,
+            fixture->map, strlen(fixture->map))) {
+        return -1;
+    }
+
+    fixture->cells = size * size;
+    for (int i = 0; i < fixture->cells; i++) {
+        sprintf(fixture->moves[i], "%c%d", 'A' + i % size, 1 + i / size);
+    }
+    for (unsigned i = fixture->cells - 1, seed = size; i > 0; i--) {
+        int j = next_random(&seed, i + 1);
+        char move[4];
+
+        memcpy(move, fixture->moves[i], sizeof(move));
+        memcpy(fixture->moves[i], fixture->moves[j], sizeof(move));
+        memcpy(fixture->moves[j], move, sizeof(move));
+    }
+    for (int i = 0; i < fixture->cells; i++) {
+        parse_move(fixture->moves[i], strlen(fixture->moves[i]),
+                &fixture->x[i], &fixture->y[i]);
+    }
+
+    if ((fixture->lines = tmpfile()) == NULL ||
+            (fixture->frame = malloc(4 * (MAX + 2) * (MAX + 4))) == NULL) {
+        return -1;
+    }
+    if ((fixture->sequential = naval_generator_create(fixture->game, size,
+            0)) == NULL || (fixture->uniform = naval_generator_create(
+            fixture->game, size, 1)) == NULL) {
+        return -1;
+    }
+    for (int i = 0; i < BENCH_LINES; i++) {
+        fputs(fixture->moves[i % fixture->cells], fixture->lines);
+        fputc('\n', fixture->lines);
+    }
+    rewind(fixture->lines);
+    return 0;
+}
+
+/* Frees what make_fixture set up.
+ *
+ * @param (struct fixture* fixture) (fixture to be freed)
+ */
+static void free_fixture(struct fixture* fixture)
+{
+    naval_destroy(fixture->game);
+    naval_destroy(fixture->blank);
+    if (fixture->lines != NULL) {
+        fclose(fixture->lines);
+    }
+    free(fixture->frame);
+    naval_generator_destroy(fixture->sequential);
+    naval_generator_destroy(fixture->uniform);
+}
+
+// One benchmark: runs the operation timed count times on a fixture
+typedef void (*bench_fn)(struct fixture* fixture, long count);
+
+// Copies back the blank player board, which read_map needs before each run
+// and is taken off its time
+static void bench_reset(struct fixture* fixture, long count)
+{
+    for (long i = 0; i < count; i++) {
+        copy_board(fixture->game, &fixture->game->playerBoard,
+                &fixture->blank->playerBoard);
+    }
+}
+
+// Reads the lines of a file of moves, starting over at its end
+static void bench_read_line(struct fixture* fixture, long count)
+{
+    char line[NAVAL_LINE_MAX];
+
+    for (long i = 0; i < count; i++) {
+        if (read_line(fixture->lines, line, sizeof(line)) == 0) {
+            rewind(fixture->lines);
+        }
+    }
+}
+
+// Places every ship of the map on a blank player board
+static void bench_read_map(struct fixture* fixture, long count)
+{
+    struct naval_text text;
+
+    for (long i = 0; i < count; i++) {
+        copy_board(fixture->game, &fixture->game->playerBoard,
+                &fixture->blank->playerBoard);
+        naval_text_buffer(&text, fixture->map, strlen(fixture->map));
+        sink += read_map(fixture->game, &text, PLAYER);
+    }
+}
+
+// Places the first ship on an empty player board and takes it off again
+static void bench_ship_directions(struct fixture* fixture, long count)
+{
+    struct board* board = &fixture->game->playerBoard;
+    int size = fixture->game->shipSizes[0];
+
+    copy_board(fixture->game, board, &fixture->blank->playerBoard);
+    for (long i = 0; i < count; i++) {
+        sink += ship_directions(fixture->game, PLAYER, 1, 1, 1, 'S');
+        // take the ship off again by hand, cheaper than a blank board
+        for (int j = 1; j <= size; j++) {
+            CELL(board, 1, j) = NONE;
+        }
+        board->remaining[0] = 0;
+        board->afloat = 0;
+    }
+}
+
+// Fires at every position of the cpu board in turn
+static void bench_check_hit(struct fixture* fixture, long count)
+{
+    for (long i = 0, cell = fixture->cells; i < count; i++, cell++) {
+        // start on an unshot board, and again once every position was hit
+        if (cell == fixture->cells) {
+            copy_board(fixture->game, &fixture->game->cpuBoard,
+                    &fixture->blank->cpuBoard);
+            naval_load_map_buffer(fixture->game, CPU, fixture->map,
+                    strlen(fixture->map));
+            cell = 0;
+        }
+        sink += check_hit(fixture->game, PLAYER, fixture->x[cell],
+                fixture->y[cell]);
+    }
+}
+
+// Checks each ship of the cpu board in turn for being sunk
+static void bench_check_sunk(struct fixture* fixture, long count)
+{
+    for (long i = 0; i < count; i++) {
+        sink += check_sunk(fixture->game, PLAYER,
+                1 + i % fixture->game->numShips);
+    }
+}
+
+// Checks the game for a winner
+static void bench_check_win(struct fixture* fixture, long count)
+{
+    for (long i = 0; i < count; i++) {
+        sink += check_win(fixture->game);
+    }
+}
+
+// Draws the cpu board into the frame
+static void bench_display_cpu_board(struct fixture* fixture, long count)
+{
+    for (long i = 0; i < count; i++) {
+        sink += display_cpu_board(fixture->frame, fixture->game) -
+                fixture->frame;
+    }
+}
+
+// Draws the player board into the frame
+static void bench_display_player_board(struct fixture* fixture, long count)
+{
+    for (long i = 0; i < count; i++) {
+        sink += display_player_board(fixture->frame, fixture->game) -
+                fixture->frame;
+    }
+}
+
+// Draws layouts for the fixture's rules, each ship among the free placements
+static void bench_generate(struct fixture* fixture, long count)
+{
+    for (long i = 0; i < count; i++) {
+        sink += naval_generate(fixture->sequential, fixture->placements);
+    }
+}
+
+// Draws layouts for the fixture's rules, every layout equally likely
+static void bench_generate_uniform(struct fixture* fixture, long count)
+{
+    for (long i = 0; i < count; i++) {
+        sink += naval_generate(fixture->uniform, fixture->placements);
+    }
+}
+
+// Plays whole games on the fixture's rules and map, the player firing in
+// the fixture's order of moves and the cpu in reverse until one side wins
+static void bench_game(struct fixture* fixture, long count)
+{
+    size_t rulesLength = strlen(fixture->rules);
+    size_t mapLength = strlen(fixture->map);
+
+    for (long i = 0; i < count; i++) {
+        struct naval_game* game = naval_create();
+
+        naval_set_engine(game, fixture->game->engine);
+        naval_load_rules_buffer(game, fixture->rules, rulesLength);
+        naval_load_map_buffer(game, PLAYER, fixture->map, mapLength);
+        naval_load_map_buffer(game, CPU, fixture->map, mapLength);
+        for (int move = 0; !naval_winner(game); move++) {
+            naval_move(game, PLAYER, fixture->moves[move]);
+            if (!naval_winner(game)) {
+                naval_move(game, CPU,
+                        fixture->moves[fixture->cells - 1 - move]);
+            }
+        }
+        naval_destroy(game);
+    }
+}
+
+/* Runs a benchmark in rounds until one round takes at least the given
+ * time, sizing each round from how long the one before took.
+ *
+ * @param (bench_fn bench) (benchmark to run)
+ * @param (struct fixture* fixture) (fixture it runs on)
+ * @param (double seconds) (shortest time of the last round)
+ * @param (long* count) (set to the operations of the last round)
+ *
+ * @return (double) (seconds per operation of the last round)
+ */
+static double run(bench_fn bench, struct fixture* fixture, double seconds,
+        long* count)
+{
+    *count = 1;
+    while (1) {
+        double start = now();
+        double elapsed;
+
+        bench(fixture, *count);
+        if ((elapsed = now() - start) >= seconds) {
+            return elapsed / *count;
+        }
+        // rounds too short to time well only say the next can be longer
+        *count = (elapsed > seconds / 100) ?
+                (long) (*count * 1.2 * seconds / elapsed) + 1 : *count * 10;
+    }
+}
+
+/* Times the hot paths of a game on a 10x10 and a 26x26 board, and whole
+ * games over a range of board sizes and ship counts on every engine, and
+ * prints the results as JSON. Board copies made to undo an operation are
+ * timed on their own and taken off the operations that need them.
+ *
+ * @param (int argc) (number of arguments)
+ * @param (char* argv[]) (optionally the shortest time of each benchmark in
+ *        seconds)
+ *
+ * @return (int) (0 if every benchmark ran)
+ */
+int main(int argc, char* argv[])
+{
+    static const struct {
+        const char* name;
+        bench_fn bench;
+        int resets;
+    } micro[] = {
+        {"read_line", bench_read_line, 0},
+        {"read_map", bench_read_map, 1},
+        {"ship_directions", bench_ship_directions, 0},
+        {"check_hit", bench_check_hit, 0},
+        {"check_sunk", bench_check_sunk, 0},
+        {"check_win", bench_check_win, 0},
+        {"display_cpu_board", bench_display_cpu_board, 0},
+        {"display_player_board", bench_display_player_board, 0},
+        {"generate", bench_generate, 0},
+        {"generate_uniform", bench_generate_uniform, 0}
+    };
+    static const int microSizes[] = {10, 26};
+    static const char* engines[] = {"array", "bitboard", "sparse"};
+    double seconds = (argc > 1) ? atof(argv[1]) : BENCH_SECONDS;
+    struct fixture fixture;
+    const char* separator = "";
+    long count;
+
+    if (seconds <= 0) {
+        fprintf(stderr, "Usage: naval-bench [seconds]\n");
+        return 1;
+    }
+
+    printf("{\n  \"benchmarks\": [");
+    for (int s = 0; s < 2; s++) {
+        int size = microSizes[s];
+        int ships = (size == 10) ? 5 : 15;
+        double reset;
+
+        if (make_fixture(&fixture, size, ships, ENGINE_ARRAY)) {
+            fprintf(stderr, "Could not set up a %dx%d board\n", size, size);
+            return 1;
+        }
+        reset = run(bench_reset, &fixture, seconds, &count);
+        for (int m = 0; m < (int) (sizeof(micro) / sizeof(micro[0])); m++) {
+            double perOp = run(micro[m].bench, &fixture, seconds, &count);
+
+            perOp -= micro[m].resets * reset;
+            printf("%s\n    {\"name\": \"%s\", \"width\": %d, \"height\": %d, "
+                    "\"ships\": %d, \"ops\": %ld, \"ns_per_op\": %.2f}",
+                    separator, micro[m].name, size, size, ships, count,
+                    perOp * 1e9);
+            separator = ",";
+            fflush(stdout);
+        }
+        free_fixture(&fixture);
+    }
+
+    printf("\n  ],\n  \"games\": [");
+    separator = "";
+    for (int e = 0; e < (int) (sizeof(engines) / sizeof(engines[0])); e++) {
+        for (int s = 0; s < (int) (sizeof(boardSizes) / sizeof(int)); s++) {
+            for (int c = 0; c < (int) (sizeof(shipCounts) / sizeof(int));
+                    c++) {
+                int size = boardSizes[s];
+                double perGame;
+
+                if (make_fixture(&fixture, size, shipCounts[c], e)) {
+                    fprintf(stderr, "Could not set up a %dx%d board\n", size,
+                            size);
+                    return 1;
+                }
+                perGame = run(bench_game, &fixture, seconds, &count);
+                printf("%s\n    {\"engine\": \"%s\", \"width\": %d, "
+                        "\"height\": %d, \"ships\": %d, \"games\": %ld, "
+                        "\"games_per_sec\": %.1f}", separator, engines[e],
+                        size, size, shipCounts[c], count, 1 / perGame);
+                separator = ",";
+                fflush(stdout);
+                free_fixture(&fixture);
+            }
+        }
+    }
+    printf("\n  ]\n}\n");
+    return 0;
+}
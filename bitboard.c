@@ -0,0 +1,221 @@
+#include <string.h>
+
+#include "bitboard.h"
+
+// Runs of 0 to BITBOARD_STRIDE set bits along a row and down a column
+static struct bitboard rows[BITBOARD_STRIDE + 1];
+static struct bitboard columns[BITBOARD_STRIDE + 1];
+
+/* Fills in the run tables once when the library is loaded.
+ */
+__attribute__((constructor)) static void initialise_runs(void)
+{
+    for (int length = 1; length <= BITBOARD_STRIDE; length++) {
+        rows[length] = rows[length - 1];
+        bitboard_set(&rows[length], length - 1, 0);
+        columns[length] = columns[length - 1];
+        bitboard_set(&columns[length], 0, length - 1);
+    }
+}
+
+/* Shifts a mask towards higher positions.
+ *
+ * @param (struct bitboard* result) (set to the shifted mask)
+ * @param (const struct bitboard* mask) (mask to be shifted)
+ * @param (int bits) (number of bits to shift by)
+ */
+static void shift_left(struct bitboard* result, const struct bitboard* mask,
+        int bits)
+{
+    int words = bits / 64;
+    int offset = bits % 64;
+
+    for (int i = BITBOARD_WORDS - 1; i >= 0; i--) {
+        uint64_t word = 0;
+
+        if (i - words >= 0) {
+            word = mask->words[i - words] << offset;
+            if (offset && i - words - 1 >= 0) {
+                word |= mask->words[i - words - 1] >> (64 - offset);
+            }
+        }
+        result->words[i] = word;
+    }
+}
+
+/* Returns 1 if the masks share a set bit, 0 otherwise.
+ */
+static int intersects(const struct bitboard* a, const struct bitboard* b)
+{
+    uint64_t any = 0;
+
+    for (int i = 0; i < BITBOARD_WORDS; i++) {
+        any |= a->words[i] & b->words[i];
+    }
+    return any != 0;
+}
+
+/* Returns 1 if a has a set bit that b does not, 0 otherwise.
+ */
+static int exceeds(const struct bitboard* a, const struct bitboard* b)
+{
+    uint64_t any = 0;
+
+    for (int i = 0; i < BITBOARD_WORDS; i++) {
+        any |= a->words[i] & ~b->words[i];
+    }
+    return any != 0;
+}
+
+/* Sets the bit of every position on a board of the given size.
+ *
+ * @param (struct bitboard* extent) (set to the mask of the board)
+ * @param (int width) (width of the board)
+ * @param (int height) (height of the board)
+ */
+void bitboard_extent(struct bitboard* extent, int width, int height)
+{
+    struct bitboard row;
+
+    memset(extent, 0, sizeof(*extent));
+    for (int i = 1; i < (height + 1); i++) {
+        shift_left(&row, &rows[width], i * BITBOARD_STRIDE + 1);
+        for (int j = 0; j < BITBOARD_WORDS; j++) {
+            extent->words[j] |= row.words[j];
+        }
+    }
+}
+
+/* Places a ship by shifting the run of its length to its first position.
+ * The run is cut off one position past the border ring at most, which keeps
+ * it from wrapping while still leaving a bit outside the extent for any
+ * ship that does not fit. Positions inside the extent are checked against
+ * the other ships before the rest is checked against the extent, giving the
+ * same errors as placing the ship position by position.
+ *
+ * @param (struct bitboards* bits) (masks of the board being set up)
+ * @param (const struct bitboard* extent) (mask of the board positions)
+ * @param (int player) (PLAYER or CPU depending on which map file)
+ * @param (int shipNum) (ship number)
+ * @param (int size) (number of positions the ship covers)
+ * @param (int x) (x coordinate of the boards position)
+ * @param (int y) (y coordinate of the boards position)
+ * @param (char dir) (direction ship is to be placed in)
+ *
+ * @return (int) (0 on success, otherwise the map error for that player)
+ */
+int bitboard_place(struct bitboards* bits, const struct bitboard* extent,
+        int player, int shipNum, int size, int x, int y, char dir)
+{
+    const struct bitboard* run;
+    struct bitboard ship, inside;
+    int badDirection = 0;
+    int length;
+
+    if (size <= 0) {
+        return 0;
+    }
+    switch (dir) {
+        case 'N':
+            length = (size < y + 1) ? size : y + 1;
+            run = &columns[length];
+            y -= length - 1;
+            break;
+        case 'E':
+            length = (size < BITBOARD_STRIDE - x) ? size : BITBOARD_STRIDE - x;
+            run = &rows[length];
+            break;
+        case 'S':
+            length = (size < BITBOARD_STRIDE - y) ? size : BITBOARD_STRIDE - y;
+            run = &columns[length];
+            break;
+        case 'W':
+            length = (size < x + 1) ? size : x + 1;
+            run = &rows[length];
+            x -= length - 1;
+            break;
+        default:
+            // only the first position is checked before the direction
+            run = &rows[1];
+            badDirection = 1;
+            break;
+    }
+    shift_left(&ship, run, y * BITBOARD_STRIDE + x);
+
+    for (int i = 0; i < BITBOARD_WORDS; i++) {
+        inside.words[i] = ship.words[i] & extent->words[i];
+    }
+    if (intersects(&inside, &bits->occupied)) {
+        return (player == PLAYER) ? E_PLAYER_SHIP_OVERLAP : E_CPU_SHIP_OVERLAP;
+    }
+    if (badDirection) {
+        return (player == PLAYER) ? E_PLAYER_MAP : E_CPU_MAP;
+    }
+    if (exceeds(&ship, extent)) {
+        return (player == PLAYER) ? E_PLAYER_MAP_OOB : E_CPU_MAP_OOB;
+    }
+
+    bits->ships[shipNum - 1] = ship;
+    for (int i = 0; i < BITBOARD_WORDS; i++) {
+        bits->occupied.words[i] |= ship.words[i];
+    }
+    return 0;
+}
+
+/* Returns the number of the ship covering position x, y, NONE if there is
+ * no ship there.
+ *
+ * @param (const struct bitboards* bits) (masks of the board)
+ * @param (int numShips) (number of ships each player has)
+ * @param (int x) (x coordinate of the boards position)
+ * @param (int y) (y coordinate of the boards position)
+ */
+int bitboard_ship_at(const struct bitboards* bits, int numShips, int x, int y)
+{
+    if (bitboard_test(&bits->occupied, x, y)) {
+        for (int ship = 0; ship < numShips; ship++) {
+            if (bitboard_test(&bits->ships[ship], x, y)) {
+                return ship + 1;
+            }
+        }
+    }
+    return NONE;
+}
+
+/* Returns the status of position x, y in the same terms as the array board.
+ *
+ * @param (const struct bitboards* bits) (masks of the board)
+ * @param (int numShips) (number of ships each player has)
+ * @param (int x) (x coordinate of the boards position)
+ * @param (int y) (y coordinate of the boards position)
+ *
+ * @return (int) (NONE, MISS, HIT or the ship number)
+ */
+int bitboard_cell(const struct bitboards* bits, int numShips, int x, int y)
+{
+    if (bitboard_test(&bits->hits, x, y)) {
+        return HIT;
+    }
+    if (bitboard_test(&bits->shots, x, y)) {
+        return MISS;
+    }
+    return bitboard_ship_at(bits, numShips, x, y);
+}
+
+/* Records a shot at position x, y.
+ *
+ * @param (struct bitboards* bits) (masks of the board shot at)
+ * @param (int x) (x coordinate of the boards position)
+ * @param (int y) (y coordinate of the boards position)
+ *
+ * @return (int) (0 if miss, 1 if hit)
+ */
+int bitboard_hit(struct bitboards* bits, int x, int y)
+{
+    bitboard_set(&bits->shots, x, y);
+    if (bitboard_test(&bits->occupied, x, y)) {
+        bitboard_set(&bits->hits, x, y);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,53 @@
+#ifndef BITBOARD_H
+#define BITBOARD_H
+
+#include <stdint.h>
+
+#include "naval.h"
+
+/* Bit y * BITBOARD_STRIDE + x stands for position x, y. The border ring of
+ * the padded board is kept so a ship running off any edge lands on a bit
+ * outside the board extent instead of wrapping onto the next row.
+ */
+#define BITBOARD_STRIDE (MAX + 2)
+#define BITBOARD_BITS (BITBOARD_STRIDE * BITBOARD_STRIDE)
+#define BITBOARD_WORDS ((BITBOARD_BITS + 63) / 64)
+
+struct bitboard {
+    uint64_t words[BITBOARD_WORDS];
+};
+
+// Every mask describing one side's board under ENGINE_BITBOARD
+struct bitboards {
+    struct bitboard ships[MAX_SHIPS];
+    struct bitboard occupied;
+    struct bitboard shots;
+    struct bitboard hits;
+};
+
+/* Sets bit x, y of the mask.
+ */
+static inline void bitboard_set(struct bitboard* mask, int x, int y)
+{
+    int bit = y * BITBOARD_STRIDE + x;
+
+    mask->words[bit / 64] |= (uint64_t)1 << (bit % 64);
+}
+
+/* Returns 1 if bit x, y of the mask is set, 0 otherwise.
+ */
+static inline int bitboard_test(const struct bitboard* mask, int x, int y)
+{
+    int bit = y * BITBOARD_STRIDE + x;
+
+    return (mask->words[bit / 64] >> (bit % 64)) & 1;
+}
+
+void bitboard_extent(struct bitboard* extent, int width, int height);
+int bitboard_place(struct bitboards* bits, const struct bitboard* extent,
+        int player, int shipNum, int size, int x, int y, char dir);
+int bitboard_ship_at(const struct bitboards* bits, int numShips, int x, int y);
+int bitboard_cell(const struct bitboards* bits, int numShips, int x, int y);
+int bitboard_hit(struct bitboards* bits, int x, int y);
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef COMMANDS_H
+#define COMMANDS_H
+
+#include "naval.h"
+
+// Filenames on each manifest line: rules, maps, cpu turns and player moves
+#define ENTRY_FIELDS 5
+// Filenames after naval compile: the four game files and the scenario
+#define COMPILE_FIELDS 5
+// Longest manifest line read, paths included
+#define MANIFEST_LINE_MAX 4096
+// Milliseconds the mcts cpu searches each shot for unless told otherwise
+#define THINK_MS_DEFAULT 5
+// Shots between the snapshots of a journal unless told otherwise
+#define JOURNAL_EVERY_DEFAULT 16
+// Seed of naval genmap unless told otherwise
+#define GENMAP_SEED_DEFAULT 1
+
+// Settings shared by every game a command plays
+struct options {
+    int engine;
+    int cpu;
+    int threads;
+    int thinkMs;
+    int stats;
+    int endgame;
+};
+
+int parse_option(int argc, char* argv[], int* index, struct options* options);
+void start_stats(void);
+
+/* Plays every game listed in the manifest file without prompts or boards
+ * and prints one result line per game.
+ *
+ * @return (int) (exit code of the naval process)
+ */
+int run_batch(const char* manifest, const struct options* options);
+
+/* Writes the game of the rules, map and turns files as a compiled scenario.
+ *
+ * @return (int) (exit code of the naval process)
+ */
+int run_compile(char* paths[]);
+
+/* Replays the cpu turns and prints the chance of a ship at every position
+ * of the player's board.
+ *
+ * @return (int) (exit code of the naval process)
+ */
+int show_heatmap(struct naval_game* game, struct naval_turns* turns,
+        const struct options* options);
+
+/* Serves the loaded game to every player connecting to the address, with
+ * the same prompts and replies as the interactive game.
+ *
+ * @return (int) (exit code of the naval process)
+ */
+int run_server(const char* address, const struct naval_game* game,
+        const struct naval_turns* turns, const struct options* options);
+
+/* Checks journals or shows their boards after a move.
+ *
+ * @return (int) (exit code of the naval process)
+ */
+int run_replay(int argc, char* argv[], const struct options* options);
+
+/* Checks every map under the directories, tar archives and files given
+ * against a rules file on all cores and reports each problem found.
+ *
+ * @return (int) (exit code of the naval process)
+ */
+int run_validate(int argc, char* argv[], const struct options* options);
+
+/* Writes random legal maps for a rules file as text, one file per map or
+ * a binary stream.
+ *
+ * @return (int) (exit code of the naval process)
+ */
+int run_genmap(int argc, char* argv[]);
+
+/* Plays a turns file against every player map under the directories and
+ * files given on all cores and prints how many shots it took to win.
+ *
+ * @return (int) (exit code of the naval process)
+ */
+int run_evaluate(int argc, char* argv[], const struct options* options);
+
+int read_file(const char* path, char** buffer, size_t* capacity,
+        size_t* length);
+int walk_directory(const char* directory, int ordered,
+        int (*visit)(void* context, const char* path), void* context);
+
+int parse_entry(char* line, char* paths[]);
+int play_entry(char* paths[], const struct options* options,
+        struct naval_result* result);
+void print_result(int game, const struct naval_result* result, int error);
+
+#endif
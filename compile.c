@@ -0,0 +1,58 @@
+#include <stdio.h>
+
+#include "naval.h"
+#include "commands.h"
+
+/* Loads a game from its text files and writes it out as a compiled
+ * scenario, so later runs start with naval --scenario and no parsing.
+ *
+ * @param (char* paths[]) (rules, player map, cpu map, cpu turns and
+ *        scenario filenames)
+ *
+ * @return (int) (exit code of the naval process)
+ */
+int run_compile(char* paths[])
+{
+    static const int missing[COMPILE_FIELDS - 1] = {E_RULES_MISSING,
+            E_PLAYER_MAP_MISSING, E_CPU_MAP_MISSING, E_CPU_TURNS_MISSING};
+    FILE* files[COMPILE_FIELDS];
+    struct naval_game* game;
+    struct naval_text text;
+    struct naval_turns turns;
+    int error = 0;
+
+    for (int i = 0; i < COMPILE_FIELDS - 1; i++) {
+        files[i] = fopen(paths[i], "r");
+        if (files[i] == NULL && !error) {
+            error = missing[i];
+        }
+    }
+    files[COMPILE_FIELDS - 1] = NULL;
+
+    if ((game = naval_create()) == NULL && !error) {
+        error = E_SCENARIO;
+    }
+    if (!error && !((error = naval_load_rules(game, files[0])) ||
+            (error = naval_load_map(game, PLAYER, files[1])) ||
+            (error = naval_load_map(game, CPU, files[2])))) {
+        if (naval_text_open(&text, files[3])) {
+            error = E_CPU_TURNS_MISSING;
+        } else {
+            if (naval_turns_decode(&turns, &text, game) ||
+                    (files[4] = fopen(paths[4], "w")) == NULL ||
+                    naval_scenario_write(game, &turns, files[4])) {
+                error = E_SCENARIO;
+            }
+            naval_turns_free(&turns);
+            naval_text_close(&text);
+        }
+    }
+    naval_destroy(game);
+
+    for (int i = 0; i < COMPILE_FIELDS; i++) {
+        if (files[i] != NULL && fclose(files[i]) != 0 && !error) {
+            error = E_SCENARIO;
+        }
+    }
+    return error;
+}
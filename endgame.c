@@ -0,0 +1,1015 @@
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "game.h"
+
+// Most layouts of the ships afloat the solver searches over
+#define ENDGAME_MAX_LAYOUTS 4096
+// Most unshot positions the ships afloat may cover, one bit of a mask each
+#define ENDGAME_MAX_CELLS 64
+// Most hit positions the ships may cover, one bit of a mask each
+#define ENDGAME_MAX_HITS 64
+// Transposition table entries of one search, shared out between its threads
+#define ENDGAME_TABLE_ENTRIES (1 << 16)
+// Entries of a bucket, of which the least recently used is replaced
+#define ENDGAME_WAYS 4
+// Layouts one thread may look through before the solver gives up on a shot
+#define ENDGAME_MAX_VISITS (1L << 20)
+#define ENDGAME_MAX_THREADS 64
+
+/* Every layout of the ships, sunk or afloat, that agrees with the shots
+ * the ai has fired. The unshot positions the ships afloat in any of them
+ * cover are numbered, cells of them, and each layout keeps the ship over
+ * every numbered position (0 for none), the mask of those it covers and
+ * the pieces of each ship, the mask of the numbered positions under it.
+ * Each layout also has two random Zobrist keys, and a set of layouts is
+ * known by the exclusive or of their keys. marks holds a key for each
+ * numbered position and hitKey the keys of the positions hit so far.
+ */
+struct layouts {
+    int count;
+    int cells;
+    int x[ENDGAME_MAX_CELLS];
+    int y[ENDGAME_MAX_CELLS];
+    uint64_t marks[ENDGAME_MAX_CELLS];
+    uint64_t hitKey;
+    unsigned char (*owner)[ENDGAME_MAX_CELLS];
+    uint64_t (*pieces)[MAX_SHIPS + 1];
+    uint64_t* cover;
+    uint64_t* keys;
+    uint64_t* checks;
+};
+
+// What a shot tells of a layout, all a player is told of it
+enum Outcomes {
+    OUTCOME_MISS,
+    OUTCOME_HIT,
+    OUTCOME_SUNK,
+    OUTCOMES
+};
+
+/* Solved state of the transposition table, known by the keys of the
+ * layouts left and of the positions hit: whether a shot sinks a ship
+ * depends on which of its positions were hit before, and otherwise the
+ * shots that led there only matter through the layouts they leave. misses
+ * is the fewest misses expected from there on, or only a lower bound on
+ * them if exact is clear. stamp orders the entries of a bucket by last
+ * use, 0 for an empty entry.
+ */
+struct entry {
+    uint64_t hash;
+    uint64_t check;
+    double misses;
+    unsigned stamp;
+    int exact;
+};
+
+/* Transposition table of one search thread. Sets of layouts are known by
+ * where their ships lie, so the ai keeps the tables from one shot to the
+ * next and the states a shot leaves are often solved already.
+ */
+struct endgame_table {
+    struct entry* entries;
+    size_t buckets;
+    unsigned clock;
+};
+
+/* Work of one search thread: its share of the first shots, every step-th
+ * of them from first, its own table, and room for the layouts left after
+ * each shot on the way down.
+ */
+struct solver {
+    const struct layouts* layouts;
+    const int* moves;
+    int count;
+    int first;
+    int step;
+    struct endgame_table* table;
+    long visits;
+    int failed;
+    uint16_t* lists;
+    double best;
+    int bestMove;
+};
+
+/* Steps a splitmix64 generator.
+ *
+ * @param (uint64_t* seed) (state of the generator)
+ *
+ * @return (uint64_t) (the next number)
+ */
+static uint64_t next_key(uint64_t* seed)
+{
+    uint64_t z = (*seed += 0x9e3779b97f4a7c15ULL);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/* Returns the key of a board position, the same from one search to the
+ * next.
+ */
+static uint64_t position_key(int x, int y)
+{
+    uint64_t seed = ((uint64_t)y * (MAX + 2) + x) ^ 0x2545f4914f6cdd1dULL;
+
+    return next_key(&seed);
+}
+
+/* Tells what firing at a position says of a layout: a miss, a hit, or a
+ * sunk ship when the rest of the ship there was shot already.
+ *
+ * @param (const struct layouts* layouts) (layouts searched)
+ * @param (int l) (number of the layout)
+ * @param (uint64_t shots) (positions shot since the search started)
+ * @param (int cell) (position fired at)
+ *
+ * @return (int) (one of enum Outcomes)
+ */
+static int outcome(const struct layouts* layouts, int l, uint64_t shots,
+        int cell)
+{
+    int ship = layouts->owner[l][cell];
+
+    if (ship == 0) {
+        return OUTCOME_MISS;
+    }
+    return ((layouts->pieces[l][ship] & ~shots) == (uint64_t)1 << cell) ?
+            OUTCOME_SUNK : OUTCOME_HIT;
+}
+
+/* Looks a set of layouts up in the table, marking it as the most recently
+ * used.
+ *
+ * @return (struct entry*) (the entry of the set, NULL if absent)
+ */
+static struct entry* find_entry(struct solver* work, uint64_t hash,
+        uint64_t check)
+{
+    struct entry* bucket = work->table->entries +
+            (hash & (work->table->buckets - 1)) * ENDGAME_WAYS;
+
+    for (int w = 0; w < ENDGAME_WAYS; w++) {
+        if (bucket[w].stamp && bucket[w].hash == hash &&
+                bucket[w].check == check) {
+            bucket[w].stamp = ++work->table->clock;
+            return &bucket[w];
+        }
+    }
+    return NULL;
+}
+
+/* Adds a solved set of layouts to the table, over its own entry if it has
+ * one and otherwise in place of the least recently used of its bucket.
+ */
+static void store_entry(struct solver* work, struct entry* entry,
+        uint64_t hash, uint64_t check, double misses, int exact)
+{
+    struct entry* bucket = work->table->entries +
+            (hash & (work->table->buckets - 1)) * ENDGAME_WAYS;
+
+    for (int w = 1; entry == NULL && w < ENDGAME_WAYS; w++) {
+        if (bucket[w].stamp < bucket[0].stamp) {
+            entry = &bucket[w];
+        }
+    }
+    if (entry == NULL) {
+        entry = &bucket[0];
+    }
+    entry->hash = hash;
+    entry->check = check;
+    entry->misses = misses;
+    entry->exact = exact;
+    entry->stamp = ++work->table->clock;
+}
+
+/* Adds a position to the shots worth trying, kept from the likeliest to
+ * hold a ship down, unless one already there splits the layouts the same
+ * way. Positions that split alike have the same sum of layout keys times
+ * outcomes, and cover as many layouts.
+ *
+ * @param (int* order) (shots worth trying)
+ * @param (int count) (number of them)
+ * @param (const int* covering) (layouts with a ship on each position)
+ * @param (const uint64_t* split) (sum of keys times outcomes of each
+ *        position)
+ * @param (int cell) (position added)
+ *
+ * @return (int) (number of shots worth trying now)
+ */
+static int add_move(int* order, int count, const int* covering,
+        const uint64_t* split, int cell)
+{
+    int at = count;
+
+    while (at > 0 && covering[order[at - 1]] < covering[cell]) {
+        at--;
+    }
+    for (int i = at - 1; i >= 0 && covering[order[i]] == covering[cell];
+            i--) {
+        if (split[order[i]] == split[cell]) {
+            return count;
+        }
+    }
+    memmove(order + at + 1, order + at, (count - at) * sizeof(int));
+    order[at] = cell;
+    return count + 1;
+}
+
+static double solve(struct solver* work, int level, const uint16_t* list,
+        int count, uint64_t shots, uint64_t hitKey, uint64_t hash,
+        uint64_t check, double bound);
+
+/* Works out the misses expected from firing at a position: a miss for the
+ * layouts without a ship there, and then the fewest expected from each
+ * outcome, the layouts being split by whether the shot misses, hits or
+ * sinks a ship, not by which ship it is. Each outcome is only
+ * searched as far as it could keep the total under bound, and the total
+ * is given up on once it reaches bound, since the shot is then no better
+ * than one already found.
+ *
+ * @param (struct solver* work) (thread searching)
+ * @param (int level) (shots fired since the search started)
+ * @param (const uint16_t* list) (layouts agreeing with those shots)
+ * @param (int count) (number of layouts)
+ * @param (uint64_t shots) (positions shot since the search started)
+ * @param (uint64_t hitKey) (keys of the positions hit so far)
+ * @param (int cell) (position fired at)
+ * @param (double bound) (misses of the best shot found so far)
+ *
+ * @return (double) (the misses expected if below bound, otherwise a lower
+ *         bound on them no smaller than bound)
+ */
+static double try_shot(struct solver* work, int level, const uint16_t* list,
+        int count, uint64_t shots, uint64_t hitKey, int cell, double bound)
+{
+    const struct layouts* layouts = work->layouts;
+    uint16_t* split = work->lists + (size_t)(level + 1) * layouts->count;
+    int start[OUTCOMES + 1] = {0};
+    uint64_t hash[OUTCOMES] = {0};
+    uint64_t check[OUTCOMES] = {0};
+    double misses;
+
+    work->visits += count;
+    for (int l = 0; l < count; l++) {
+        int o = outcome(layouts, list[l], shots, cell);
+
+        start[o + 1]++;
+        hash[o] ^= layouts->keys[list[l]];
+        check[o] ^= layouts->checks[list[l]];
+    }
+    misses = (double)start[1] / count;
+    for (int o = 1; o < OUTCOMES + 1; o++) {
+        start[o] += start[o - 1];
+    }
+    for (int l = 0; l < count; l++) {
+        split[start[outcome(layouts, list[l], shots, cell)]++] = list[l];
+    }
+
+    // start[o] now ends the layouts with outcome o and begins outcome o + 1
+    for (int o = 0, from = 0; o < OUTCOMES && misses < bound; o++) {
+        double weight = (double)(start[o] - from) / count;
+        double limit = (bound - misses) / weight;
+        uint64_t hit = hitKey ^
+                ((o == OUTCOME_MISS) ? 0 : layouts->marks[cell]);
+        double rest;
+
+        if (start[o] > from) {
+            rest = solve(work, level + 1, split + from, start[o] - from,
+                    shots | (uint64_t)1 << cell, hit, hash[o] ^ hit,
+                    check[o], limit);
+            misses += weight * rest;
+            if (work->failed || rest >= limit) {
+                return (misses > bound) ? misses : bound;
+            }
+        }
+        from = start[o];
+    }
+    return misses;
+}
+
+/* Works out the fewest misses expected before every ship afloat sinks,
+ * with each layout left equally likely. Every ship position has to be
+ * fired at whatever the order, so the hits are the same for every order of
+ * shots and only the misses differ, and those depend only on the layouts
+ * left. A position every layout has a ship on is fired at first, since the
+ * shot costs nothing and only tells more. Otherwise each position is tried
+ * from the likeliest to hold a ship down, once for all positions that
+ * split the layouts the same way, and the rest are skipped once the chance
+ * of a miss alone is no better than the best total found or bound.
+ *
+ * @param (struct solver* work) (thread searching)
+ * @param (int level) (shots fired since the search started)
+ * @param (const uint16_t* list) (layouts agreeing with those shots)
+ * @param (int count) (number of layouts)
+ * @param (uint64_t shots) (positions shot since the search started)
+ * @param (uint64_t hitKey) (keys of the positions hit so far)
+ * @param (uint64_t hash) (key of the layouts and the positions hit)
+ * @param (uint64_t check) (second key of the layouts)
+ * @param (double bound) (misses beyond which the exact number is not needed)
+ *
+ * @return (double) (the misses expected if below bound, otherwise a lower
+ *         bound on them no smaller than bound)
+ */
+static double solve(struct solver* work, int level, const uint16_t* list,
+        int count, uint64_t shots, uint64_t hitKey, uint64_t hash,
+        uint64_t check, double bound)
+{
+    const struct layouts* layouts = work->layouts;
+    int covering[ENDGAME_MAX_CELLS] = {0};
+    uint64_t split[ENDGAME_MAX_CELLS] = {0};
+    int order[ENDGAME_MAX_CELLS];
+    int cells = 0;
+    int sure = -1;
+    uint64_t open = 0;
+    struct entry* entry;
+    double best = HUGE_VAL;
+    double lower = HUGE_VAL;
+
+    if (count == 1) {
+        return 0;
+    }
+    entry = find_entry(work, hash, check);
+    if (entry != NULL && (entry->exact || entry->misses >= bound)) {
+        return entry->misses;
+    }
+    if ((work->visits += count) > ENDGAME_MAX_VISITS) {
+        work->failed = 1;
+        return bound;
+    }
+
+    // positions with the same sum of keys times outcomes split alike
+    for (int l = 0; l < count; l++) {
+        uint64_t mask = layouts->cover[list[l]] & ~shots;
+        uint64_t key = layouts->keys[list[l]];
+
+        open |= mask;
+        for (; mask; mask &= mask - 1) {
+            int cell = __builtin_ctzll(mask);
+
+            covering[cell]++;
+            split[cell] += key * outcome(layouts, list[l], shots, cell);
+        }
+    }
+    for (uint64_t mask = open; mask; mask &= mask - 1) {
+        int cell = __builtin_ctzll(mask);
+
+        if (covering[cell] == count) {
+            sure = cell;
+            break;
+        }
+        cells = add_move(order, cells, covering, split, cell);
+    }
+    if (sure >= 0) {
+        lower = try_shot(work, level, list, count, shots, hitKey, sure,
+                bound);
+        best = (lower < bound) ? lower : HUGE_VAL;
+    }
+    for (int i = 0; i < cells && sure < 0 && !work->failed; i++) {
+        double limit = (best < bound) ? best : bound;
+        double alone = (double)(count - covering[order[i]]) / count;
+        double misses;
+
+        if (alone >= limit) {
+            lower = (alone < lower) ? alone : lower;
+            break;
+        }
+        misses = try_shot(work, level, list, count, shots, hitKey, order[i],
+                limit);
+        if (misses < limit) {
+            best = misses;
+        }
+        lower = (misses < lower) ? misses : lower;
+    }
+    if (work->failed) {
+        return bound;
+    }
+    if (best < bound) {
+        store_entry(work, entry, hash, check, best, 1);
+        return best;
+    }
+    store_entry(work, entry, hash, check, lower, 0);
+    return lower;
+}
+
+/* Ways the ships of one size may lie. Each placement keeps where it starts
+ * and its direction in place, the unshot positions it covers as bits of
+ * the numbered positions (0 for a sunk ship), the hits it covers as bits of
+ * the numbered hits, and a random key made from the size and where it
+ * lies, which stays the same from one search to the next.
+ */
+struct ship_layouts {
+    int count;
+    int* place;
+    uint64_t* masks;
+    uint64_t* hits;
+    uint64_t* ids;
+};
+
+/* Ships placed by list_layouts, level by level. Ships of a size are placed
+ * one after the other and in increasing order of placement, so a layout is
+ * listed once however its ships of a size are swapped. class and ship give
+ * the size class and number of the ship at each level, cellsLeft the
+ * positions of the ships from that level on, hits every hit position and
+ * afloat the ships not sunk.
+ */
+struct fleet {
+    int count;
+    int afloat;
+    uint64_t hits;
+    int class[MAX_SHIPS];
+    int ship[MAX_SHIPS];
+    int cellsLeft[MAX_SHIPS + 1];
+    struct ship_layouts classes[MAX_SHIPS];
+};
+
+/* Tests whether a ship may lie at a placement given the shots alone: on the
+ * board and over no miss, and either over some unshot position and no shot
+ * that sank a ship, or over hits only, the last of them fired being the
+ * one that sank a ship.
+ *
+ * @param (const struct naval_ai* ai) (ai whose shots are used)
+ * @param (int size) (length of the ship)
+ * @param (int dir) (0 for a row of positions, 1 for a column)
+ * @param (int x) (x coordinate of the first position)
+ * @param (int y) (y coordinate of the first position)
+ *
+ * @return (int) (1 if the ship may lie there, 0 otherwise)
+ */
+static int may_lie(const struct naval_ai* ai, int size, int dir, int x,
+        int y)
+{
+    int unshot = 0;
+    int sinking = 0;
+    int last = 0;
+    int lastSank = 0;
+
+    if (dir ? y + size - 1 > ai->height : x + size - 1 > ai->width) {
+        return 0;
+    }
+    for (int i = 0; i < size; i++) {
+        int px = dir ? x : x + i;
+        int py = dir ? y + i : y;
+
+        if (ai->known[py][px] == CELL_UNKNOWN) {
+            unshot++;
+            continue;
+        } else if (ai->known[py][px] == CELL_MISS) {
+            return 0;
+        }
+        sinking += ai->sank[py][px];
+        if (ai->shotOrder[py][px] > last) {
+            last = ai->shotOrder[py][px];
+            lastSank = ai->sank[py][px];
+        }
+    }
+    return unshot ? sinking == 0 : (sinking == 1 && lastSank);
+}
+
+/* Gives each shot that sank a ship a sunk placement over it, clear of the
+ * others, in every way the ships allow, and marks the size classes that
+ * still have a ship afloat in any of them.
+ *
+ * @param (const struct fleet* fleet) (ships and their placements)
+ * @param (const int* ships) (ships of each class)
+ * @param (const uint64_t* sinking) (shots that sank a ship, one bit each)
+ * @param (int count) (number of those shots)
+ * @param (int level) (shot given a placement)
+ * @param (uint64_t taken) (hits under the placements given)
+ * @param (int* used) (ships of each class given a placement)
+ * @param (int* possible) (set to 1 for each class that may have a ship
+ *        afloat)
+ */
+static void find_afloat(const struct fleet* fleet, const int* ships,
+        const uint64_t* sinking, int count, int level, uint64_t taken,
+        int* used, int* possible)
+{
+    if (level == count) {
+        for (int c = 0; c < MAX_SHIPS; c++) {
+            possible[c] |= used[c] < ships[c];
+        }
+        return;
+    }
+    for (int c = 0; c < MAX_SHIPS; c++) {
+        const struct ship_layouts* layout = &fleet->classes[c];
+
+        if (used[c] == ships[c]) {
+            continue;
+        }
+        used[c]++;
+        for (int p = 0; p < layout->count; p++) {
+            if (layout->masks[p] == 0 && (layout->hits[p] & sinking[level]) &&
+                    !(layout->hits[p] & taken)) {
+                find_afloat(fleet, ships, sinking, count, level + 1,
+                        taken | layout->hits[p], used, possible);
+            }
+        }
+        used[c]--;
+    }
+}
+
+/* Lists the layouts of the ships one ship at a time, each placed clear of
+ * the ships before it, sunk if ships are left to sink and afloat if ships
+ * are left afloat, keeping those that cover every hit.
+ *
+ * @param (struct layouts* layouts) (layouts listed so far)
+ * @param (const struct fleet* fleet) (ships and their placements)
+ * @param (int level) (ship being placed)
+ * @param (uint64_t taken) (unshot positions of the ships placed)
+ * @param (uint64_t hit) (hits under the ships placed)
+ * @param (uint64_t id) (keys of the placements of the ships placed)
+ * @param (int afloat) (ships left to place afloat)
+ * @param (int* chosen) (placement of each ship placed)
+ *
+ * @return (int) (0 on success, -1 if there are too many layouts)
+ */
+static int list_layouts(struct layouts* layouts, const struct fleet* fleet,
+        int level, uint64_t taken, uint64_t hit, uint64_t id, int afloat,
+        int* chosen)
+{
+    const struct ship_layouts* layout;
+    int first = 0;
+
+    if (__builtin_popcountll(fleet->hits & ~hit) > fleet->cellsLeft[level]) {
+        return 0;
+    }
+    if (level == fleet->count) {
+        uint64_t seed = id;
+
+        if (layouts->count == ENDGAME_MAX_LAYOUTS) {
+            return -1;
+        }
+        // mixed again, so that layouts sharing placements have unrelated keys
+        layouts->keys[layouts->count] = next_key(&seed);
+        layouts->checks[layouts->count] = next_key(&seed);
+        memset(layouts->owner[layouts->count], 0, ENDGAME_MAX_CELLS);
+        memset(layouts->pieces[layouts->count], 0,
+                sizeof(layouts->pieces[layouts->count]));
+        for (int s = 0; s < fleet->count; s++) {
+            uint64_t mask = fleet->classes[fleet->class[s]].masks[chosen[s]];
+
+            layouts->pieces[layouts->count][fleet->ship[s]] = mask;
+            for (; mask; mask &= mask - 1) {
+                layouts->owner[layouts->count][__builtin_ctzll(mask)] =
+                        fleet->ship[s];
+            }
+        }
+        layouts->cover[layouts->count++] = taken;
+        return 0;
+    }
+
+    layout = &fleet->classes[fleet->class[level]];
+    if (level > 0 && fleet->class[level - 1] == fleet->class[level]) {
+        first = chosen[level - 1] + 1;
+    }
+    for (int p = first; p < layout->count; p++) {
+        int sunk = layout->masks[p] == 0;
+
+        if ((sunk ? fleet->count - level <= afloat : afloat == 0) ||
+                (layout->masks[p] & taken) || (layout->hits[p] & hit)) {
+            continue;
+        }
+        chosen[level] = p;
+        if (list_layouts(layouts, fleet, level + 1, taken | layout->masks[p],
+                hit | layout->hits[p], id ^ layout->ids[p], afloat - !sunk,
+                chosen)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Finds every layout of the ships that agrees with the shots the ai has
+ * fired: the misses, the hits, and which shots sank a ship, but not which
+ * ship was hit or sunk. Ships of a size that could not have a ship afloat
+ * given the shots that sank one are left out of the positions numbered,
+ * which go in order of row and column.
+ *
+ * @param (const struct naval_ai* ai) (ai whose shots are used)
+ * @param (struct layouts* layouts) (set to the layouts, with owner, pieces
+ *        and cover allocated for ENDGAME_MAX_LAYOUTS)
+ *
+ * @return (int) (0 on success, -1 if the layouts, the positions they cover
+ *         or the hits are too many, or out of memory)
+ */
+static int find_layouts(const struct naval_ai* ai, struct layouts* layouts)
+{
+    struct fleet fleet;
+    int index[MAX + 2][MAX + 2];
+    int hitIndex[MAX + 2][MAX + 2];
+    uint64_t sinking[MAX_SHIPS];
+    int ships[MAX_SHIPS] = {0};
+    int used[MAX_SHIPS] = {0};
+    int possible[MAX_SHIPS] = {0};
+    int chosen[MAX_SHIPS];
+    int hits = 0;
+    int sunk = 0;
+    int error = 0;
+
+    memset(&fleet, 0, sizeof(fleet));
+    layouts->hitKey = 0;
+    for (int i = 1; i < (ai->height + 1); i++) {
+        for (int j = 1; j < (ai->width + 1); j++) {
+            index[i][j] = -1;
+            if (ai->known[i][j] != CELL_HIT && ai->known[i][j] != CELL_SUNK) {
+                continue;
+            } else if (hits == ENDGAME_MAX_HITS || (ai->sank[i][j] &&
+                    sunk == MAX_SHIPS)) {
+                return -1;
+            }
+            if (ai->sank[i][j]) {
+                sinking[sunk++] = (uint64_t)1 << hits;
+            }
+            hitIndex[i][j] = hits;
+            fleet.hits |= (uint64_t)1 << hits++;
+            layouts->hitKey ^= position_key(j, i);
+        }
+    }
+    for (int c = 0; c < ai->classes; c++) {
+        for (int ship = 1; ship <= ai->numShips; ship++) {
+            if (ai->shipClass[ship - 1] == c) {
+                fleet.class[fleet.count] = c;
+                fleet.ship[fleet.count++] = ship;
+                ships[c]++;
+            }
+        }
+    }
+    for (int s = fleet.count - 1; s >= 0; s--) {
+        fleet.cellsLeft[s] = fleet.cellsLeft[s + 1] +
+                ai->sizes[fleet.class[s]];
+    }
+    fleet.afloat = fleet.count - sunk;
+
+    // list every placement with its hits, leaving the unshot positions
+    for (int c = 0; c < ai->classes && !error; c++) {
+        struct ship_layouts* layout = &fleet.classes[c];
+        int size = ai->sizes[c];
+
+        STATS_ALLOC(2);
+        if ((layout->place = malloc(2 * MAX * MAX * sizeof(int))) == NULL ||
+                (layout->masks = malloc(3 * 2 * MAX * MAX *
+                    sizeof(uint64_t))) == NULL) {
+            error = -1;
+            break;
+        }
+        layout->hits = layout->masks + 2 * MAX * MAX;
+        layout->ids = layout->hits + 2 * MAX * MAX;
+        for (int dir = 0; dir < 1 + (size > 1); dir++) {
+            for (int y = 1; y < (ai->height + 1); y++) {
+                for (int x = 1; x < (ai->width + 1); x++) {
+                    uint64_t seed = ((uint64_t)(size * (MAX + 2) + y) *
+                            (MAX + 2) + x) * 2 + dir;
+                    uint64_t hit = 0;
+                    int unshot = 0;
+
+                    if (!may_lie(ai, size, dir, x, y)) {
+                        continue;
+                    }
+                    for (int i = 0; i < size; i++) {
+                        int px = dir ? x : x + i;
+                        int py = dir ? y + i : y;
+
+                        if (ai->known[py][px] == CELL_UNKNOWN) {
+                            unshot++;
+                        } else {
+                            hit |= (uint64_t)1 << hitIndex[py][px];
+                        }
+                    }
+                    layout->place[layout->count] = (y * (MAX + 2) + x) * 2 +
+                            dir;
+                    layout->masks[layout->count] = unshot;
+                    layout->hits[layout->count] = hit;
+                    layout->ids[layout->count++] = next_key(&seed);
+                }
+            }
+        }
+    }
+    if (!error) {
+        find_afloat(&fleet, ships, sinking, sunk, 0, 0, used, possible);
+    }
+
+    // number the unshot positions of the classes that may be afloat
+    for (int pass = 0; pass < 2 && !error; pass++) {
+        for (int c = 0; c < ai->classes; c++) {
+            struct ship_layouts* layout = &fleet.classes[c];
+            int kept = 0;
+
+            for (int p = 0; p < layout->count; p++) {
+                int dir = layout->place[p] % 2;
+                int x = layout->place[p] / 2 % (MAX + 2);
+                int y = layout->place[p] / 2 / (MAX + 2);
+                uint64_t mask = 0;
+
+                // sunk placements cover no unshot position and are all kept
+                if (layout->masks[p] != 0 && !possible[c]) {
+                    continue;
+                }
+                for (int i = 0; i < ai->sizes[c]; i++) {
+                    int px = dir ? x : x + i;
+                    int py = dir ? y + i : y;
+
+                    if (ai->known[py][px] != CELL_UNKNOWN) {
+                        continue;
+                    } else if (pass == 0) {
+                        index[py][px] = 0;
+                    } else {
+                        mask |= (uint64_t)1 << index[py][px];
+                    }
+                }
+                if (pass == 1) {
+                    layout->place[kept] = layout->place[p];
+                    layout->masks[kept] = mask;
+                    layout->hits[kept] = layout->hits[p];
+                    layout->ids[kept++] = layout->ids[p];
+                }
+            }
+            if (pass == 1) {
+                layout->count = kept;
+            }
+        }
+        for (int i = 1; i < (ai->height + 1) && pass == 0; i++) {
+            for (int j = 1; j < (ai->width + 1); j++) {
+                if (index[i][j] < 0) {
+                    continue;
+                } else if (layouts->cells == ENDGAME_MAX_CELLS) {
+                    error = -1;
+                    break;
+                }
+                layouts->x[layouts->cells] = j;
+                layouts->y[layouts->cells] = i;
+                layouts->marks[layouts->cells] = position_key(j, i);
+                index[i][j] = layouts->cells++;
+            }
+        }
+    }
+
+    layouts->count = 0;
+    if (!error) {
+        error = list_layouts(layouts, &fleet, 0, 0, 0, 0, fleet.afloat,
+                chosen);
+    }
+    for (int c = 0; c < ai->classes; c++) {
+        free(fleet.classes[c].place);
+        free(fleet.classes[c].masks);
+    }
+    return error;
+}
+
+/* Tries the first shots given to a thread, in order, keeping the one that
+ * leaves the fewest misses expected.
+ *
+ * @param (void* arg) (struct solver of the thread)
+ *
+ * @return (void*) (NULL)
+ */
+static void* search_first(void* arg)
+{
+    struct solver* work = arg;
+    const struct layouts* layouts = work->layouts;
+
+    for (int l = 0; l < layouts->count; l++) {
+        work->lists[l] = l;
+    }
+    for (int m = work->first; m < work->count && !work->failed;
+            m += work->step) {
+        int cell = work->moves[m];
+        int covering = 0;
+        double misses;
+
+        for (int l = 0; l < layouts->count; l++) {
+            covering += layouts->owner[l][cell] != 0;
+        }
+        // the moves go from likeliest to hit down, so none later can win
+        if ((double)(layouts->count - covering) / layouts->count >=
+                work->best) {
+            break;
+        }
+        misses = try_shot(work, 0, work->lists, layouts->count, 0,
+                layouts->hitKey, cell, work->best);
+        if (!work->failed && misses < work->best) {
+            work->best = misses;
+            work->bestMove = m;
+        }
+    }
+    return NULL;
+}
+
+/* Searches the layouts for the first shot that leaves the fewest misses
+ * expected. A position with a ship in every layout is as good a shot as
+ * any and is taken at once. Otherwise the positions are ordered from the
+ * likeliest to hold a ship down and shared out between the threads, each
+ * with a table of its own, set up by the first search.
+ *
+ * @param (struct naval_ai* ai) (ai keeping the tables)
+ * @param (struct layouts* layouts) (layouts of the ships afloat)
+ *
+ * @return (int) (number of the position picked, -1 if the search gave up
+ *         or out of memory)
+ */
+static int search_layouts(struct naval_ai* ai, struct layouts* layouts)
+{
+    struct solver work[ENDGAME_MAX_THREADS];
+    pthread_t ids[ENDGAME_MAX_THREADS];
+    int covering[ENDGAME_MAX_CELLS] = {0};
+    uint64_t split[ENDGAME_MAX_CELLS] = {0};
+    int moves[ENDGAME_MAX_CELLS];
+    int threads = ai->threads;
+    int count = 0;
+    int started = 0;
+    int best = -1;
+
+    for (int l = 0; l < layouts->count; l++) {
+        uint64_t key = layouts->keys[l];
+
+        for (uint64_t mask = layouts->cover[l]; mask; mask &= mask - 1) {
+            int cell = __builtin_ctzll(mask);
+
+            covering[cell]++;
+            split[cell] += key * outcome(layouts, l, 0, cell);
+        }
+    }
+    for (int cell = 0; cell < layouts->cells; cell++) {
+        if (covering[cell] == layouts->count) {
+            return cell;
+        }
+        count = add_move(moves, count, covering, split, cell);
+    }
+
+    if (ai->tables == NULL) {
+        if (threads < 1) {
+            threads = sysconf(_SC_NPROCESSORS_ONLN);
+        }
+        if (threads < 1) {
+            threads = 1;
+        } else if (threads > ENDGAME_MAX_THREADS) {
+            threads = ENDGAME_MAX_THREADS;
+        }
+        STATS_ALLOC(1);
+        if ((ai->tables = calloc(threads, sizeof(struct endgame_table))) ==
+                NULL) {
+            return -1;
+        }
+        ai->tableCount = threads;
+        for (int t = 0; t < threads; t++) {
+            struct endgame_table* table = &ai->tables[t];
+
+            table->buckets = 1;
+            while (table->buckets * 2 * ENDGAME_WAYS * threads <=
+                    ENDGAME_TABLE_ENTRIES) {
+                table->buckets *= 2;
+            }
+            STATS_ALLOC(1);
+            if ((table->entries = calloc(table->buckets * ENDGAME_WAYS,
+                    sizeof(struct entry))) == NULL) {
+                endgame_free(ai);
+                return -1;
+            }
+        }
+    }
+    threads = (ai->tableCount < count) ? ai->tableCount : count;
+    for (int t = 0; t < threads; t++) {
+        memset(&work[t], 0, sizeof(work[t]));
+        work[t].layouts = layouts;
+        work[t].moves = moves;
+        work[t].count = count;
+        work[t].first = t;
+        work[t].step = threads;
+        work[t].best = HUGE_VAL;
+        work[t].bestMove = -1;
+        work[t].table = &ai->tables[t];
+        STATS_ALLOC(1);
+        if ((work[t].lists = malloc((size_t)(layouts->cells + 2) *
+                layouts->count * sizeof(uint16_t))) == NULL ||
+                pthread_create(&ids[t], NULL, search_first, &work[t])) {
+            free(work[t].lists);
+            break;
+        }
+        started++;
+    }
+    for (int t = 0; t < started; t++) {
+        pthread_join(ids[t], NULL);
+    }
+    // ties go to the likelier hit, whichever thread tried it
+    for (int t = 0; t < started && started == threads; t++) {
+        if (work[t].failed) {
+            best = -1;
+            break;
+        }
+        if (work[t].bestMove >= 0 && (best < 0 ||
+                work[t].best < work[best].best ||
+                (work[t].best == work[best].best &&
+                work[t].bestMove < work[best].bestMove))) {
+            best = t;
+        }
+    }
+    for (int t = 0; t < started; t++) {
+        free(work[t].lists);
+    }
+    return (best >= 0) ? moves[work[best].bestMove] : -1;
+}
+
+/* Picks the shot that sinks the ships afloat in the fewest shots expected,
+ * once no more than ai->endgame of them are left, by searching every order
+ * of shots over the layouts that agree with the shots fired, told only
+ * whether each missed, hit or sank a ship. Each layout is taken to be
+ * equally likely. States reached by shots in a
+ * different order are solved once, through a table of bounded size keyed
+ * on the shots fired and their outcomes. The first shots are shared out
+ * between ai->threads threads, or every core.
+ *
+ * @param (struct naval_ai* ai) (ai choosing the shot)
+ * @param (int* x) (set to the x coordinate of the shot)
+ * @param (int* y) (set to the y coordinate of the shot)
+ *
+ * @return (int) (1 if a position was picked, 0 if more ships are afloat,
+ *         the layouts are too many to search or out of memory)
+ */
+int endgame_choose(struct naval_ai* ai, int* x, int* y)
+{
+    struct layouts* layouts;
+    int afloat = 0;
+    int cell = -1;
+
+    for (int c = 0; c < ai->classes; c++) {
+        afloat += ai->afloat[c];
+    }
+    if (afloat == 0 || afloat > ai->endgame) {
+        return 0;
+    }
+    STATS_ALLOC(6);
+    if ((layouts = calloc(1, sizeof(struct layouts))) != NULL &&
+            (layouts->owner = malloc(ENDGAME_MAX_LAYOUTS *
+                sizeof(*layouts->owner))) != NULL &&
+            (layouts->pieces = malloc(ENDGAME_MAX_LAYOUTS *
+                sizeof(*layouts->pieces))) != NULL &&
+            (layouts->cover = malloc(ENDGAME_MAX_LAYOUTS *
+                sizeof(uint64_t))) != NULL &&
+            (layouts->keys = malloc(ENDGAME_MAX_LAYOUTS *
+                sizeof(uint64_t))) != NULL &&
+            (layouts->checks = malloc(ENDGAME_MAX_LAYOUTS *
+                sizeof(uint64_t))) != NULL &&
+            !find_layouts(ai, layouts) && layouts->count > 0 &&
+            (ai->givenUp == 0 || layouts->count * 2 <= ai->givenUp)) {
+        // layouts only ever drop out, so wait for half to go after giving up
+        if ((cell = search_layouts(ai, layouts)) < 0) {
+            ai->givenUp = layouts->count;
+        }
+    }
+    if (cell >= 0) {
+        *x = layouts->x[cell];
+        *y = layouts->y[cell];
+        ai->solved++;
+    }
+    if (layouts != NULL) {
+        free(layouts->owner);
+        free(layouts->pieces);
+        free(layouts->cover);
+        free(layouts->keys);
+        free(layouts->checks);
+    }
+    free(layouts);
+    return cell >= 0;
+}
+
+/* Frees the tables an ai's searches kept.
+ *
+ * @param (struct naval_ai* ai) (ai being freed)
+ */
+void endgame_free(struct naval_ai* ai)
+{
+    for (int t = 0; t < ai->tableCount; t++) {
+        free(ai->tables[t].entries);
+    }
+    free(ai->tables);
+    ai->tables = NULL;
+    ai->tableCount = 0;
+}
+
+/* Makes an ai solve the end of the game exactly once few ships are left.
+ *
+ * @param (struct naval_ai* ai) (ai to solve with)
+ * @param (int threads) (threads to search on, every core if below 1)
+ * @param (int ships) (most ships afloat for the solver to take over, 0 to
+ *        never use it)
+ */
+void naval_ai_endgame(struct naval_ai* ai, int threads, int ships)
+{
+    ai->threads = threads;
+    ai->endgame = ships;
+}
+
+/* Reads how many shots an ai has solved exactly.
+ *
+ * @param (const struct naval_ai* ai) (ai that solved)
+ *
+ * @return (long) (shots picked by the endgame solver)
+ */
+long naval_ai_solved(const struct naval_ai* ai)
+{
+    return ai->solved;
+}
@@ -0,0 +1,824 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "game.h"
+
+// Most states the count table may hold before giving up, whatever the
+// number of threads
+#define ENUMERATE_MAX_STATES (1 << 20)
+#define ENUMERATE_MAX_THREADS 256
+// Parts the count table is split into by hash, each with its own lock so
+// threads counting different branches add states at once
+#define ENUMERATE_PARTS 64
+
+// One way a ship can lie on the board, as its positions
+struct placement {
+    struct bitboard mask;
+    int hits;
+    int x;
+    int y;
+    int dir;
+};
+
+// Every placement a ship may take given the shots fired so far
+struct ship_placements {
+    int size;
+    int count;
+    struct placement* placements;
+};
+
+/* States of the enumeration, keyed by the ships still to place (level) and
+ * the positions taken by the ships placed before them. value holds either
+ * the number of ways to place the rest, or the ways to have reached the
+ * state while walking forwards.
+ */
+struct state_table {
+    struct bitboard* keys;
+    int* levels;
+    long double* values;
+    size_t capacity;
+    size_t used;
+};
+
+/* What is known of the board and the ships, shared by every thread. Masks
+ * only use their first words words, and threads split the placements of
+ * ship split, the first with a choice, which lie clear of fixed, the
+ * positions of the ships before it. order numbers the positions in the
+ * order they were shot at, from 1, and sank marks the shots that sank a
+ * ship. counts holds every state counted once, however many threads
+ * counted it, in the part its hash picks, and is only read once the count
+ * is over.
+ */
+struct problem {
+    int numShips;
+    int words;
+    int split;
+    int failed;
+    int next;
+    size_t stored;
+    int cellsLeft[MAX_SHIPS + 1];
+    struct ship_placements ships[MAX_SHIPS];
+    struct bitboard hits;
+    struct bitboard misses;
+    struct bitboard fixed;
+    unsigned short order[MAX + 2][MAX + 2];
+    unsigned char sank[MAX + 2][MAX + 2];
+    struct state_table counts[ENUMERATE_PARTS];
+    pthread_mutex_t locks[ENUMERATE_PARTS];
+};
+
+// Work and results of one thread
+struct enumeration {
+    const struct problem* problem;
+    int first;
+    int step;
+    int failed;
+    long double total;
+    long double heat[MAX + 2][MAX + 2];
+};
+
+/* Returns the number of set bits of a & ~b.
+ */
+static int count_outside(const struct bitboard* a, const struct bitboard* b)
+{
+    int count = 0;
+
+    for (int i = 0; i < BITBOARD_WORDS; i++) {
+        count += __builtin_popcountll(a->words[i] & ~b->words[i]);
+    }
+    return count;
+}
+
+/* Returns 1 if the first words words of the masks share a set bit.
+ */
+static int overlaps(const struct bitboard* a, const struct bitboard* b,
+        int words)
+{
+    uint64_t any = 0;
+
+    for (int i = 0; i < words; i++) {
+        any |= a->words[i] & b->words[i];
+    }
+    return any != 0;
+}
+
+/* Sets result to the positions of either mask.
+ */
+static void combine(struct bitboard* result, const struct bitboard* a,
+        const struct bitboard* b)
+{
+    for (int i = 0; i < BITBOARD_WORDS; i++) {
+        result->words[i] = a->words[i] | b->words[i];
+    }
+}
+
+/* Returns the hash of a state, whose low bits pick its bucket and high
+ * bits its part of the count table.
+ */
+static uint64_t state_mix(int level, const struct bitboard* key)
+{
+    uint64_t hash = 0x9e3779b97f4a7c15ull * (level + 1);
+
+    for (int i = 0; i < BITBOARD_WORDS; i++) {
+        hash = (hash ^ key->words[i]) * 0xff51afd7ed558ccdull;
+        hash ^= hash >> 32;
+    }
+    return hash;
+}
+
+/* Returns the bucket a state hashes to.
+ */
+static size_t state_hash(const struct state_table* table, int level,
+        const struct bitboard* key)
+{
+    return state_mix(level, key) & (table->capacity - 1);
+}
+
+/* Returns the part of the count table a state belongs to.
+ */
+static int state_part(int level, const struct bitboard* key)
+{
+    return (int)(state_mix(level, key) >> 58) % ENUMERATE_PARTS;
+}
+
+/* Empties a table, allocating its first buckets if it has none.
+ *
+ * @return (int) (0 on success, -1 if out of memory)
+ */
+static int state_clear(struct state_table* table)
+{
+    if (table->capacity == 0) {
+        table->capacity = 1 << 12;
+        table->keys = malloc(table->capacity * sizeof(struct bitboard));
+        table->levels = malloc(table->capacity * sizeof(int));
+        table->values = malloc(table->capacity * sizeof(long double));
+        if (!table->keys || !table->levels || !table->values) {
+            return -1;
+        }
+    }
+    for (size_t i = 0; i < table->capacity; i++) {
+        table->levels[i] = -1;
+    }
+    table->used = 0;
+    return 0;
+}
+
+static void state_free(struct state_table* table)
+{
+    free(table->keys);
+    free(table->levels);
+    free(table->values);
+    memset(table, 0, sizeof(*table));
+}
+
+/* Finds the bucket of a state, adding it with a value of zero if absent.
+ * The table holds up to limit states.
+ *
+ * @return (long double*) (the value of the state, NULL if the table is
+ *         full or out of memory)
+ */
+static long double* state_find(struct state_table* table, int level,
+        const struct bitboard* key, size_t limit, int* found)
+{
+    size_t i;
+
+    if ((table->used + 1) * 2 > table->capacity) {
+        struct state_table grown = {NULL, NULL, NULL, table->capacity * 2, 0};
+
+        if (grown.capacity > 2 * limit ||
+                (grown.keys = malloc(grown.capacity *
+                    sizeof(struct bitboard))) == NULL ||
+                (grown.levels = malloc(grown.capacity * sizeof(int))) ==
+                    NULL ||
+                (grown.values = malloc(grown.capacity *
+                    sizeof(long double))) == NULL) {
+            state_free(&grown);
+            return NULL;
+        }
+        for (i = 0; i < grown.capacity; i++) {
+            grown.levels[i] = -1;
+        }
+        for (size_t j = 0; j < table->capacity; j++) {
+            if (table->levels[j] < 0) {
+                continue;
+            }
+            i = state_hash(&grown, table->levels[j], &table->keys[j]);
+            while (grown.levels[i] >= 0) {
+                i = (i + 1) & (grown.capacity - 1);
+            }
+            grown.keys[i] = table->keys[j];
+            grown.levels[i] = table->levels[j];
+            grown.values[i] = table->values[j];
+        }
+        grown.used = table->used;
+        state_free(table);
+        *table = grown;
+    }
+
+    i = state_hash(table, level, key);
+    while (table->levels[i] >= 0) {
+        if (table->levels[i] == level &&
+                !memcmp(&table->keys[i], key, sizeof(*key))) {
+            *found = 1;
+            return &table->values[i];
+        }
+        i = (i + 1) & (table->capacity - 1);
+    }
+    table->keys[i] = *key;
+    table->levels[i] = level;
+    table->values[i] = 0;
+    table->used++;
+    *found = 0;
+    return &table->values[i];
+}
+
+/* Looks up a state without adding it, so any number of threads may read a
+ * table no thread writes to.
+ *
+ * @return (const long double*) (the value of the state, NULL if absent)
+ */
+static const long double* state_get(const struct state_table* table,
+        int level, const struct bitboard* key)
+{
+    size_t i = state_hash(table, level, key);
+
+    while (table->levels[i] >= 0) {
+        if (table->levels[i] == level &&
+                !memcmp(&table->keys[i], key, sizeof(*key))) {
+            return &table->values[i];
+        }
+        i = (i + 1) & (table->capacity - 1);
+    }
+    return NULL;
+}
+
+/* Counts the ways to place the last ship on the positions not taken so
+ * that it covers every hit left.
+ *
+ * @param (const struct problem* problem) (ships being placed)
+ * @param (const struct bitboard* taken) (positions of the other ships)
+ * @param (int uncovered) (hits not covered by the other ships)
+ *
+ * @return (long double) (number of ways)
+ */
+static long double count_last(const struct problem* problem,
+        const struct bitboard* taken, int uncovered)
+{
+    const struct ship_placements* ship =
+            &problem->ships[problem->numShips - 1];
+    long double ways = 0;
+
+    for (int p = 0; p < ship->count; p++) {
+        ways += ship->placements[p].hits == uncovered &&
+                !overlaps(&ship->placements[p].mask, taken, problem->words);
+    }
+    return ways;
+}
+
+/* Reads the ways to complete a state from its part of the count table,
+ * under the part's lock since other threads may be adding to it.
+ *
+ * @param (struct problem* problem) (ships being placed)
+ * @param (int level) (first ship still to place)
+ * @param (const struct bitboard* taken) (positions of the ships placed)
+ * @param (long double* ways) (set to the ways if the state was counted)
+ *
+ * @return (int) (1 if the state was counted, 0 otherwise)
+ */
+static int find_count(struct problem* problem, int level,
+        const struct bitboard* taken, long double* ways)
+{
+    int part = state_part(level, taken);
+    const long double* memo;
+
+    pthread_mutex_lock(&problem->locks[part]);
+    if ((memo = state_get(&problem->counts[part], level, taken)) != NULL) {
+        *ways = *memo;
+    }
+    pthread_mutex_unlock(&problem->locks[part]);
+    return memo != NULL;
+}
+
+/* Adds the ways to complete a state to its part of the count table, unless
+ * another thread counted it first. States are only counted against the
+ * limit when first added, so the table ends up the same for any number of
+ * threads.
+ *
+ * @param (struct problem* problem) (ships being placed)
+ * @param (int level) (first ship still to place)
+ * @param (const struct bitboard* taken) (positions of the ships placed)
+ * @param (long double ways) (ways to place the rest)
+ */
+static void add_count(struct problem* problem, int level,
+        const struct bitboard* taken, long double ways)
+{
+    int part = state_part(level, taken);
+    struct state_table* table = &problem->counts[part];
+    long double* memo;
+    int found;
+
+    pthread_mutex_lock(&problem->locks[part]);
+    if (state_get(table, level, taken) == NULL) {
+        if (__atomic_add_fetch(&problem->stored, 1, __ATOMIC_RELAXED) >
+                ENUMERATE_MAX_STATES || (memo = state_find(table, level,
+                taken, ENUMERATE_MAX_STATES, &found)) == NULL) {
+            __atomic_store_n(&problem->failed, 1, __ATOMIC_RELAXED);
+        } else {
+            *memo = ways;
+        }
+    }
+    pthread_mutex_unlock(&problem->locks[part]);
+}
+
+/* Counts the ways to place ships level onwards on the positions not taken
+ * so that every hit ends up covered, remembering each state but those of
+ * the last ship in the problem's count table. Placements never share a
+ * position, so the hits left to cover drop by those of each placement and
+ * a state with more of them than the ships left can cover is cut off at
+ * once. Threads may count at once, at worst counting a state twice.
+ *
+ * @param (struct problem* problem) (ships being placed)
+ * @param (int level) (first ship still to place)
+ * @param (const struct bitboard* taken) (positions of the ships placed)
+ * @param (int uncovered) (hits not covered by the ships placed)
+ *
+ * @return (long double) (number of ways, 0 once the table is full)
+ */
+static long double count_ways(struct problem* problem, int level,
+        const struct bitboard* taken, int uncovered)
+{
+    const struct ship_placements* ship;
+    long double ways = 0;
+
+    if (uncovered > problem->cellsLeft[level]) {
+        return 0;
+    }
+    if (level == problem->numShips) {
+        return 1;
+    }
+    if (level == problem->numShips - 1) {
+        return count_last(problem, taken, uncovered);
+    }
+    if (find_count(problem, level, taken, &ways)) {
+        return ways;
+    }
+
+    ship = &problem->ships[level];
+    for (int p = 0; p < ship->count &&
+            !__atomic_load_n(&problem->failed, __ATOMIC_RELAXED); p++) {
+        const struct placement* placement = &ship->placements[p];
+        struct bitboard next;
+
+        if (overlaps(&placement->mask, taken, problem->words)) {
+            continue;
+        }
+        combine(&next, &placement->mask, taken);
+        ways += count_ways(problem, level + 1, &next,
+                uncovered - placement->hits);
+    }
+    add_count(problem, level, taken, ways);
+    return ways;
+}
+
+/* Counts the ways to complete each placement of the split ship not yet
+ * taken by another thread, which is where the count branches out.
+ *
+ * @param (void* argument) (struct problem being counted)
+ */
+static void* count_branches(void* argument)
+{
+    struct problem* problem = argument;
+    const struct ship_placements* ship = &problem->ships[problem->split];
+    int uncovered = count_outside(&problem->hits, &problem->fixed);
+    int p;
+
+    while (!__atomic_load_n(&problem->failed, __ATOMIC_RELAXED) &&
+            (p = __atomic_fetch_add(&problem->next, 1, __ATOMIC_RELAXED)) <
+            ship->count) {
+        const struct placement* placement = &ship->placements[p];
+        struct bitboard next;
+
+        if (overlaps(&placement->mask, &problem->fixed, problem->words)) {
+            continue;
+        }
+        combine(&next, &placement->mask, &problem->fixed);
+        count_ways(problem, problem->split + 1, &next,
+                uncovered - placement->hits);
+    }
+    return NULL;
+}
+
+/* Returns the ways to place ships level onwards as count_ways counted them,
+ * reading the count table only.
+ *
+ * @param (struct enumeration* work) (thread walking forwards)
+ * @param (int level) (first ship still to place)
+ * @param (const struct bitboard* taken) (positions of the ships placed)
+ * @param (int uncovered) (hits not covered by the ships placed)
+ *
+ * @return (long double) (number of ways, 0 if the state was not counted)
+ */
+static long double counted_ways(struct enumeration* work, int level,
+        const struct bitboard* taken, int uncovered)
+{
+    const struct problem* problem = work->problem;
+    const long double* memo;
+
+    if (uncovered > problem->cellsLeft[level]) {
+        return 0;
+    }
+    if (level == problem->numShips) {
+        return 1;
+    }
+    if (level == problem->numShips - 1) {
+        return count_last(problem, taken, uncovered);
+    }
+    if ((memo = state_get(&problem->counts[state_part(level, taken)], level,
+            taken)) == NULL) {
+        work->failed = 1;
+        return 0;
+    }
+    return *memo;
+}
+
+/* Adds weight to every position a placement covers.
+ */
+static void add_heat(struct enumeration* work, int level,
+        const struct placement* placement, long double weight)
+{
+    int size = work->problem->ships[level].size;
+
+    for (int i = 0; i < size; i++) {
+        int x = placement->dir ? placement->x : placement->x + i;
+        int y = placement->dir ? placement->y + i : placement->y;
+
+        work->heat[y][x] += weight;
+    }
+}
+
+/* Places the last ship from a state reached with weight ways, adding the
+ * weight to every placement that covers the hits left.
+ *
+ * @param (struct enumeration* work) (thread walking forwards)
+ * @param (const struct bitboard* taken) (positions of the other ships)
+ * @param (int uncovered) (hits not covered by the other ships)
+ * @param (long double ways) (ways to have reached the state)
+ *
+ * @return (long double) (number of placements of the last ship)
+ */
+static long double add_last(struct enumeration* work,
+        const struct bitboard* taken, int uncovered, long double ways)
+{
+    const struct problem* problem = work->problem;
+    int level = problem->numShips - 1;
+    const struct ship_placements* ship = &problem->ships[level];
+    long double count = 0;
+
+    for (int p = 0; p < ship->count; p++) {
+        const struct placement* placement = &ship->placements[p];
+
+        if (placement->hits == uncovered &&
+                !overlaps(&placement->mask, taken, problem->words)) {
+            add_heat(work, level, placement, ways);
+            count++;
+        }
+    }
+    return count;
+}
+
+/* Walks forwards one ship at a time, merging paths that take the same
+ * positions. Each placement from a state is weighted by the ways to reach
+ * the state times the ways to complete it, read from the count table.
+ * Every thread follows the ships before the split, which have no choice,
+ * then goes on from its share of the split ship's placements. The last
+ * ship is placed straight from the states of the one before it, so every
+ * state kept is one the count table holds and no thread can run out of
+ * room where the count did not.
+ *
+ * @param (void* argument) (struct enumeration of the thread)
+ */
+static void* enumerate(void* argument)
+{
+    struct enumeration* work = argument;
+    const struct problem* problem = work->problem;
+    struct state_table reached = {NULL}, nextReached = {NULL};
+    struct bitboard empty;
+    long double* weight;
+    int found;
+
+    memset(&empty, 0, sizeof(empty));
+    if (state_clear(&reached) || state_clear(&nextReached) ||
+            (weight = state_find(&reached, 0, &empty, ENUMERATE_MAX_STATES,
+                &found)) == NULL) {
+        work->failed = 1;
+    } else {
+        *weight = 1;
+    }
+    if (!work->failed && work->first == 0 && problem->numShips == 0) {
+        work->total = counted_ways(work, 0, &empty,
+                count_outside(&problem->hits, &empty));
+    }
+
+    for (int level = 0; level < problem->numShips && !work->failed;
+            level++) {
+        const struct ship_placements* ship = &problem->ships[level];
+        struct state_table swap;
+
+        for (size_t s = 0; s < reached.capacity && !work->failed; s++) {
+            struct bitboard taken;
+            long double ways;
+            int uncovered;
+
+            if (reached.levels[s] < 0) {
+                continue;
+            }
+            taken = reached.keys[s];
+            ways = reached.values[s];
+            uncovered = count_outside(&problem->hits, &taken);
+            for (int p = 0; p < ship->count && !work->failed; p++) {
+                const struct placement* placement = &ship->placements[p];
+                struct bitboard next;
+                long double rest;
+
+                if ((level == problem->split && p % work->step != work->first) ||
+                        overlaps(&placement->mask, &taken, problem->words)) {
+                    continue;
+                }
+                combine(&next, &placement->mask, &taken);
+                // ships before the split have one placement at most
+                if (level < problem->split) {
+                    rest = 1;
+                } else if ((rest = (level + 2 == problem->numShips) ?
+                        add_last(work, &next, uncovered - placement->hits,
+                            ways) :
+                        counted_ways(work, level + 1, &next,
+                            uncovered - placement->hits)) == 0) {
+                    continue;
+                } else {
+                    add_heat(work, level, placement, ways * rest);
+                }
+                if (level == problem->split) {
+                    work->total += ways * rest;
+                }
+                if (level + 1 == problem->numShips ||
+                        (level >= problem->split &&
+                        level + 2 == problem->numShips)) {
+                    continue;
+                }
+                if ((weight = state_find(&nextReached, level + 1, &next,
+                        ENUMERATE_MAX_STATES, &found)) == NULL) {
+                    work->failed = 1;
+                    break;
+                }
+                *weight += ways;
+            }
+        }
+        swap = reached;
+        reached = nextReached;
+        nextReached = swap;
+        if (state_clear(&nextReached)) {
+            work->failed = 1;
+        }
+    }
+    state_free(&reached);
+    state_free(&nextReached);
+    return NULL;
+}
+
+/* Lists the placements of a ship that agree with the shots fired so far,
+ * as endgame.c's may_lie does: none may cover a miss, one covering a
+ * position not yet shot at may cover no sinking shot, and one lying wholly
+ * on hits must have been sunk by the last of them to be fired. Placements
+ * are found with bitboard_place, so they follow the same bounds as a map
+ * file.
+ *
+ * @return (int) (0 on success, -1 if out of memory)
+ */
+static int list_placements(struct ship_placements* ship,
+        const struct naval_game* game, const struct problem* problem)
+{
+    static const char directions[2] = {'E', 'S'};
+
+    ship->count = 0;
+    ship->placements = malloc(2 * MAX * MAX * sizeof(struct placement));
+    if (ship->placements == NULL) {
+        return -1;
+    }
+    for (int dir = 0; dir < 1 + (ship->size > 1); dir++) {
+        for (int y = 1; y < (game->height + 1); y++) {
+            for (int x = 1; x < (game->width + 1); x++) {
+                struct bitboards bits;
+                struct placement* placement;
+                int unshot;
+                int sinking = 0;
+                int last = 0;
+                int lastSank = 0;
+
+                memset(&bits, 0, sizeof(bits));
+                if (bitboard_place(&bits, &game->extent, PLAYER, 1,
+                        ship->size, x, y, directions[dir]) ||
+                        overlaps(&bits.ships[0], &problem->misses,
+                            BITBOARD_WORDS)) {
+                    continue;
+                }
+                for (int i = 0; i < ship->size; i++) {
+                    int px = dir ? x : x + i;
+                    int py = dir ? y + i : y;
+
+                    sinking += problem->sank[py][px];
+                    if (problem->order[py][px] > last) {
+                        last = problem->order[py][px];
+                        lastSank = problem->sank[py][px];
+                    }
+                }
+                unshot = count_outside(&bits.ships[0], &problem->hits);
+                if (unshot ? sinking > 0 : (sinking != 1 || !lastSank)) {
+                    continue;
+                }
+                placement = &ship->placements[ship->count++];
+                placement->mask = bits.ships[0];
+                placement->hits = ship->size - unshot;
+                placement->x = x;
+                placement->y = y;
+                placement->dir = dir;
+            }
+        }
+    }
+    return 0;
+}
+
+/* Works out the exact chance that each position of a board holds a ship,
+ * given the shots fired at it in order and nothing but whether each
+ * missed, hit or sank a ship, by counting every placement of all the
+ * ships that agrees with them. The ways to complete the placements of the
+ * first ship with a choice are counted first, shared out across threads
+ * into one table of at most ENUMERATE_MAX_STATES, then the same
+ * placements are shared out again to add the heat up. Whether a board can
+ * be counted does not depend on threads.
+ *
+ * @param (const struct naval_game* game) (game with the rules loaded)
+ * @param (const struct naval_shot* shots) (shots fired at the board, in
+ *        order)
+ * @param (int count) (number of shots)
+ * @param (int threads) (number of threads to count with)
+ * @param (double heat[][MAX + 2]) (set to the chance of a ship at every
+ *        position)
+ * @param (double* ways) (set to the number of placements that agree)
+ *
+ * @return (int) (0 on success, -1 if there are too many states to count,
+ *         a shot is off the board, the board is larger than MAX or out of
+ *         memory)
+ */
+int naval_heatmap(const struct naval_game* game,
+        const struct naval_shot* shots, int count, int threads,
+        double heat[][MAX + 2], double* ways)
+{
+    struct problem* problem = calloc(1, sizeof(struct problem));
+    struct enumeration* work = NULL;
+    pthread_t* ids = NULL;
+    long double total = 0;
+    int fired = 0;
+    int started = 0;
+    int locks = 0;
+    int error = 0;
+
+    if (threads < 1) {
+        threads = 1;
+    } else if (threads > ENUMERATE_MAX_THREADS) {
+        threads = ENUMERATE_MAX_THREADS;
+    }
+    if (game->width > MAX || game->height > MAX || problem == NULL ||
+            (work = calloc(threads, sizeof(struct enumeration))) == NULL ||
+            (ids = malloc(threads * sizeof(pthread_t))) == NULL) {
+        free(problem);
+        free(work);
+        return -1;
+    }
+
+    for (int i = 0; i < count && !error; i++) {
+        int x = shots[i].x;
+        int y = shots[i].y;
+
+        if (x < 1 || x > game->width || y < 1 || y > game->height) {
+            error = -1;
+        } else if (problem->order[y][x] == 0 &&
+                (shots[i].outcome == SHOT_MISS ||
+                shots[i].outcome == SHOT_HIT ||
+                shots[i].outcome == SHOT_SUNK)) {
+            problem->order[y][x] = ++fired;
+            problem->sank[y][x] = shots[i].outcome == SHOT_SUNK;
+            bitboard_set(shots[i].outcome == SHOT_MISS ? &problem->misses :
+                    &problem->hits, x, y);
+        }
+    }
+    // the largest ships first, to cut off dead ends early
+    for (int size = MAX; size > 0 && !error; size--) {
+        for (int i = 0; i < game->numShips; i++) {
+            struct ship_placements* ship;
+
+            if (game->shipSizes[i] != size) {
+                continue;
+            }
+            ship = &problem->ships[problem->numShips++];
+            ship->size = size;
+            if (list_placements(ship, game, problem)) {
+                error = -1;
+            }
+        }
+    }
+    for (int i = problem->numShips - 1; i >= 0; i--) {
+        problem->cellsLeft[i] = problem->cellsLeft[i + 1] +
+                problem->ships[i].size;
+    }
+    problem->words = ((game->height + 1) * BITBOARD_STRIDE + game->width +
+            64) / 64;
+    while (problem->split < problem->numShips - 1 &&
+            problem->ships[problem->split].count < 2) {
+        problem->split++;
+    }
+
+    // the ships before the split have one placement at most, so the count
+    // branches out at the split and its placements are shared out
+    for (int i = 0; i < problem->split && !error; i++) {
+        const struct ship_placements* ship = &problem->ships[i];
+
+        if (ship->count == 0 || overlaps(&ship->placements[0].mask,
+                &problem->fixed, problem->words)) {
+            problem->next = problem->ships[problem->split].count;
+            break;
+        }
+        combine(&problem->fixed, &ship->placements[0].mask, &problem->fixed);
+    }
+    for (; locks < ENUMERATE_PARTS && !error; locks++) {
+        if (state_clear(&problem->counts[locks]) ||
+                pthread_mutex_init(&problem->locks[locks], NULL)) {
+            error = -1;
+            break;
+        }
+    }
+    for (int t = 0; t < threads && !error && problem->numShips > 0; t++) {
+        if (pthread_create(&ids[t], NULL, count_branches, problem)) {
+            __atomic_store_n(&problem->failed, 1, __ATOMIC_RELAXED);
+            break;
+        }
+        started++;
+    }
+    for (int t = 0; t < started; t++) {
+        pthread_join(ids[t], NULL);
+    }
+    error |= -problem->failed;
+    started = 0;
+    for (int t = 0; t < threads && !error; t++) {
+        work[t].problem = problem;
+        work[t].first = t;
+        work[t].step = threads;
+        if (pthread_create(&ids[t], NULL, enumerate, &work[t])) {
+            error = -1;
+            break;
+        }
+        started++;
+    }
+    for (int t = 0; t < started; t++) {
+        pthread_join(ids[t], NULL);
+        total += work[t].total;
+        error |= -work[t].failed;
+    }
+
+    // every placement that agrees holds the ships before the split
+    for (int i = 0; i < problem->split; i++) {
+        const struct placement* placement = problem->ships[i].placements;
+
+        for (int k = 0; k < problem->ships[i].size && total > 0; k++) {
+            int x = placement->dir ? placement->x : placement->x + k;
+            int y = placement->dir ? placement->y + k : placement->y;
+
+            work[0].heat[y][x] += total;
+        }
+    }
+    for (int i = 0; i < MAX + 2; i++) {
+        for (int j = 0; j < MAX + 2; j++) {
+            long double sum = 0;
+
+            for (int t = 0; t < threads; t++) {
+                sum += work[t].heat[i][j];
+            }
+            heat[i][j] = (total > 0) ? (double)(sum / total) : 0;
+        }
+    }
+    *ways = (double)total;
+
+    for (int i = 0; i < problem->numShips; i++) {
+        free(problem->ships[i].placements);
+    }
+    for (int i = 0; i < ENUMERATE_PARTS; i++) {
+        state_free(&problem->counts[i]);
+    }
+    for (int i = 0; i < locks; i++) {
+        pthread_mutex_destroy(&problem->locks[i]);
+    }
+    free(problem);
+    free(work);
+    free(ids);
+    return error;
+}
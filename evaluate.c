@@ -0,0 +1,541 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "naval.h"
+#include "commands.h"
+
+// Maps parsed into one pool before it is passed on to be shot at
+#define EVALUATE_LANES 256
+// Batches in flight for each parsing thread, bounding the memory held
+#define EVALUATE_DEPTH 2
+// Most shots a game can take, one at every position of a 26x26 board
+#define EVALUATE_SHOTS (MAX * MAX)
+
+/* A batch of maps moving down the pipeline: the walker fills in the paths,
+ * a parser loads the maps into the pool, the simulator fires the turns at
+ * it and the aggregator adds up the results before handing it back.
+ */
+struct batch {
+    struct naval_pool* pool;
+    char* paths;
+    size_t length;
+    size_t capacity;
+    size_t offsets[EVALUATE_LANES];
+    int count;
+    int lanes;
+    int invalid;
+};
+
+/* Batches waiting for a stage. Every queue has room for all the batches,
+ * so only taking from one waits.
+ */
+struct queue {
+    struct batch** items;
+    int capacity;
+    int head;
+    int count;
+    int closed;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+};
+
+struct worker;
+
+/* One stage of the pipeline. The last of its threads to run out of batches
+ * closes the queue of the next stage.
+ */
+struct stage {
+    void (*work)(struct worker* worker, struct batch* batch);
+    struct queue* input;
+    struct queue* output;
+    int running;
+};
+
+/* What is known of the turns, and the results of every map shot at with
+ * them so far.
+ */
+struct evaluation {
+    struct naval_turn* moves;
+    int count;
+    long long won[EVALUATE_SHOTS + 1];
+    long long maps;
+    long long invalid;
+    long long gaveUp;
+    long long hits;
+    long long shots;
+};
+
+/* What the main thread keeps as it walks the paths: the batch it is
+ * filling and the queues of the stages, the empty batches last.
+ */
+struct walk {
+    struct batch* filling;
+    struct queue* queues;
+};
+
+/* A thread of a stage. Parsers keep their own game to load maps on and a
+ * buffer for the files read.
+ */
+struct worker {
+    struct stage* stage;
+    struct evaluation* evaluation;
+    struct naval_game* game;
+    char* file;
+    size_t fileCapacity;
+    int failed;
+};
+
+/* Sets up an empty queue.
+ *
+ * @param (struct queue* queue) (queue to be set up)
+ * @param (int capacity) (batches it must hold)
+ *
+ * @return (int) (0 on success, -1 if out of memory)
+ */
+static int queue_init(struct queue* queue, int capacity)
+{
+    memset(queue, 0, sizeof(struct queue));
+    if ((queue->items = malloc(capacity * sizeof(struct batch*))) == NULL) {
+        return -1;
+    }
+    queue->capacity = capacity;
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->ready, NULL);
+    return 0;
+}
+
+/* Frees a queue set up with queue_init.
+ *
+ * @param (struct queue* queue) (queue to be freed)
+ */
+static void queue_free(struct queue* queue)
+{
+    if (queue->items != NULL) {
+        pthread_mutex_destroy(&queue->lock);
+        pthread_cond_destroy(&queue->ready);
+        free(queue->items);
+    }
+}
+
+/* Adds a batch to the back of a queue.
+ *
+ * @param (struct queue* queue) (queue of the stage taking the batch)
+ * @param (struct batch* batch) (batch to be passed on)
+ */
+static void queue_push(struct queue* queue, struct batch* batch)
+{
+    pthread_mutex_lock(&queue->lock);
+    queue->items[(queue->head + queue->count++) % queue->capacity] = batch;
+    pthread_cond_signal(&queue->ready);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+/* Takes the batch at the front of a queue, waiting for one if it is empty.
+ *
+ * @param (struct queue* queue) (queue to take from)
+ *
+ * @return (struct batch*) (the batch, NULL once the queue is empty and
+ *         closed)
+ */
+static struct batch* queue_pop(struct queue* queue)
+{
+    struct batch* batch = NULL;
+
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0 && !queue->closed) {
+        pthread_cond_wait(&queue->ready, &queue->lock);
+    }
+    if (queue->count > 0) {
+        batch = queue->items[queue->head];
+        queue->head = (queue->head + 1) % queue->capacity;
+        queue->count--;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return batch;
+}
+
+/* Marks a queue as getting no more batches, waking every thread waiting on
+ * it.
+ *
+ * @param (struct queue* queue) (queue to be closed)
+ */
+static void queue_close(struct queue* queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    queue->closed = 1;
+    pthread_cond_broadcast(&queue->ready);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+/* Loads every map of a batch into a lane of its pool, counting those that
+ * cannot be read or would not load in a game.
+ *
+ * @param (struct worker* worker) (parser loading the maps)
+ * @param (struct batch* batch) (batch with its paths filled in)
+ */
+static void parse_batch(struct worker* worker, struct batch* batch)
+{
+    naval_pool_reset(batch->pool);
+    batch->lanes = 0;
+    batch->invalid = 0;
+    for (int i = 0; i < batch->count; i++) {
+        size_t length;
+        int read = read_file(batch->paths + batch->offsets[i], &worker->file,
+                &worker->fileCapacity, &length);
+
+        worker->failed |= (read == -2);
+        if (read || naval_check_map(worker->game, PLAYER, worker->file,
+                length, NULL, 0) > 0) {
+            batch->invalid++;
+        } else {
+            naval_pool_add(batch->pool, worker->game, PLAYER);
+            batch->lanes++;
+        }
+    }
+}
+
+/* Fires the turns at every board of a batch, stopping once the CPU has won
+ * on all of them.
+ *
+ * @param (struct worker* worker) (simulator firing the turns)
+ * @param (struct batch* batch) (batch with its maps loaded)
+ */
+static void simulate_batch(struct worker* worker, struct batch* batch)
+{
+    const struct evaluation* evaluation = worker->evaluation;
+
+    for (int i = 0; i < evaluation->count &&
+            naval_pool_playing(batch->pool) > 0; i++) {
+        naval_pool_fire(batch->pool, evaluation->moves[i].x,
+                evaluation->moves[i].y);
+    }
+}
+
+/* Adds the results of every board of a batch to the totals and empties the
+ * batch for the walker to fill again.
+ *
+ * @param (struct worker* worker) (aggregator keeping the totals)
+ * @param (struct batch* batch) (batch that has been shot at)
+ */
+static void aggregate_batch(struct worker* worker, struct batch* batch)
+{
+    struct evaluation* evaluation = worker->evaluation;
+
+    for (int lane = 0; lane < batch->lanes; lane++) {
+        int shots, hits, sunk;
+
+        naval_pool_lane(batch->pool, lane, &shots, &hits, &sunk);
+        if (shots >= 0) {
+            evaluation->won[shots]++;
+        } else {
+            evaluation->gaveUp++;
+            shots = evaluation->count;
+        }
+        evaluation->hits += hits;
+        evaluation->shots += shots;
+    }
+    evaluation->maps += batch->count;
+    evaluation->invalid += batch->invalid;
+    batch->count = 0;
+    batch->length = 0;
+}
+
+/* Runs one thread of a stage, passing each batch on once it is done with.
+ *
+ * @param (void* arg) (struct worker of the thread)
+ *
+ * @return (void*) (NULL)
+ */
+static void* run_stage(void* arg)
+{
+    struct worker* worker = arg;
+    struct stage* stage = worker->stage;
+    struct batch* batch;
+
+    while ((batch = queue_pop(stage->input)) != NULL) {
+        stage->work(worker, batch);
+        queue_push(stage->output, batch);
+    }
+    if (__atomic_sub_fetch(&stage->running, 1, __ATOMIC_ACQ_REL) == 0) {
+        queue_close(stage->output);
+    }
+    return NULL;
+}
+
+/* Adds a path to the batch being filled, passing the batch on to the
+ * parsers once it is full and waiting for an empty one.
+ *
+ * @param (void* context) (struct walk filling the batches)
+ * @param (const char* path) (path of the map)
+ *
+ * @return (int) (0 on success, E_EVALUATE if out of memory)
+ */
+static int add_path(void* context, const char* path)
+{
+    struct walk* walk = context;
+    struct batch* filling = walk->filling;
+    size_t length = strlen(path) + 1;
+
+    if (filling->length + length > filling->capacity) {
+        size_t capacity = 2 * (filling->length + length);
+        char* paths = realloc(filling->paths, capacity);
+
+        if (paths == NULL) {
+            return E_EVALUATE;
+        }
+        filling->paths = paths;
+        filling->capacity = capacity;
+    }
+    memcpy(filling->paths + filling->length, path, length);
+    filling->offsets[filling->count++] = filling->length;
+    filling->length += length;
+    if (filling->count == EVALUATE_LANES) {
+        queue_push(&walk->queues[0], filling);
+        if ((walk->filling = queue_pop(&walk->queues[3])) == NULL) {
+            return E_EVALUATE;
+        }
+    }
+    return 0;
+}
+
+/* Prints the totals of an evaluation, one line each, then how many maps
+ * the CPU won on in each number of shots.
+ *
+ * @param (const struct evaluation* evaluation) (totals of every map)
+ */
+static void print_evaluation(const struct evaluation* evaluation)
+{
+    long long played = evaluation->maps - evaluation->invalid;
+    long long won = played - evaluation->gaveUp;
+    long long total = 0;
+    long long seen = 0;
+    int median = -1;
+
+    for (int shots = 0; shots <= EVALUATE_SHOTS; shots++) {
+        total += shots * evaluation->won[shots];
+        seen += evaluation->won[shots];
+        if (median < 0 && 2 * seen >= won && seen > 0) {
+            median = shots;
+        }
+    }
+    printf("maps %lld\n", evaluation->maps);
+    printf("invalid %lld\n", evaluation->invalid);
+    printf("won %lld\n", won);
+    printf("gave-up %lld %.2f%%\n", evaluation->gaveUp,
+            played ? 100.0 * evaluation->gaveUp / played : 0);
+    printf("hit-rate %.2f%% %lld/%lld\n", evaluation->shots ?
+            100.0 * evaluation->hits / evaluation->shots : 0,
+            evaluation->hits, evaluation->shots);
+    if (won > 0) {
+        printf("shots-mean %.2f\n", (double)total / won);
+        printf("shots-median %d\n", median);
+    }
+    for (int shots = 0; shots <= EVALUATE_SHOTS; shots++) {
+        if (evaluation->won[shots] > 0) {
+            printf("shots %d %lld\n", shots, evaluation->won[shots]);
+        }
+    }
+}
+
+/* Plays a turns file as the CPU against every player map under the paths,
+ * with no boards drawn, and prints how it did: how many maps it won, how
+ * often it gave up with code 140, its hit rate and how many maps it won in
+ * each number of shots. Each game stops once the CPU has won it.
+ *
+ * The maps stream through a pipeline of a fixed number of batches: this
+ * thread walks the paths and fills batches with the names of maps, a
+ * parser on every core loads them into the lanes of a naval_pool, one
+ * simulator fires the turns at the whole pool and one aggregator adds up
+ * the results and hands the batch back to be filled again. Memory stays
+ * the same however many maps there are. How many maps were played, and
+ * how fast, goes to stderr.
+ *
+ * @param (int argc) (number of arguments after evaluate)
+ * @param (char* argv[]) (arguments after evaluate: turns, rules, then map
+ *        directories or files)
+ * @param (const struct options* options) (settings of the games played)
+ *
+ * @return (int) (exit code of the naval process: 0 if every map is valid,
+ *         E_PLAYER_MAP if any is not)
+ */
+int run_evaluate(int argc, char* argv[], const struct options* options)
+{
+    struct evaluation* evaluation;
+    struct naval_game* game;
+    struct naval_turns turns = {NULL};
+    struct naval_text text;
+    struct timespec start, end;
+    struct queue queues[4];
+    struct stage stages[3];
+    struct batch* batches = NULL;
+    struct worker* workers = NULL;
+    pthread_t* ids = NULL;
+    struct walk walk = {NULL, NULL};
+    const struct naval_turn* move;
+    int threads = options->threads;
+    int count, started = 0;
+    FILE* file;
+    int error = 0;
+
+    if (argc < 3) {
+        return E_NOT_ENOUGH_PARAMETERS;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if ((file = fopen(argv[1], "r")) == NULL) {
+        return E_RULES_MISSING;
+    }
+    if ((game = naval_create()) == NULL) {
+        fclose(file);
+        return E_EVALUATE;
+    }
+    naval_set_engine(game, options->engine);
+    error = naval_load_rules(game, file);
+    fclose(file);
+    if (!error && (file = fopen(argv[0], "r")) == NULL) {
+        error = E_CPU_TURNS_MISSING;
+    } else if (!error) {
+        if (naval_text_open(&text, file)) {
+            error = E_TURNS;
+        } else {
+            // only the moves are kept, so the text is not needed past here
+            error = naval_turns_decode(&turns, &text, game) ? E_TURNS : 0;
+            naval_text_close(&text);
+        }
+        fclose(file);
+    }
+    if (error || (evaluation = calloc(1, sizeof(struct evaluation))) ==
+            NULL) {
+        naval_turns_free(&turns);
+        naval_destroy(game);
+        return error ? error : E_EVALUATE;
+    }
+    // only moves that would be fired are kept, in the order of the file
+    evaluation->moves = turns.moves;
+    while ((move = naval_turns_next(&turns)) != NULL) {
+        if (move->kind == SHOT_MISS) {
+            evaluation->moves[evaluation->count++] = *move;
+        }
+    }
+
+    if (threads < 1) {
+        threads = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+    count = EVALUATE_DEPTH * threads + 2;
+    memset(queues, 0, sizeof(queues));
+    if ((batches = calloc(count, sizeof(struct batch))) == NULL ||
+            (workers = calloc(threads + 2, sizeof(struct worker))) == NULL ||
+            (ids = malloc((threads + 2) * sizeof(pthread_t))) == NULL) {
+        error = E_EVALUATE;
+    }
+    for (int q = 0; !error && q < 4; q++) {
+        error = queue_init(&queues[q], count) ? E_EVALUATE : 0;
+    }
+    for (int i = 0; !error && i < count; i++) {
+        if ((batches[i].pool = naval_pool_create(game, EVALUATE_LANES)) ==
+                NULL) {
+            error = E_EVALUATE;
+        } else {
+            queue_push(&queues[3], &batches[i]);
+        }
+    }
+    for (int t = 0; !error && t < threads; t++) {
+        if ((workers[t].game = naval_copy(game)) == NULL) {
+            error = E_EVALUATE;
+        }
+    }
+
+    if (!error) {
+        void (*work[3])(struct worker*, struct batch*) = {parse_batch,
+                simulate_batch, aggregate_batch};
+        int wanted[3] = {threads, 1, 1};
+
+        // the aggregator is started first, so batches always come back
+        for (int s = 2; s >= 0; s--) {
+            stages[s].work = work[s];
+            stages[s].input = &queues[s];
+            stages[s].output = &queues[s + 1];
+            stages[s].running = wanted[s];
+            for (int t = 0; t < wanted[s]; t++) {
+                struct worker* worker = &workers[(s == 0) ? t :
+                        threads + s - 1];
+
+                worker->stage = &stages[s];
+                worker->evaluation = evaluation;
+                if (!error && pthread_create(&ids[started], NULL, run_stage,
+                        worker) == 0) {
+                    started++;
+                } else {
+                    stages[s].running--;
+                }
+            }
+            if (stages[s].running == 0) {
+                error = E_EVALUATE;
+                queue_close(stages[s].output);
+            }
+        }
+    }
+    if (!error) {
+        walk.filling = queue_pop(&queues[3]);
+        walk.queues = queues;
+    }
+    for (int i = 2; !error && i < argc; i++) {
+        struct stat info;
+
+        if (stat(argv[i], &info) != 0) {
+            error = E_PLAYER_MAP_MISSING;
+        } else if (S_ISDIR(info.st_mode)) {
+            error = walk_directory(argv[i], 0, add_path, &walk);
+        } else {
+            error = add_path(&walk, argv[i]);
+        }
+    }
+    if (walk.filling != NULL) {
+        queue_push(&queues[0], walk.filling);
+    }
+    if (queues[0].items != NULL) {
+        queue_close(&queues[0]);
+    }
+    for (int t = 0; t < started; t++) {
+        pthread_join(ids[t], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    for (int t = 0; workers != NULL && t < threads; t++) {
+        error = (!error && workers[t].failed) ? E_EVALUATE : error;
+        naval_destroy(workers[t].game);
+        free(workers[t].file);
+    }
+    if (!error) {
+        double seconds = (end.tv_sec - start.tv_sec) +
+                (end.tv_nsec - start.tv_nsec) / 1e9;
+
+        print_evaluation(evaluation);
+        fflush(stdout);
+        fprintf(stderr, "%lld maps in %.3f s, %.0f maps/sec\n",
+                evaluation->maps, seconds,
+                (seconds > 0) ? evaluation->maps / seconds : 0);
+        error = evaluation->invalid ? E_PLAYER_MAP : 0;
+    }
+    for (int i = 0; batches != NULL && i < count; i++) {
+        naval_pool_destroy(batches[i].pool);
+        free(batches[i].paths);
+    }
+    for (int q = 0; q < 4; q++) {
+        queue_free(&queues[q]);
+    }
+    free(batches);
+    free(workers);
+    free(ids);
+    free(evaluation);
+    naval_turns_free(&turns);
+    naval_destroy(game);
+    return error;
+}
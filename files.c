@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "naval.h"
+#include "commands.h"
+
+/* Reads a whole file into a buffer that is grown as needed and kept for
+ * the next file.
+ *
+ * @param (const char* path) (path of the file)
+ * @param (char** buffer) (buffer read into, reallocated when too small)
+ * @param (size_t* capacity) (bytes the buffer holds, updated as it grows)
+ * @param (size_t* length) (set to the bytes read)
+ *
+ * @return (int) (0 on success, -1 if it cannot be read, -2 if out of
+ *         memory)
+ */
+int read_file(const char* path, char** buffer, size_t* capacity,
+        size_t* length)
+{
+    int fd = open(path, O_RDONLY);
+    ssize_t got;
+
+    *length = 0;
+    if (fd < 0) {
+        return -1;
+    }
+    do {
+        if (*length == *capacity) {
+            size_t grown = *capacity ? 2 * *capacity : 4096;
+            char* file = realloc(*buffer, grown);
+
+            if (file == NULL) {
+                close(fd);
+                return -2;
+            }
+            *buffer = file;
+            *capacity = grown;
+        }
+        got = read(fd, *buffer + *length, *capacity - *length);
+        *length += (got > 0) ? got : 0;
+    } while (got > 0);
+    close(fd);
+    return (got < 0) ? -1 : 0;
+}
+
+/* Orders directory entries by name, so maps are reported in the same order
+ * wherever the directory was copied.
+ */
+static int compare_names(const struct dirent** a, const struct dirent** b)
+{
+    return strcmp((*a)->d_name, (*b)->d_name);
+}
+
+/* Skips the . and .. entries of a directory.
+ */
+static int not_dots(const struct dirent* entry)
+{
+    return strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0;
+}
+
+/* Visits one entry of a directory being walked, walking it in turn if it
+ * is a directory itself.
+ *
+ * @param (const char* directory) (path of the directory holding it)
+ * @param (const struct dirent* entry) (the entry)
+ * @param (int ordered) (as for walk_directory)
+ * @param (int (*visit)(void*, const char*)) (as for walk_directory)
+ * @param (void* context) (passed on to visit)
+ *
+ * @return (int) (as walk_directory)
+ */
+static int walk_entry(const char* directory, const struct dirent* entry,
+        int ordered, int (*visit)(void* context, const char* path),
+        void* context)
+{
+    size_t length = strlen(directory);
+    char path[length + strlen(entry->d_name) + 2];
+    int type = entry->d_type;
+    struct stat info;
+
+    sprintf(path, "%s%s%s", directory,
+            (length > 0 && directory[length - 1] == '/') ? "" : "/",
+            entry->d_name);
+    // links and file systems that give no type are looked up
+    if (type != DT_DIR && type != DT_REG) {
+        type = (stat(path, &info) != 0) ? DT_UNKNOWN :
+                S_ISDIR(info.st_mode) ? DT_DIR :
+                S_ISREG(info.st_mode) ? DT_REG : DT_UNKNOWN;
+    }
+    if (type == DT_DIR) {
+        return walk_directory(path, ordered, visit, context);
+    }
+    return (type == DT_REG) ? visit(context, path) : 0;
+}
+
+/* Calls visit with the path of every regular file under a directory, and
+ * under the directories within it. Ordered walks go in order of name and
+ * hold the names of each directory on the way down at once; unordered
+ * walks take entries as the directory lists them and hold one at a time,
+ * however many files there are.
+ *
+ * @param (const char* directory) (path of the directory)
+ * @param (int ordered) (1 to walk in order of name)
+ * @param (int (*visit)(void*, const char*)) (called with each path, which
+ *        is only valid during the call; returns 0 to go on or an error
+ *        code to stop with)
+ * @param (void* context) (passed on to visit)
+ *
+ * @return (int) (0 on success, E_PLAYER_MAP_MISSING if a directory cannot
+ *         be read, otherwise the code visit stopped with)
+ */
+int walk_directory(const char* directory, int ordered,
+        int (*visit)(void* context, const char* path), void* context)
+{
+    struct dirent** names;
+    struct dirent* entry;
+    DIR* dir;
+    int count;
+    int error = 0;
+
+    if (ordered) {
+        if ((count = scandir(directory, &names, not_dots,
+                compare_names)) < 0) {
+            return E_PLAYER_MAP_MISSING;
+        }
+        for (int i = 0; i < count; i++) {
+            if (!error) {
+                error = walk_entry(directory, names[i], ordered, visit,
+                        context);
+            }
+            free(names[i]);
+        }
+        free(names);
+        return error;
+    }
+    if ((dir = opendir(directory)) == NULL) {
+        return E_PLAYER_MAP_MISSING;
+    }
+    while (!error && (entry = readdir(dir)) != NULL) {
+        if (not_dots(entry)) {
+            error = walk_entry(directory, entry, ordered, visit, context);
+        }
+    }
+    closedir(dir);
+    return error;
+}
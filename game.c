@@ -0,0 +1,1195 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "game.h"
+
+// Most letters of a column and digits of a row a move may have
+#define COLUMN_LETTERS_MAX 4
+#define ROW_DIGITS_MAX 9
+
+/* Allocates a game with both boards empty.
+ *
+ * @return (struct naval_game*) (the new game, NULL if out of memory)
+ */
+struct naval_game* naval_create(void)
+{
+    STATS_ALLOC(1);
+    return calloc(1, sizeof(struct naval_game));
+}
+
+/* Frees a game created with naval_create.
+ *
+ * @param (struct naval_game* game) (game to be freed)
+ */
+void naval_destroy(struct naval_game* game)
+{
+    if (game != NULL) {
+        naval_journal_close(game);
+        free(game->cells);
+        sparse_free(&game->cpuBoard.sparse);
+        sparse_free(&game->playerBoard.sparse);
+    }
+    free(game);
+}
+
+/* Allocates a copy of a game, boards and shots included. The copy is not
+ * journaled.
+ *
+ * @param (const struct naval_game* game) (game to be copied)
+ *
+ * @return (struct naval_game*) (the copy, NULL if out of memory)
+ */
+struct naval_game* naval_copy(const struct naval_game* game)
+{
+    struct naval_game* copy = malloc(sizeof(struct naval_game));
+    size_t size = (size_t)game->cpuBoard.stride * (game->height + 2);
+
+    STATS_ALLOC(1);
+    if (copy == NULL) {
+        return NULL;
+    }
+    memcpy(copy, game, sizeof(struct naval_game));
+    copy->journal = NULL;
+    memset(&copy->cpuBoard.sparse, 0, sizeof(struct sparse));
+    memset(&copy->playerBoard.sparse, 0, sizeof(struct sparse));
+    if (game->cells != NULL) {
+        STATS_ALLOC(1);
+        if ((copy->cells = malloc(2 * size)) == NULL) {
+            free(copy);
+            return NULL;
+        }
+        memcpy(copy->cells, game->cells, 2 * size);
+        copy->cpuBoard.cells = copy->cells;
+        copy->playerBoard.cells = copy->cells + size;
+    }
+    if (sparse_copy(&copy->cpuBoard.sparse, &game->cpuBoard.sparse) ||
+            sparse_copy(&copy->playerBoard.sparse,
+            &game->playerBoard.sparse)) {
+        naval_destroy(copy);
+        return NULL;
+    }
+    return copy;
+}
+
+/* Selects the board representation used by the game.
+ *
+ * @param (struct naval_game* game) (game not yet set up)
+ * @param (int engine) (one of enum Engines)
+ */
+void naval_set_engine(struct naval_game* game, int engine)
+{
+    game->engine = engine;
+}
+
+/* Returns the message for the error code, NULL for unknown codes.
+ *
+ * @param (int code) (enumerator value corresponding to the error code)
+ *
+ * @return (const char*) (message printed when exiting with that code)
+ */
+const char* naval_strerror(int code)
+{
+    switch (code) {
+        case E_NOT_ENOUGH_PARAMETERS:
+            return "Usage: naval rules playermap cpumap turns";
+        case E_RULES_MISSING:
+            return "Missing rules file";
+        case E_PLAYER_MAP_MISSING:
+            return "Missing player map file";
+        case E_CPU_MAP_MISSING:
+            return "Missing CPU map file";
+        case E_CPU_TURNS_MISSING:
+            return "Missing CPU turns file";
+        case E_PLAYER_MOVES_MISSING:
+            return "Missing player moves file";
+        case E_RULES:
+            return "Error in rules file";
+        case E_PLAYER_SHIP_OVERLAP:
+            return "Overlap in player map file";
+        case E_CPU_SHIP_OVERLAP:
+            return "Overlap in CPU map file";
+        case E_PLAYER_MAP_OOB:
+            return "Out of bounds in player map file";
+        case E_CPU_MAP_OOB:
+            return "Out of bounds in CPU map file";
+        case E_PLAYER_MAP:
+            return "Error in player map file";
+        case E_CPU_MAP:
+            return "Error in CPU map file";
+        case E_TURNS:
+            return "Error in turns file";
+        case E_PLAYER_GIVES_UP:
+            return "Bad guess";
+        case E_CPU_GIVES_UP:
+            return "CPU player gives up";
+        case E_SCENARIO:
+            return "Error in scenario file";
+        case E_HEATMAP:
+            return "Too many placements to count";
+        case E_SERVER:
+            return "Cannot listen on server address";
+        case E_SERVER_CPU:
+            return "CPU player cannot be served";
+        case E_JOURNAL:
+            return "Error in journal file";
+        case E_GENMAP:
+            return "Cannot write maps for the rules";
+        case E_EVALUATE:
+            return "Cannot evaluate turns for the rules";
+        default:
+            return NULL;
+    }
+}
+
+/* Returns the board owned by player.
+ *
+ * @param (struct naval_game* game) (game holding the boards)
+ * @param (int player) (PLAYER or CPU)
+ */
+static struct board* own_board(struct naval_game* game, int player)
+{
+    return (player == PLAYER) ? &game->playerBoard : &game->cpuBoard;
+}
+
+/* Returns the number of the ship at position x, y of the board, NONE if
+ * there is none. The position must not have been shot at.
+ *
+ * @param (const struct naval_game* game) (game holding the board)
+ * @param (const struct board* board) (board to be looked at)
+ * @param (int x) (x coordinate of the boards position)
+ * @param (int y) (y coordinate of the boards position)
+ */
+static int ship_at(const struct naval_game* game, const struct board* board,
+        int x, int y)
+{
+    if (game->engine == ENGINE_BITBOARD) {
+        return bitboard_ship_at(&board->bits, game->numShips, x, y);
+    }
+    if (game->engine == ENGINE_SPARSE) {
+        return sparse_ship_at(&board->sparse, x, y);
+    }
+    return CELL(board, x, y);
+}
+
+/* Initialises an empty board.
+ *
+ * @param (struct board* board) (board to be cleared)
+ * @param (int width) (width of the board)
+ * @param (int height) (height of the board)
+ */
+static void initialise_board(struct board* board, int width, int height)
+{
+    memset(&board->bits, 0, sizeof(board->bits));
+    memset(board->remaining, 0, sizeof(board->remaining));
+    board->afloat = 0;
+    if (board->cells != NULL) {
+        memset(board->cells, NONE, (size_t)board->stride * (height + 2));
+    }
+    sparse_clear(&board->sparse);
+}
+
+/* Clears a board of the game with the kernel for its size if there is one.
+ *
+ * @param (const struct naval_game* game) (game with its size set)
+ * @param (struct board* board) (board of the game to be cleared)
+ */
+static void clear_board(const struct naval_game* game, struct board* board)
+{
+    if (game->kernels != NULL && game->engine != ENGINE_SPARSE) {
+        game->kernels->clear(board);
+    } else {
+        initialise_board(board, game->width, game->height);
+    }
+}
+
+/* Narrows a slice of text to leave out leading and trailing whitespace.
+ *
+ * @param (const char** start) (start of the slice, moved past whitespace)
+ * @param (size_t* length) (length of the slice, shortened to match)
+ */
+static void trim_slice(const char** start, size_t* length)
+{
+    while (*length > 0 && isspace((unsigned char)**start)) {
+        (*start)++;
+        (*length)--;
+    }
+    while (*length > 0 && isspace((unsigned char)(*start)[*length - 1])) {
+        (*length)--;
+    }
+}
+
+/* Reads an integer from a slice of text the way sscanf's %i does: leading
+ * whitespace is skipped and the base follows any 0 or 0x prefix.
+ *
+ * @param (const char** p) (position in the text, moved past the integer)
+ * @param (const char* end) (end of the text)
+ * @param (int* value) (set to the integer read)
+ *
+ * @return (int) (1 if an integer was read, 0 otherwise)
+ */
+static int scan_int(const char** p, const char* end, int* value)
+{
+    char digits[32];
+    char* stop;
+    size_t n = 0;
+    long result;
+
+    while (*p < end && isspace((unsigned char)**p)) {
+        (*p)++;
+    }
+    while (*p + n < end && n < sizeof(digits) - 1 &&
+            (isxdigit((unsigned char)(*p)[n]) || (*p)[n] == 'x' ||
+            (*p)[n] == 'X' || (*p)[n] == '+' || (*p)[n] == '-')) {
+        digits[n] = (*p)[n];
+        n++;
+    }
+    digits[n] = '\0';
+    result = strtol(digits, &stop, 0);
+    if (stop == digits) {
+        return 0;
+    }
+    *p += stop - digits;
+    *value = (int)result;
+    return 1;
+}
+
+/* Reads the board dimensions, number of ships and ship sizes from the rules
+ * text and clears both boards.
+ *
+ * @param (struct naval_game* game) (game to be set up)
+ * @param (struct naval_text* rules) (text of the rules file)
+ *
+ * @return (int) (0 on success, E_RULES otherwise)
+ */
+static int parse_rules(struct naval_game* game, struct naval_text* rules)
+{
+    int width, height, numShips;
+    int fields;
+    const char* line;
+    size_t length;
+
+    naval_text_line(rules, &line, &length);
+    fields = scan_int(&line, line + length, &width);
+    fields += (fields == 1) && scan_int(&line, line + length, &height);
+    naval_text_line(rules, &line, &length);
+    fields += scan_int(&line, line + length, &numShips);
+    if ((fields != 3) || (width < 0) || (height < 0) || (width > SIDE_MAX) ||
+            (height > SIDE_MAX) || (numShips < 0) || (numShips > MAX_SHIPS)) {
+        return E_RULES;
+    }
+
+    for (int i = 0; i < numShips; i++) {
+        game->shipSizes[i] = 0;
+        naval_text_line(rules, &line, &length);
+        scan_int(&line, line + length, &game->shipSizes[i]);
+    }
+    game->numShips = numShips;
+    return size_boards(game, width, height) ? E_RULES : 0;
+}
+
+/* Sizes both boards of the game to the width and height and clears them.
+ * The array engine's cells of both are allocated together in one buffer,
+ * kept while the size stays the same. Boards of more than SPARSE_AREA
+ * positions are played on the sparse engine, which allocates no cells, and
+ * as the bitboard engine only holds boards up to MAX, larger ones are
+ * otherwise played on the array engine.
+ *
+ * @param (struct naval_game* game) (game to be set up)
+ * @param (int width) (width of the board, up to SIDE_MAX)
+ * @param (int height) (height of the board, up to SIDE_MAX)
+ *
+ * @return (int) (0 on success, -1 if out of memory)
+ */
+int size_boards(struct naval_game* game, int width, int height)
+{
+    size_t size = (size_t)(width + 2) * (height + 2);
+
+    if ((size_t)width * height > SPARSE_AREA) {
+        game->engine = ENGINE_SPARSE;
+    }
+    if (game->engine == ENGINE_SPARSE) {
+        free(game->cells);
+        game->cells = NULL;
+    } else if (game->cells == NULL || width != game->width ||
+            height != game->height) {
+        int8_t* cells = realloc(game->cells, 2 * size);
+
+        STATS_ALLOC(1);
+        if (cells == NULL) {
+            return -1;
+        }
+        game->cells = cells;
+    }
+    game->width = width;
+    game->height = height;
+    game->cpuBoard.cells = game->cells;
+    game->playerBoard.cells = (game->cells != NULL) ? game->cells + size :
+            NULL;
+    game->cpuBoard.stride = game->playerBoard.stride = width + 2;
+    game->kernels = find_kernels(width, height);
+
+    if (width > MAX || height > MAX) {
+        if (game->engine == ENGINE_BITBOARD) {
+            game->engine = ENGINE_ARRAY;
+        }
+        memset(&game->extent, 0, sizeof(game->extent));
+    } else {
+        bitboard_extent(&game->extent, width, height);
+    }
+    clear_board(game, &game->cpuBoard);
+    clear_board(game, &game->playerBoard);
+    return 0;
+}
+
+/* Copies a board of the game, ships, shots and counts, over another board
+ * of the same game.
+ *
+ * @param (const struct naval_game* game) (game owning both boards)
+ * @param (struct board* to) (board to be overwritten)
+ * @param (const struct board* from) (board to be copied)
+ *
+ * @return (int) (0 on success, -1 if out of memory)
+ */
+int copy_board(const struct naval_game* game, struct board* to,
+        const struct board* from)
+{
+    int8_t* cells = to->cells;
+    struct sparse sparse = to->sparse;
+
+    *to = *from;
+    to->cells = cells;
+    to->sparse = sparse;
+    if (cells != NULL) {
+        memcpy(cells, from->cells, (size_t)from->stride * (game->height + 2));
+    }
+    return sparse_copy(&to->sparse, &from->sparse);
+}
+
+/* Parses rules as parse_rules does, timing it for --stats.
+ *
+ * @param (struct naval_game* game) (game to be set up)
+ * @param (struct naval_text* rules) (text of the rules file)
+ *
+ * @return (int) (0 on success, E_RULES otherwise)
+ */
+int load_rules(struct naval_game* game, struct naval_text* rules)
+{
+    unsigned long long start = STATS_START();
+    int error = parse_rules(game, rules);
+
+    STATS_STOP(PHASE_RULES, start);
+    return error;
+}
+
+/* Reads the rules file into the game.
+ *
+ * @param (struct naval_game* game) (game to be set up)
+ * @param (FILE* rules) (filename of the rules file)
+ *
+ * @return (int) (0 on success, E_RULES otherwise)
+ */
+int naval_load_rules(struct naval_game* game, FILE* rules)
+{
+    struct naval_text text;
+    int error;
+
+    if (naval_text_open(&text, rules)) {
+        return E_RULES;
+    }
+    error = load_rules(game, &text);
+    naval_text_close(&text);
+    return error;
+}
+
+/* Reads rules held in memory into the game.
+ *
+ * @param (struct naval_game* game) (game to be set up)
+ * @param (const char* data) (contents of a rules file)
+ * @param (size_t length) (number of bytes of data)
+ *
+ * @return (int) (0 on success, E_RULES otherwise)
+ */
+int naval_load_rules_buffer(struct naval_game* game, const char* data,
+        size_t length)
+{
+    struct naval_text text;
+
+    naval_text_buffer(&text, data, length);
+    return load_rules(game, &text);
+}
+
+/* Checks if the input string is a valid move and returns 0 if so. A move
+ * is a column of uppercase letters, named A to Z and then AA, AB and so on,
+ * followed by the digits of a row.
+ *
+ * @param (const char* move) (the move just played as a string)
+ * @param (size_t length) (length of the move)
+ *
+ * @return (int) (0 if a bad move, 1 if not)
+ */
+int check_bad_move(const char* move, size_t length)
+{
+    size_t letters = 0;
+
+    while (letters < length && isupper((unsigned char)move[letters])) {
+        letters++;
+    }
+    if (letters == 0 || letters > COLUMN_LETTERS_MAX ||
+            length - letters == 0 || length - letters > ROW_DIGITS_MAX) {
+        return 0;
+    }
+    for (size_t i = letters; i < length; i++) {
+        if (!(isdigit((unsigned char)move[i]))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Checks if the x and y coordinates are valid and returns 0 if so.
+ *
+ * @param (int x) (x coordinate of the boards position)
+ * @param (int y) (y coordinate of the boards position)
+ * @param (int width) (width of the board)
+ * @param (int height) (height of the board)
+ *
+ * @return (int) (0 if a bad guess, 1 if not)
+ */
+int check_bad_guess(int x, int y, int width, int height)
+{
+    if ((x > width) || (x < 1) || (y < 1) || (y > height)) {
+        return 0;
+    }
+    return 1;
+}
+
+/* Checks if the move just played has been played before.
+ *
+ * @param (struct naval_game* game) (game being played)
+ * @param (int player) (PLAYER or CPU depending on who made the move)
+ * @param (int x) (x coordinate of the boards position)
+ * @param (int y) (y coordinate of the boards position)
+ *
+ * @return (int) (0 if repeated guess, 1 if not)
+ */
+int check_repeat(struct naval_game* game, int player, int x, int y)
+{
+    struct board* target = own_board(game, (player == PLAYER) ? CPU : PLAYER);
+
+    if (game->engine == ENGINE_BITBOARD) {
+        return !bitboard_test(&target->bits.shots, x, y);
+    }
+    if (game->engine == ENGINE_SPARSE) {
+        return !positions_test(&target->sparse.shots, SPARSE_KEY(x, y));
+    }
+    if (CELL(target, x, y) == HIT || CELL(target, x, y) == MISS) {
+        return 0;
+    }
+    return 1;
+}
+
+/* Checks if the hit just played sunk a ship.
+ *
+ * @param (struct naval_game* game) (game being played)
+ * @param (int player) (PLAYER or CPU depending on who made the move)
+ * @param (int ship) (ship number that was hit)
+ *
+ * @return (int) (1 if the ship has no positions left, 0 otherwise)
+ */
+int check_sunk(struct naval_game* game, int player, int ship)
+{
+    struct board* target = own_board(game, (player == PLAYER) ? CPU : PLAYER);
+
+    return target->remaining[ship - 1] == 0;
+}
+
+/* Checks if the move just played was a hit or miss, updates the board
+ * accordingly and counts the position off the ship that was hit.
+ *
+ * @param (struct naval_game* game) (game being played)
+ * @param (int player) (PLAYER or CPU depending on who made the move)
+ * @param (int x) (x coordinate of the boards position)
+ * @param (int y) (y coordinate of the boards position)
+ *
+ * @return (int) (NONE if miss, the number of the ship hit otherwise)
+ */
+int check_hit(struct naval_game* game, int player, int x, int y)
+{
+    struct board* target = own_board(game, (player == PLAYER) ? CPU : PLAYER);
+    int ship = ship_at(game, target, x, y);
+
+    if (game->engine == ENGINE_BITBOARD) {
+        bitboard_hit(&target->bits, x, y);
+    } else if (game->engine == ENGINE_SPARSE) {
+        sparse_hit(&target->sparse, x, y);
+    } else {
+        CELL(target, x, y) = (ship == NONE) ? MISS : HIT;
+    }
+    if (ship != NONE && --target->remaining[ship - 1] == 0) {
+        target->afloat--;
+    }
+    return ship;
+}
+
+/* Fires the shot of player at position x, y of the opposing board.
+ *
+ * @param (struct naval_game* game) (game being played)
+ * @param (int player) (PLAYER or CPU depending on who made the move)
+ * @param (int x) (x coordinate of the boards position)
+ * @param (int y) (y coordinate of the boards position)
+ *
+ * @return (int) (one of enum Shots)
+ */
+int naval_fire(struct naval_game* game, int player, int x, int y)
+{
+    unsigned long long start = STATS_START();
+    int ship, shot;
+
+    if (!(check_bad_guess(x, y, game->width, game->height))) {
+        return SHOT_BAD;
+    }
+    if (!check_repeat(game, player, x, y)) {
+        return SHOT_REPEATED;
+    }
+    // not a bad or repeated guess
+    ship = check_hit(game, player, x, y);
+    STATS_STOP(PHASE_HIT, start);
+    if (ship == NONE) {
+        shot = SHOT_MISS;
+    } else {
+        start = STATS_START();
+        shot = check_sunk(game, player, ship) ? SHOT_SUNK : SHOT_HIT;
+        STATS_STOP(PHASE_CHECKS, start);
+    }
+    if (game->journal != NULL) {
+        journal_shot(game->journal, player, x, y, shot);
+    }
+    return shot;
+}
+
+/* Parses a move such as "C7" or "AB120", ignoring surrounding whitespace,
+ * into its coordinates.
+ *
+ * @param (const char* move) (the move as read from the input)
+ * @param (size_t length) (length of the move)
+ * @param (int* x) (set to the x coordinate of the move)
+ * @param (int* y) (set to the y coordinate of the move)
+ *
+ * @return (int) (0 if a bad move, 1 if not)
+ */
+int parse_move(const char* move, size_t length, int* x, int* y)
+{
+    unsigned long long start = STATS_START();
+    const char* end;
+    int valid;
+
+    trim_slice(&move, &length);
+    if ((valid = check_bad_move(move, length))) {
+        // is a valid input
+        end = move + length;
+        *x = 0;
+        while (isupper((unsigned char)*move)) {
+            *x = *x * 26 + *move++ - 64;
+        }
+        scan_int(&move, end, y);
+    }
+    STATS_STOP(PHASE_INTAKE, start);
+    return valid;
+}
+
+/* Writes the name of a position as a move is typed, its column letters
+ * followed by its row.
+ *
+ * @param (int x) (x coordinate of the boards position, from 1)
+ * @param (int y) (y coordinate of the boards position, from 1)
+ * @param (char* buffer) (buffer of NAVAL_MOVE_MAX bytes)
+ *
+ * @return (size_t) (length of the name)
+ */
+size_t naval_move_name(int x, int y, char* buffer)
+{
+    char letters[COLUMN_LETTERS_MAX];
+    int count = 0;
+    char* p = buffer;
+
+    for (; x > 0 && count < COLUMN_LETTERS_MAX; x = (x - 1) / 26) {
+        letters[count++] = 'A' + (x - 1) % 26;
+    }
+    while (count > 0) {
+        *p++ = letters[--count];
+    }
+    return (p - buffer) + sprintf(p, "%d", y);
+}
+
+/* Parses a move such as "C7", ignoring surrounding whitespace, and fires it.
+ *
+ * @param (struct naval_game* game) (game being played)
+ * @param (int player) (PLAYER or CPU depending on who made the move)
+ * @param (const char* move) (the move as read from the input)
+ *
+ * @return (int) (one of enum Shots)
+ */
+int naval_move(struct naval_game* game, int player, const char* move)
+{
+    return naval_move_n(game, player, move, strlen(move));
+}
+
+/* As naval_move, for a move that is not NUL terminated.
+ *
+ * @param (struct naval_game* game) (game being played)
+ * @param (int player) (PLAYER or CPU depending on who made the move)
+ * @param (const char* move) (the move as read from the input)
+ * @param (size_t length) (length of the move)
+ *
+ * @return (int) (one of enum Shots)
+ */
+int naval_move_n(struct naval_game* game, int player, const char* move,
+        size_t length)
+{
+    int x, y;
+
+    if (!parse_move(move, length, &x, &y)) {
+        return SHOT_BAD;
+    }
+    return naval_fire(game, player, x, y);
+}
+
+/* Checks if the position a ship is being placed on is already taken by
+ * another ship.
+ *
+ * @param (struct naval_game* game) (game being set up)
+ * @param (int player) (PLAYER or CPU depending on which map file)
+ * @param (int x) (x coordinate of the boards position)
+ * @param (int y) (y coordinate of the boards position)
+ *
+ * @return (int) (0 if free, the overlap error for that player otherwise)
+ */
+int check_overlap(struct naval_game* game, int player, int x, int y)
+{
+    struct board* board = own_board(game, player);
+
+    if (CELL(board, x, y) == HIT || CELL(board, x, y) == MISS ||
+            CELL(board, x, y) == NONE) {
+        return 0;
+    }
+    return (player == PLAYER) ? E_PLAYER_SHIP_OVERLAP : E_CPU_SHIP_OVERLAP;
+}
+
+/* Loops through each position of a ship placing its number on the board.
+ *
+ * @param (struct naval_game* game) (game being set up)
+ * @param (int player) (PLAYER or CPU depending on which map file)
+ * @param (int shipNum) (ship number)
+ * @param (int x) (x coordinate of the boards position)
+ * @param (int y) (y coordinate of the boards position)
+ * @param (char dir) (direction ship is to be placed in)
+ *
+ * @return (int) (0 on success, otherwise the map error for that player)
+ */
+static int place_cells(struct naval_game* game, int player, int shipNum, int x,
+        int y, char dir)
+{
+    struct board* board = own_board(game, player);
+    int error;
+
+    for (int i = 0; i < game->shipSizes[shipNum - 1]; i++) {
+        if ((error = check_overlap(game, player, x, y))) {
+            return error;
+        }
+
+        CELL(board, x, y) = shipNum;
+        switch (dir) {
+            case 'N':
+                y--;
+                break;
+            case 'E':
+                x++;
+                break;
+            case 'S':
+                y++;
+                break;
+            case 'W':
+                x--;
+                break;
+            default:
+                return (player == PLAYER) ? E_PLAYER_MAP : E_CPU_MAP;
+        }
+        if (x < 0 || x > game->width + 1 || y < 0 || y > game->height + 1) {
+            return (player == PLAYER) ? E_PLAYER_MAP_OOB : E_CPU_MAP_OOB;
+        }
+    }
+    return 0;
+}
+
+/* Places a ship on the board of the selected engine and sets its count of
+ * positions left.
+ *
+ * @param (struct naval_game* game) (game being set up)
+ * @param (int player) (PLAYER or CPU depending on which map file)
+ * @param (int shipNum) (ship number)
+ * @param (int x) (x coordinate of the boards position)
+ * @param (int y) (y coordinate of the boards position)
+ * @param (char dir) (direction ship is to be placed in)
+ *
+ * @return (int) (0 on success, otherwise the map error for that player)
+ */
+int ship_directions(struct naval_game* game, int player, int shipNum, int x,
+        int y, char dir)
+{
+    struct board* board = own_board(game, player);
+    int size = game->shipSizes[shipNum - 1];
+    int error;
+
+    if (game->engine == ENGINE_BITBOARD) {
+        error = bitboard_place(&board->bits, &game->extent, player, shipNum,
+                size, x, y, dir);
+    } else if (game->engine == ENGINE_SPARSE) {
+        error = sparse_place(&board->sparse, game->width, game->height,
+                player, shipNum, size, x, y, dir);
+    } else {
+        error = place_cells(game, player, shipNum, x, y, dir);
+    }
+    if (error) {
+        return error;
+    }
+    if (size > 0) {
+        board->remaining[shipNum - 1] = size;
+        board->afloat++;
+    }
+    return 0;
+}
+
+/* Splits a map line on spaces into its position and direction.
+ *
+ * @param (const char* line) (line of the map with whitespace trimmed)
+ * @param (size_t length) (length of the line)
+ * @param (int* x) (set to the x coordinate of the position)
+ * @param (int* y) (set to the y coordinate of the position)
+ * @param (char* dir) (set to the direction, 0 if it is not one character)
+ *
+ * @return (int) (0 if the line is malformed, 1 otherwise)
+ */
+static int decode_placement(const char* line, size_t length, int* x, int* y,
+        char* dir)
+{
+    const char* tokens[2] = {"", ""};
+    size_t lengths[2] = {0, 0};
+    const char* end = line + length;
+    const char* p = line;
+    int count = 0;
+
+    while (p < end) {
+        const char* start;
+
+        while (p < end && *p == ' ') {
+            p++;
+        }
+        if (p == end) {
+            break;
+        }
+        start = p;
+        while (p < end && *p != ' ') {
+            p++;
+        }
+        if (count < 2) {
+            tokens[count] = start;
+            lengths[count] = p - start;
+        }
+        count++;
+    }
+    if (count > 2 || !parse_move(tokens[0], lengths[0], x, y)) {
+        return 0;
+    }
+    trim_slice(&tokens[1], &lengths[1]);
+    *dir = (lengths[1] == 1) ? tokens[1][0] : 0;
+    return 1;
+}
+
+/* Reads the map text line by line to get the ship location and direction,
+ * checks if the position is bad and checks if the number of ships aligns wi
+ * th that in the rules file.
+ *
+ * @param (struct naval_game* game) (game being set up)
+ * @param (struct naval_text* text) (text of the map file)
+ * @param (int player) (PLAYER or CPU depending on which map file)
+ *
+ * @return (int) (0 on success, otherwise the map error for that player)
+ */
+static int place_ships(struct naval_game* game, struct naval_text* text,
+        int player)
+{
+    int mapError = (player == PLAYER) ? E_PLAYER_MAP : E_CPU_MAP;
+    const char* line;
+    size_t length;
+    char dir;
+    int x, y, shipNum = 0;
+    int error;
+
+    while (naval_text_line(text, &line, &length), trim_slice(&line, &length),
+            length != 0) {
+        if (!decode_placement(line, length, &x, &y, &dir)) {
+            return mapError;
+        }
+        if (check_bad_guess(x, y, game->width, game->height) && dir != 0) {
+            // isnt out of bounds and is a valid direction
+            if (++shipNum > game->numShips) {
+                return mapError;
+            }
+            if ((error = ship_directions(game, player, shipNum, x, y, dir))) {
+                return error;
+            }
+        }
+    }
+    if (shipNum != game->numShips) {
+        return mapError;
+    }
+    return 0;
+}
+
+/* Places the ships of a map as place_ships does, timing each call for
+ * --stats.
+ *
+ * @param (struct naval_game* game) (game being set up)
+ * @param (struct naval_text* text) (text of the map file)
+ * @param (int player) (PLAYER or CPU depending on which map file)
+ *
+ * @return (int) (0 on success, otherwise an error from enum Errors)
+ */
+int read_map(struct naval_game* game, struct naval_text* text, int player)
+{
+    unsigned long long start = STATS_START();
+    int error = place_ships(game, text, player);
+
+    STATS_STOP(PHASE_MAP, start);
+    return error;
+}
+
+/* Places the ships of the map file on the board owned by player.
+ *
+ * @param (struct naval_game* game) (game being set up)
+ * @param (int player) (PLAYER or CPU depending on which map file)
+ * @param (FILE* map) (filename of the map file)
+ *
+ * @return (int) (0 on success, otherwise the map error for that player)
+ */
+int naval_load_map(struct naval_game* game, int player, FILE* map)
+{
+    struct naval_text text;
+    int error;
+
+    if (naval_text_open(&text, map)) {
+        return (player == PLAYER) ? E_PLAYER_MAP : E_CPU_MAP;
+    }
+    error = read_map(game, &text, player);
+    naval_text_close(&text);
+    return error;
+}
+
+/* Places the ships of a map held in memory on the board owned by player.
+ *
+ * @param (struct naval_game* game) (game being set up)
+ * @param (int player) (PLAYER or CPU depending on which map file)
+ * @param (const char* data) (contents of a map file)
+ * @param (size_t length) (number of bytes of data)
+ *
+ * @return (int) (0 on success, otherwise the map error for that player)
+ */
+int naval_load_map_buffer(struct naval_game* game, int player,
+        const char* data, size_t length)
+{
+    struct naval_text text;
+
+    naval_text_buffer(&text, data, length);
+    return read_map(game, &text, player);
+}
+
+/* Finds the error ship_directions would return for a ship on any engine
+ * without placing it: an overlap on the board, then a direction other than
+ * N, E, S or W, then a position past the edge.
+ *
+ * @param (struct naval_game* game) (game being set up)
+ * @param (int player) (PLAYER or CPU depending on which map file)
+ * @param (int shipNum) (ship number)
+ * @param (int x) (x coordinate of the boards position)
+ * @param (int y) (y coordinate of the boards position)
+ * @param (char dir) (direction ship is to be placed in)
+ * @param (int* kind) (set to the problem from enum MapProblems on error)
+ *
+ * @return (int) (0 if the ship fits, otherwise the map error for that player)
+ */
+static int check_placement(struct naval_game* game, int player, int shipNum,
+        int x, int y, char dir, int* kind)
+{
+    const struct board* board = own_board(game, player);
+    int size = game->shipSizes[shipNum - 1];
+    int dx = 0, dy = 0;
+    long endX, endY;
+
+    switch (dir) {
+        case 'N':
+            dy = -1;
+            break;
+        case 'E':
+            dx = 1;
+            break;
+        case 'S':
+            dy = 1;
+            break;
+        case 'W':
+            dx = -1;
+            break;
+    }
+    for (int i = 0; i < size; i++) {
+        int px = x + i * dx;
+        int py = y + i * dy;
+
+        if (!check_bad_guess(px, py, game->width, game->height)) {
+            break;
+        }
+        if (ship_at(game, board, px, py) != NONE) {
+            *kind = MAP_OVERLAP;
+            return (player == PLAYER) ? E_PLAYER_SHIP_OVERLAP :
+                    E_CPU_SHIP_OVERLAP;
+        }
+        if (dx == 0 && dy == 0) {
+            // only the first position is checked before the direction
+            *kind = MAP_DIRECTION;
+            return (player == PLAYER) ? E_PLAYER_MAP : E_CPU_MAP;
+        }
+    }
+    endX = x + (long)(size - 1) * dx;
+    endY = y + (long)(size - 1) * dy;
+    if (size > 0 && (endX < 1 || endX > game->width || endY < 1 ||
+            endY > game->height)) {
+        *kind = MAP_OOB;
+        return (player == PLAYER) ? E_PLAYER_MAP_OOB : E_CPU_MAP_OOB;
+    }
+    return 0;
+}
+
+/* Stores a problem of a map if there is room for it and counts it.
+ *
+ * @param (struct naval_map_problem* problems) (problems found so far)
+ * @param (int capacity) (problems there is room for)
+ * @param (int* count) (problems found so far, counted up)
+ * @param (const struct naval_map_problem* problem) (problem just found)
+ */
+static void add_problem(struct naval_map_problem* problems, int capacity,
+        int* count, const struct naval_map_problem* problem)
+{
+    if (*count < capacity) {
+        problems[*count] = *problem;
+    }
+    (*count)++;
+}
+
+/* Checks the map line by line as place_ships reads it, placing each ship
+ * that fits and noting every problem with the line it is on.
+ *
+ * @param (struct naval_game* game) (game with its rules loaded)
+ * @param (int player) (PLAYER or CPU depending on which map file)
+ * @param (const char* data) (contents of the map file)
+ * @param (size_t length) (number of bytes of data)
+ * @param (struct naval_map_problem* problems) (filled in with problems)
+ * @param (int capacity) (problems there is room for)
+ *
+ * @return (int) (number of problems found)
+ */
+static int check_ships(struct naval_game* game, int player, const char* data,
+        size_t length, struct naval_map_problem* problems, int capacity)
+{
+    int mapError = (player == PLAYER) ? E_PLAYER_MAP : E_CPU_MAP;
+    struct naval_map_problem problem;
+    struct naval_text text;
+    const char* line;
+    size_t lineLength;
+    char dir;
+    int x, y, shipNum = 0;
+    int count = 0;
+    int extra = -1;
+
+    naval_text_buffer(&text, data, length);
+    problem.line = 1;
+    while (1) {
+        const char* start = text.next;
+        int next = problem.line;
+
+        naval_text_line(&text, &line, &lineLength);
+        trim_slice(&line, &lineLength);
+        if (lineLength == 0) {
+            break;
+        }
+        // a line joined across comments is reported where it starts
+        for (const char* p = start; p < text.next &&
+                (p = memchr(p, '\n', text.next - p)) != NULL; p++) {
+            next++;
+        }
+        problem.kind = MAP_LINE;
+        problem.ship = 0;
+        problem.code = mapError;
+        if (!decode_placement(line, lineLength, &x, &y, &dir)) {
+            add_problem(problems, capacity, &count, &problem);
+        } else if (check_bad_guess(x, y, game->width, game->height) &&
+                dir != 0) {
+            problem.ship = ++shipNum;
+            if (shipNum > game->numShips) {
+                // the ships past the rules are one problem, at the first
+                if (extra < 0) {
+                    problem.kind = MAP_SHIPS;
+                    extra = count;
+                    add_problem(problems, capacity, &count, &problem);
+                }
+            } else if ((problem.code = check_placement(game, player, shipNum,
+                    x, y, dir, &problem.kind))) {
+                add_problem(problems, capacity, &count, &problem);
+            } else {
+                ship_directions(game, player, shipNum, x, y, dir);
+            }
+        }
+        problem.line = next;
+    }
+    if (extra >= 0 && extra < capacity) {
+        problems[extra].ship = shipNum;
+    } else if (shipNum < game->numShips) {
+        problem.line = 0;
+        problem.kind = MAP_SHIPS;
+        problem.ship = shipNum;
+        problem.code = mapError;
+        add_problem(problems, capacity, &count, &problem);
+    }
+    return count;
+}
+
+/* Checks a map against the loaded rules on a cleared board, as check_ships
+ * does, timing it for --stats.
+ *
+ * @param (struct naval_game* game) (game with its rules loaded)
+ * @param (int player) (PLAYER or CPU depending on which map file)
+ * @param (const char* data) (contents of the map file)
+ * @param (size_t length) (number of bytes of data)
+ * @param (struct naval_map_problem* problems) (filled in with problems)
+ * @param (int capacity) (problems there is room for)
+ *
+ * @return (int) (number of problems found)
+ */
+int naval_check_map(struct naval_game* game, int player, const char* data,
+        size_t length, struct naval_map_problem* problems, int capacity)
+{
+    unsigned long long start = STATS_START();
+    int count;
+
+    clear_board(game, own_board(game, player));
+    count = check_ships(game, player, data, length, problems, capacity);
+    STATS_STOP(PHASE_MAP, start);
+    return count;
+}
+
+/* Places the ships of a board exactly as given, with no checks beyond
+ * ignoring numbers that are not ships of the rules. The boards must have
+ * been sized with size_boards, up to MAX.
+ *
+ * @param (struct naval_game* game) (game being set up)
+ * @param (int player) (PLAYER or CPU, owner of the board)
+ * @param (const int8_t* ships) (ship number at every padded position, row
+ *        by row)
+ */
+void restore_board(struct naval_game* game, int player, const int8_t* ships)
+{
+    struct board* board = own_board(game, player);
+
+    clear_board(game, board);
+    for (int i = 1; i < (game->height + 1); i++) {
+        for (int j = 1; j < (game->width + 1); j++) {
+            int ship = ships[i * (MAX + 2) + j];
+
+            if (ship < 1 || ship > game->numShips) {
+                continue;
+            }
+            if (game->engine == ENGINE_BITBOARD) {
+                bitboard_set(&board->bits.ships[ship - 1], j, i);
+                bitboard_set(&board->bits.occupied, j, i);
+            } else if (game->engine == ENGINE_SPARSE) {
+                sparse_set(&board->sparse, ship, j, i);
+            } else {
+                CELL(board, j, i) = ship;
+            }
+            if (board->remaining[ship - 1]++ == 0) {
+                board->afloat++;
+            }
+        }
+    }
+}
+
+/* Checks if either player has won the game and returns 0 if not.
+ *
+ * @param (const struct naval_game* game) (game being played)
+ *
+ * @return (int) (PLAYER or CPU if that side has won, 0 otherwise)
+ */
+int check_win(const struct naval_game* game)
+{
+    unsigned long long start = STATS_START();
+    int winner = 0;
+
+    if (game->cpuBoard.afloat == 0) {
+        winner = PLAYER;
+    } else if (game->playerBoard.afloat == 0) {
+        winner = CPU;
+    }
+    STATS_STOP(PHASE_CHECKS, start);
+    return winner;
+}
+
+/* Returns the winner of the game, 0 while it is still going.
+ *
+ * @param (const struct naval_game* game) (game being played)
+ */
+int naval_winner(const struct naval_game* game)
+{
+    return check_win(game);
+}
+
+/* Returns the status of position x, y on the board owned by player.
+ *
+ * @param (const struct naval_game* game) (game being played)
+ * @param (int player) (PLAYER or CPU)
+ * @param (int x) (x coordinate of the boards position)
+ * @param (int y) (y coordinate of the boards position)
+ *
+ * @return (int) (NONE, MISS, HIT or the ship number)
+ */
+int naval_cell(const struct naval_game* game, int player, int x, int y)
+{
+    const struct board* board = (player == PLAYER) ? &game->playerBoard :
+            &game->cpuBoard;
+
+    if (game->engine == ENGINE_BITBOARD) {
+        return bitboard_cell(&board->bits, game->numShips, x, y);
+    }
+    if (game->engine == ENGINE_SPARSE) {
+        return sparse_cell(&board->sparse, x, y);
+    }
+    return CELL(board, x, y);
+}
+
+int naval_width(const struct naval_game* game)
+{
+    return game->width;
+}
+
+int naval_height(const struct naval_game* game)
+{
+    return game->height;
+}
+
+int naval_ships(const struct naval_game* game)
+{
+    return game->numShips;
+}
+
+int naval_ship_size(const struct naval_game* game, int ship)
+{
+    return game->shipSizes[ship - 1];
+}
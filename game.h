@@ -0,0 +1,177 @@
+#ifndef GAME_H
+#define GAME_H
+
+#include "naval.h"
+#include "bitboard.h"
+#include "sparse.h"
+
+/* One side's board, padded by a border cell on every edge. The array
+ * engine's cells are rows of stride positions in the game's buffer, read
+ * and written with CELL. remaining holds the positions of each ship not yet
+ * hit and afloat the ships with any left, so sunk ships and wins are known
+ * without looking at the board.
+ */
+struct board {
+    int8_t* cells;
+    int stride;
+    struct bitboards bits;
+    struct sparse sparse;
+    int remaining[MAX_SHIPS];
+    int afloat;
+};
+
+// Position x, y of a board of the array engine
+#define CELL(board, x, y) ((board)->cells[(size_t)(y) * (board)->stride + (x)])
+
+struct naval_game;
+struct endgame_table;
+
+/* Board loops compiled for one board size, with constant bounds so they
+ * are unrolled and vectorised. Games of that size on the array engine use
+ * them in place of the generic loops.
+ */
+struct kernels {
+    int width;
+    int height;
+    void (*clear)(struct board* board);
+    char* (*cpuBoard)(char* frame, const struct naval_game* game);
+    char* (*playerBoard)(char* frame, const struct naval_game* game);
+};
+
+struct naval_game {
+    int engine;
+    const struct kernels* kernels;
+    struct naval_journal* journal;
+    int width;
+    int height;
+    int numShips;
+    int shipSizes[MAX_SHIPS];
+    struct bitboard extent;
+    int8_t* cells;
+    struct board cpuBoard;
+    struct board playerBoard;
+};
+
+// What the ai knows of each position of the board it fires at
+enum Knowledge {
+    CELL_UNKNOWN,
+    CELL_MISS,
+    CELL_HIT,
+    CELL_SUNK
+};
+
+/* Targeting state of one side, which learns only whether each shot missed,
+ * hit or sank a ship. Ships of equal size are grouped into a class and every
+ * placement of a class, a start position and a direction, keeps how many
+ * missed or sunk positions it covers (blocked) and how many hits not yet put
+ * down to a sunk ship (hits). Only placements with nothing blocked are
+ * legal. density counts the legal placements of a class over each position
+ * and target the hits those placements cover, and total and targetTotal
+ * weigh both by the ships of the class still afloat, as far as the hits tell
+ * which class each sunk ship was. A shot changes only the placements running
+ * through its position, so every count is kept up to date without being
+ * worked out again. With thinkMs set the shots are searched for by
+ * mcts_choose instead, which adds up its playouts and the seconds they took.
+ * Once no more than endgame ships are afloat endgame_choose solves the shots
+ * exactly where it can, counting them in solved, and givenUp holds the
+ * layouts left when it last could not. The solver keeps its transposition
+ * tables, one per thread, in tables, and works from the shots alone:
+ * shotOrder numbers each position in the order it was fired at, from 1, and
+ * sank marks the shots that sank a ship.
+ */
+struct naval_ai {
+    int player;
+    int width;
+    int height;
+    int numShips;
+    int classes;
+    int pending;
+    int shots;
+    int unresolved;
+    int sinkX[MAX_SHIPS];
+    int sinkY[MAX_SHIPS];
+    int sizes[MAX_SHIPS];
+    int afloat[MAX_SHIPS];
+    int shipClass[MAX_SHIPS];
+    unsigned char known[MAX + 2][MAX + 2];
+    unsigned short shotOrder[MAX + 2][MAX + 2];
+    unsigned char sank[MAX + 2][MAX + 2];
+    unsigned char settled[MAX + 2][MAX + 2];
+    unsigned char blocked[MAX_SHIPS][2][MAX + 2][MAX + 2];
+    unsigned char hits[MAX_SHIPS][2][MAX + 2][MAX + 2];
+    int density[MAX_SHIPS][MAX + 2][MAX + 2];
+    int target[MAX_SHIPS][MAX + 2][MAX + 2];
+    long total[MAX + 2][MAX + 2];
+    long targetTotal[MAX + 2][MAX + 2];
+    int threads;
+    int thinkMs;
+    long playouts;
+    double seconds;
+    int endgame;
+    int givenUp;
+    long solved;
+    struct endgame_table* tables;
+    int tableCount;
+};
+
+// Parts of a game timed by --stats
+enum Phases {
+    PHASE_RULES,
+    PHASE_MAP,
+    PHASE_INTAKE,
+    PHASE_HIT,
+    PHASE_CHECKS,
+    PHASE_RENDER,
+    PHASES
+};
+
+// Set by naval_stats_enable. While it is clear timing a phase costs a test
+extern int statsOn;
+
+#define STATS_START() (statsOn ? stats_cycles() : 0)
+#define STATS_STOP(phase, start) do { \
+        if (statsOn) { \
+            stats_phase((phase), (start)); \
+        } \
+    } while (0)
+#define STATS_ALLOC(count) do { \
+        if (statsOn) { \
+            stats_alloc(count); \
+        } \
+    } while (0)
+
+unsigned long long stats_cycles(void);
+void stats_phase(int phase, unsigned long long start);
+void stats_alloc(int count);
+
+const struct kernels* find_kernels(int width, int height);
+void journal_shot(struct naval_journal* journal, int player, int x, int y,
+        int shot);
+
+int load_rules(struct naval_game* game, struct naval_text* rules);
+int size_boards(struct naval_game* game, int width, int height);
+int copy_board(const struct naval_game* game, struct board* to,
+        const struct board* from);
+int check_bad_move(const char* move, size_t length);
+int check_bad_guess(int x, int y, int width, int height);
+int parse_move(const char* move, size_t length, int* x, int* y);
+int check_repeat(struct naval_game* game, int player, int x, int y);
+int check_hit(struct naval_game* game, int player, int x, int y);
+int check_sunk(struct naval_game* game, int player, int ship);
+int check_overlap(struct naval_game* game, int player, int x, int y);
+int ship_directions(struct naval_game* game, int player, int shipNum, int x,
+        int y, char dir);
+int read_map(struct naval_game* game, struct naval_text* text, int player);
+void restore_board(struct naval_game* game, int player, const int8_t* ships);
+int check_win(const struct naval_game* game);
+
+int mcts_choose(struct naval_ai* ai, int* x, int* y);
+int endgame_choose(struct naval_ai* ai, int* x, int* y);
+void endgame_free(struct naval_ai* ai);
+
+char cpu_chars(int value);
+char player_chars(int value);
+char* display_cpu_board(char* frame, const struct naval_game* game);
+char* display_player_board(char* frame, const struct naval_game* game);
+
+#endif
@@ -0,0 +1,333 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "game.h"
+
+// Bits of a layout mask, one per position and row by row without a border
+#define GENERATE_WORDS ((MAX * MAX + 63) / 64)
+// Draws of a ship rejected before its free placements are listed instead
+#define GENERATE_REJECTS 32
+// Layouts started over before the rules are taken to fit no layout
+#define GENERATE_RESTARTS (1 << 20)
+
+/* Every placement of one ship size that lies on the board: its start and
+ * direction as a map line gives them, and the mask of the positions it
+ * covers.
+ */
+struct placements {
+    int size;
+    int count;
+    struct naval_placement* places;
+    uint64_t* masks;
+};
+
+/* Draws layouts for one rules file. Each ship draws from the placements of
+ * its size, shared between ships of equal size, and masks take only as many
+ * of the GENERATE_WORDS words as the board needs.
+ */
+struct naval_generator {
+    int numShips;
+    int uniform;
+    int words;
+    int sizes;
+    uint64_t seed;
+    int shipPlacements[MAX_SHIPS];
+    struct placements placements[MAX_SHIPS];
+    int* free;
+};
+
+/* Steps a xorshift generator.
+ *
+ * @param (uint64_t* seed) (state of the generator)
+ *
+ * @return (uint64_t) (the next number)
+ */
+static inline uint64_t next_bits(uint64_t* seed)
+{
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 7;
+    *seed ^= *seed << 17;
+    return *seed;
+}
+
+/* Returns a number below limit, every one equally likely: the high half of
+ * a 32 bit draw times the limit, drawing again on the few low halves that
+ * would favour some numbers.
+ *
+ * @param (uint64_t* seed) (state of the generator)
+ * @param (uint32_t limit) (one more than the largest number returned)
+ *
+ * @return (uint32_t) (number from 0 to limit - 1)
+ */
+static inline uint32_t next_below(uint64_t* seed, uint32_t limit)
+{
+    uint64_t product = (next_bits(seed) >> 32) * limit;
+
+    if ((uint32_t)product < limit) {
+        uint32_t threshold = -limit % limit;
+
+        while ((uint32_t)product < threshold) {
+            product = (next_bits(seed) >> 32) * limit;
+        }
+    }
+    return product >> 32;
+}
+
+/* Lists every placement of a ship size that stays on the board, in each of
+ * the four directions ship_directions takes. A ship covering one position
+ * lies the same way in all four and a longer one has two starts for each
+ * run of positions, so every layout is listed equally often.
+ *
+ * @param (struct placements* list) (list to be filled in for its size)
+ * @param (int width) (width of the board)
+ * @param (int height) (height of the board)
+ * @param (int words) (words of each mask)
+ *
+ * @return (int) (0 on success, -1 if out of memory)
+ */
+static int list_placements(struct placements* list, int width, int height,
+        int words)
+{
+    static const char dirs[4] = {'N', 'E', 'S', 'W'};
+    static const int dx[4] = {0, 1, 0, -1};
+    static const int dy[4] = {-1, 0, 1, 0};
+    int size = list->size;
+    int capacity = 4 * width * height;
+
+    STATS_ALLOC(2);
+    list->count = 0;
+    list->places = malloc(capacity * sizeof(struct naval_placement));
+    list->masks = calloc((size_t)capacity * words, sizeof(uint64_t));
+    if (list->places == NULL || list->masks == NULL) {
+        return -1;
+    }
+    for (int y = 1; y < (height + 1); y++) {
+        for (int x = 1; x < (width + 1); x++) {
+            for (int d = 0; d < 4; d++) {
+                int endX = x + (size - 1) * dx[d];
+                int endY = y + (size - 1) * dy[d];
+                uint64_t* mask = list->masks + (size_t)list->count * words;
+
+                if (size > 0 && (endX < 1 || endX > width || endY < 1 ||
+                        endY > height)) {
+                    continue;
+                }
+                for (int i = 0; i < size; i++) {
+                    int bit = (y - 1 + i * dy[d]) * width + x - 1 + i * dx[d];
+
+                    mask[bit / 64] |= (uint64_t)1 << (bit % 64);
+                }
+                list->places[list->count].x = x;
+                list->places[list->count].y = y;
+                list->places[list->count].dir = dirs[d];
+                list->count++;
+            }
+        }
+    }
+    return 0;
+}
+
+/* Sets up drawing layouts for the rules of a game, listing the placements
+ * of each ship size once.
+ *
+ * @param (const struct naval_game* game) (game with its rules loaded)
+ * @param (unsigned long long seed) (seed of the layouts drawn)
+ * @param (int uniform) (1 to draw every layout equally often)
+ *
+ * @return (struct naval_generator*) (the generator, NULL if out of memory
+ *         or the board is larger than MAX)
+ */
+struct naval_generator* naval_generator_create(const struct naval_game* game,
+        unsigned long long seed, int uniform)
+{
+    struct naval_generator* generator;
+    int most = 0;
+
+    if (game->width > MAX || game->height > MAX) {
+        return NULL;
+    }
+    STATS_ALLOC(1);
+    if ((generator = calloc(1, sizeof(struct naval_generator))) == NULL) {
+        return NULL;
+    }
+    generator->numShips = game->numShips;
+    generator->uniform = uniform;
+    generator->words = (game->width * game->height + 63) / 64;
+    // splitmix64 spreads any seed, 0 included, over a nonzero state
+    seed += 0x9e3779b97f4a7c15ULL;
+    seed = (seed ^ (seed >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    seed = (seed ^ (seed >> 27)) * 0x94d049bb133111ebULL;
+    generator->seed = (seed ^ (seed >> 31)) | 1;
+
+    for (int ship = 0; ship < game->numShips; ship++) {
+        int size = game->shipSizes[ship];
+        int s = 0;
+
+        while (s < generator->sizes &&
+                generator->placements[s].size != size) {
+            s++;
+        }
+        if (s == generator->sizes) {
+            generator->placements[s].size = size;
+            generator->sizes++;
+            if (list_placements(&generator->placements[s], game->width,
+                    game->height, generator->words)) {
+                naval_generator_destroy(generator);
+                return NULL;
+            }
+            if (generator->placements[s].count > most) {
+                most = generator->placements[s].count;
+            }
+        }
+        generator->shipPlacements[ship] = s;
+    }
+    STATS_ALLOC(1);
+    if ((generator->free = malloc((most + 1) * sizeof(int))) == NULL) {
+        naval_generator_destroy(generator);
+        return NULL;
+    }
+    return generator;
+}
+
+void naval_generator_destroy(struct naval_generator* generator)
+{
+    if (generator != NULL) {
+        for (int s = 0; s < generator->sizes; s++) {
+            free(generator->placements[s].places);
+            free(generator->placements[s].masks);
+        }
+        free(generator->free);
+    }
+    free(generator);
+}
+
+/* Tests a placement's mask against the positions taken so far.
+ *
+ * @param (const uint64_t* taken) (positions taken)
+ * @param (const uint64_t* mask) (positions of the placement)
+ * @param (int words) (words of each mask)
+ *
+ * @return (int) (1 if they share a position, 0 otherwise)
+ */
+static inline int overlaps(const uint64_t* taken, const uint64_t* mask,
+        int words)
+{
+    uint64_t shared = 0;
+
+    for (int w = 0; w < words; w++) {
+        shared |= taken[w] & mask[w];
+    }
+    return shared != 0;
+}
+
+/* Draws one ship uniformly among the placements of its size left free:
+ * drawing from all of them until one is free, or after GENERATE_REJECTS
+ * misses listing the free ones and drawing from those, which on a crowded
+ * board gives the same odds for less work.
+ *
+ * @param (struct naval_generator* generator) (generator drawing the layout)
+ * @param (const struct placements* list) (placements of the ship's size)
+ * @param (const uint64_t* taken) (positions taken by the ships so far)
+ * @param (int words) (words of each mask)
+ *
+ * @return (int) (index of the placement, -1 if none is free)
+ */
+static inline __attribute__((always_inline)) int draw_free(
+        struct naval_generator* generator, const struct placements* list,
+        const uint64_t* taken, int words)
+{
+    int count = 0;
+
+    for (int tries = 0; tries < GENERATE_REJECTS; tries++) {
+        int pick = next_below(&generator->seed, list->count);
+
+        if (!overlaps(taken, list->masks + (size_t)pick * words, words)) {
+            return pick;
+        }
+    }
+    for (int p = 0; p < list->count; p++) {
+        if (!overlaps(taken, list->masks + (size_t)p * words, words)) {
+            generator->free[count++] = p;
+        }
+    }
+    return count ? generator->free[next_below(&generator->seed, count)] : -1;
+}
+
+/* Draws a layout as naval_generate does, for masks of a given number of
+ * words. Inlined with a constant count, the mask loops are unrolled.
+ *
+ * @param (struct naval_generator* generator) (generator drawing the layout)
+ * @param (struct naval_placement* placements) (set to one placement per
+ *        ship)
+ * @param (int words) (words of each mask)
+ *
+ * @return (int) (0 on success, -1 if no layout was found in
+ *         GENERATE_RESTARTS tries)
+ */
+static inline __attribute__((always_inline)) int draw_layout(
+        struct naval_generator* generator, struct naval_placement* placements,
+        int words)
+{
+    for (int restart = 0; restart < GENERATE_RESTARTS; restart++) {
+        uint64_t taken[GENERATE_WORDS];
+        int ship;
+
+        memset(taken, 0, words * sizeof(uint64_t));
+        for (ship = 0; ship < generator->numShips; ship++) {
+            const struct placements* list =
+                    &generator->placements[generator->shipPlacements[ship]];
+            const uint64_t* mask;
+            int pick;
+
+            if (list->count == 0) {
+                return -1;
+            }
+            if (generator->uniform) {
+                pick = next_below(&generator->seed, list->count);
+                if (overlaps(taken, list->masks + (size_t)pick * words,
+                        words)) {
+                    break;
+                }
+            } else if ((pick = draw_free(generator, list, taken, words)) < 0) {
+                break;
+            }
+            mask = list->masks + (size_t)pick * words;
+            for (int w = 0; w < words; w++) {
+                taken[w] |= mask[w];
+            }
+            placements[ship] = list->places[pick];
+        }
+        if (ship == generator->numShips) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* Draws the next layout: one placement per ship of the rules, in order.
+ * Uniform generators draw every ship from all of its placements and start
+ * the layout over at the first overlap, so every legal layout is equally
+ * likely. Otherwise each ship is drawn among the placements the ships
+ * before it left free, which never starts over unless a ship has none.
+ * Boards of up to 128 positions get loops of their own mask size.
+ *
+ * @param (struct naval_generator* generator) (generator drawing the layout)
+ * @param (struct naval_placement* placements) (set to one placement per
+ *        ship)
+ *
+ * @return (int) (0 on success, -1 if no layout was found in
+ *         GENERATE_RESTARTS tries)
+ */
+int naval_generate(struct naval_generator* generator,
+        struct naval_placement* placements)
+{
+    switch (generator->words) {
+        case 1:
+            return draw_layout(generator, placements, 1);
+        case 2:
+            return draw_layout(generator, placements, 2);
+        default:
+            return draw_layout(generator, placements, generator->words);
+    }
+}
@@ -0,0 +1,217 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "naval.h"
+#include "commands.h"
+
+#define GENMAP_MAGIC "NAVALMAP"
+#define GENMAP_VERSION 1
+
+/* Start of a binary stream of maps, in host byte order: the rules, then
+ * every map as numShips placements of three bytes, x, y and the direction
+ * letter, in the order of the rules.
+ */
+struct genmap_header {
+    char magic[8];
+    uint32_t version;
+    int32_t width;
+    int32_t height;
+    int32_t numShips;
+    int32_t shipSizes[MAX_SHIPS];
+};
+
+/* Appends the lines of a map to a buffer, one ship per line as read_map
+ * reads them.
+ *
+ * @param (char* buffer) (end of the text so far)
+ * @param (const struct naval_placement* placements) (placement of each ship)
+ * @param (int numShips) (ships of the rules)
+ *
+ * @return (char*) (end of the text)
+ */
+static char* map_text(char* buffer, const struct naval_placement* placements,
+        int numShips)
+{
+    for (int ship = 0; ship < numShips; ship++) {
+        buffer += naval_move_name(placements[ship].x, placements[ship].y,
+                buffer);
+        *buffer++ = ' ';
+        *buffer++ = placements[ship].dir;
+        *buffer++ = '\n';
+    }
+    return buffer;
+}
+
+/* Writes a map to its own file in a directory, numbered from 1 with enough
+ * digits for the last.
+ *
+ * @param (const char* directory) (directory of the maps)
+ * @param (long map) (number of the map)
+ * @param (int digits) (digits of the numbers)
+ * @param (const char* text) (lines of the map)
+ * @param (size_t length) (length of the text)
+ *
+ * @return (int) (0 on success, -1 if it could not be written)
+ */
+static int write_map(const char* directory, long map, int digits,
+        const char* text, size_t length)
+{
+    char path[MANIFEST_LINE_MAX];
+    FILE* file;
+    int error;
+
+    if (snprintf(path, sizeof(path), "%s/%0*ld", directory, digits, map) >=
+            (int)sizeof(path) || (file = fopen(path, "w")) == NULL) {
+        return -1;
+    }
+    error = fwrite(text, 1, length, file) != length;
+    return (fclose(file) != 0 || error) ? -1 : 0;
+}
+
+/* Draws random legal maps for a rules file and writes them out: as text on
+ * stdout with a blank line after each map, one file per map in a directory
+ * with --dir, or with --binary as one binary stream on stdout. How many
+ * were drawn, and how fast, goes to stderr.
+ *
+ * @param (int argc) (number of arguments after genmap)
+ * @param (char* argv[]) (arguments after genmap: --seed N, --uniform,
+ *        --binary or --dir DIR, then the rules and the number of maps)
+ *
+ * @return (int) (exit code of the naval process)
+ */
+int run_genmap(int argc, char* argv[])
+{
+    unsigned long long seed = GENMAP_SEED_DEFAULT;
+    const char* directory = NULL;
+    int uniform = 0;
+    int binary = 0;
+    int first = 0;
+    struct naval_placement placements[MAX_SHIPS];
+    struct naval_generator* generator;
+    struct naval_game* game;
+    struct timespec start, end;
+    FILE* rules;
+    char* buffer;
+    size_t length = 0;
+    size_t capacity;
+    long count, map = 0;
+    int numShips;
+    int digits = 1;
+    int error;
+
+    while (first < argc && strncmp(argv[first], "--", 2) == 0) {
+        if (strcmp(argv[first], "--seed") == 0 && first + 1 < argc) {
+            seed = strtoull(argv[first + 1], NULL, 0);
+            first += 2;
+        } else if (strcmp(argv[first], "--dir") == 0 && first + 1 < argc) {
+            directory = argv[first + 1];
+            first += 2;
+        } else if (strcmp(argv[first], "--uniform") == 0) {
+            uniform = 1;
+            first++;
+        } else if (strcmp(argv[first], "--binary") == 0) {
+            binary = 1;
+            first++;
+        } else {
+            return E_NOT_ENOUGH_PARAMETERS;
+        }
+    }
+    if (argc - first != 2 || (count = atol(argv[first + 1])) < 0 ||
+            (binary && directory != NULL)) {
+        return E_NOT_ENOUGH_PARAMETERS;
+    }
+    if ((rules = fopen(argv[first], "r")) == NULL) {
+        return E_RULES_MISSING;
+    }
+    if ((game = naval_create()) == NULL) {
+        fclose(rules);
+        return E_GENMAP;
+    }
+    error = naval_load_rules(game, rules);
+    fclose(rules);
+    if (error) {
+        naval_destroy(game);
+        return error;
+    }
+    numShips = naval_ships(game);
+    generator = naval_generator_create(game, seed, uniform);
+    // a buffer of maps is written at a time, or one map to each file
+    capacity = (size_t)numShips * (NAVAL_MOVE_MAX + 3) + 1;
+    capacity *= (directory != NULL) ? 1 : BUFSIZ;
+    buffer = malloc(capacity);
+    if (generator == NULL || buffer == NULL || (directory != NULL &&
+            mkdir(directory, 0777) != 0 && errno != EEXIST)) {
+        error = E_GENMAP;
+    }
+    for (long last = count; last >= 10; last /= 10) {
+        digits++;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (!error && binary) {
+        struct genmap_header header;
+
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, GENMAP_MAGIC, sizeof(header.magic));
+        header.version = GENMAP_VERSION;
+        header.width = naval_width(game);
+        header.height = naval_height(game);
+        header.numShips = numShips;
+        for (int ship = 0; ship < numShips; ship++) {
+            header.shipSizes[ship] = naval_ship_size(game, ship + 1);
+        }
+        error = (fwrite(&header, sizeof(header), 1, stdout) != 1) ?
+                E_GENMAP : 0;
+    }
+    for (; !error && map < count; map++) {
+        if (naval_generate(generator, placements)) {
+            error = E_GENMAP;
+            break;
+        }
+        if (binary) {
+            for (int ship = 0; ship < numShips; ship++) {
+                buffer[length++] = placements[ship].x;
+                buffer[length++] = placements[ship].y;
+                buffer[length++] = placements[ship].dir;
+            }
+        } else {
+            length = map_text(buffer + length, placements, numShips) -
+                    buffer;
+            if (directory == NULL) {
+                buffer[length++] = '\n';
+            } else if (write_map(directory, map + 1, digits, buffer,
+                    length)) {
+                error = E_GENMAP;
+            }
+        }
+        if (directory != NULL || capacity - length < capacity / BUFSIZ) {
+            if (directory == NULL && fwrite(buffer, 1, length, stdout) !=
+                    length) {
+                error = E_GENMAP;
+            }
+            length = 0;
+        }
+    }
+    if (!error && (fwrite(buffer, 1, length, stdout) != length ||
+            fflush(stdout) != 0)) {
+        error = E_GENMAP;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (!error) {
+        double seconds = (end.tv_sec - start.tv_sec) +
+                (end.tv_nsec - start.tv_nsec) / 1e9;
+
+        fprintf(stderr, "%ld maps in %.3f s, %.0f maps/sec\n", map, seconds,
+                (seconds > 0) ? map / seconds : 0);
+    }
+    free(buffer);
+    naval_generator_destroy(generator);
+    naval_destroy(game);
+    return error;
+}
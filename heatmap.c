@@ -0,0 +1,70 @@
+#include <stdio.h>
+#include <unistd.h>
+
+#include "naval.h"
+#include "commands.h"
+
+/* Replays the cpu turns at the player's board and prints the chance, in
+ * percent, that each position not yet shot at holds a ship, going by the
+ * outcomes of the shots as the cpu was told them. Hits are shown as * and
+ * misses as / as on the cpu's view of a board.
+ *
+ * @param (struct naval_game* game) (game with rules and maps loaded)
+ * @param (struct naval_turns* turns) (decoded cpu turns)
+ * @param (const struct options* options) (settings of the game)
+ *
+ * @return (int) (exit code of the naval process)
+ */
+int show_heatmap(struct naval_game* game, struct naval_turns* turns,
+        const struct options* options)
+{
+    const struct naval_turn* move;
+    struct naval_shot shots[MAX * MAX];
+    double heat[MAX + 2][MAX + 2];
+    double ways;
+    int threads = options->threads;
+    int count = 0;
+
+    while (!naval_winner(game) && (move = naval_turns_next(turns)) != NULL) {
+        int shot;
+
+        if (move->kind != SHOT_MISS) {
+            continue;
+        }
+        shot = naval_fire(game, CPU, move->x, move->y);
+        // a board larger than MAX is turned down by naval_heatmap
+        if (shot != SHOT_REPEATED && count < MAX * MAX) {
+            shots[count].x = move->x;
+            shots[count].y = move->y;
+            shots[count++].outcome = shot;
+        }
+    }
+    if (threads < 1) {
+        threads = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (naval_heatmap(game, shots, count, threads, heat, &ways)) {
+        return E_HEATMAP;
+    }
+
+    printf("%.0f placements\n  ", ways);
+    for (int j = 1; j < (naval_width(game) + 1); j++) {
+        printf("%4c", 'A' + j - 1);
+    }
+    printf("\n");
+    for (int i = 1; i < (naval_height(game) + 1); i++) {
+        printf("%2d", i);
+        for (int j = 1; j < (naval_width(game) + 1); j++) {
+            int cell = naval_cell(game, PLAYER, j, i);
+
+            if (cell == HIT) {
+                printf("   *");
+            } else if (cell == MISS) {
+                printf("   /");
+            } else {
+                printf("%4.0f", 100 * heat[i][j]);
+            }
+        }
+        printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,397 @@
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "game.h"
+
+#define JOURNAL_MAGIC "NAVALJNL"
+#define JOURNAL_VERSION 1
+// Bytes of one shot: side and outcome, then x and y
+#define JOURNAL_SHOT 3
+
+/* Start of a journal, in host byte order: the rules and both boards as
+ * placed, like a scenario. Shots follow, with a snapshot after every
+ * interval of them, so the record of any move is at a known offset.
+ */
+struct journal_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t interval;
+    int32_t width;
+    int32_t height;
+    int32_t numShips;
+    int32_t shipSizes[MAX_SHIPS];
+    int8_t ships[2][MAX + 2][MAX + 2];
+};
+
+/* Every position shot at on the cpu's board (by the player) and on the
+ * player's board (by the cpu) once moves shots have been fired.
+ */
+struct journal_snapshot {
+    uint32_t moves;
+    uint32_t unused;
+    struct bitboard shots[2];
+};
+
+// Journal being written as a game is played
+struct naval_journal {
+    FILE* file;
+    int interval;
+    int moves;
+    int error;
+    struct journal_snapshot snapshot;
+};
+
+/* Returns the bytes of one interval of shots and the snapshot after them.
+ *
+ * @param (int interval) (shots between snapshots)
+ */
+static size_t block_size(int interval)
+{
+    return (size_t)interval * JOURNAL_SHOT + sizeof(struct journal_snapshot);
+}
+
+/* Starts writing a journal of the game to a file, with the rules and the
+ * boards as placed, recording every shot naval_fire resolves from then on.
+ *
+ * @param (struct naval_game* game) (game with its maps loaded and no shot
+ *        fired yet)
+ * @param (FILE* file) (file opened for writing)
+ * @param (int interval) (shots between snapshots, at least 1)
+ *
+ * @return (int) (0 on success, -1 if it could not be written)
+ */
+int naval_journal_open(struct naval_game* game, FILE* file, int interval)
+{
+    struct journal_header header;
+    struct naval_journal* journal;
+
+    if (interval < 1 || game->journal != NULL || game->width > MAX ||
+            game->height > MAX) {
+        return -1;
+    }
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, JOURNAL_MAGIC, sizeof(header.magic));
+    header.version = JOURNAL_VERSION;
+    header.interval = interval;
+    header.width = game->width;
+    header.height = game->height;
+    header.numShips = game->numShips;
+    for (int i = 0; i < game->numShips; i++) {
+        header.shipSizes[i] = game->shipSizes[i];
+    }
+    for (int i = 1; i < (game->height + 1); i++) {
+        for (int j = 1; j < (game->width + 1); j++) {
+            header.ships[0][i][j] = naval_cell(game, PLAYER, j, i);
+            header.ships[1][i][j] = naval_cell(game, CPU, j, i);
+        }
+    }
+    if (fwrite(&header, sizeof(header), 1, file) != 1) {
+        return -1;
+    }
+
+    STATS_ALLOC(1);
+    if ((journal = calloc(1, sizeof(struct naval_journal))) == NULL) {
+        return -1;
+    }
+    journal->file = file;
+    journal->interval = interval;
+    game->journal = journal;
+    return 0;
+}
+
+/* Records a shot fired for player, with a snapshot at the end of every
+ * interval.
+ *
+ * @param (struct naval_journal* journal) (journal of the game)
+ * @param (int player) (PLAYER or CPU, the side that fired)
+ * @param (int x) (x coordinate of the shot)
+ * @param (int y) (y coordinate of the shot)
+ * @param (int shot) (SHOT_MISS, SHOT_HIT or SHOT_SUNK)
+ */
+void journal_shot(struct naval_journal* journal, int player, int x, int y,
+        int shot)
+{
+    unsigned char record[JOURNAL_SHOT] = {player | shot << 2, x, y};
+
+    if (fwrite(record, sizeof(record), 1, journal->file) != 1) {
+        journal->error = -1;
+    }
+    bitboard_set(&journal->snapshot.shots[player - 1], x, y);
+    if (++journal->moves % journal->interval == 0) {
+        journal->snapshot.moves = journal->moves;
+        if (fwrite(&journal->snapshot, sizeof(journal->snapshot), 1,
+                journal->file) != 1) {
+            journal->error = -1;
+        }
+    }
+}
+
+/* Stops the journal of a game and flushes its file, which is left open.
+ *
+ * @param (struct naval_game* game) (game being journaled)
+ *
+ * @return (int) (0 if every shot was written, -1 otherwise)
+ */
+int naval_journal_close(struct naval_game* game)
+{
+    struct naval_journal* journal = game->journal;
+    int error;
+
+    if (journal == NULL) {
+        return 0;
+    }
+    error = (fflush(journal->file) != 0) ? -1 : journal->error;
+    free(journal);
+    game->journal = NULL;
+    return error;
+}
+
+/* Maps a journal and checks it was written by this version. A journal cut
+ * short, by a crash say, is kept up to its last whole shot.
+ *
+ * @param (struct naval_replay* replay) (set to the mapped journal)
+ * @param (const char* path) (filename of the journal)
+ *
+ * @return (int) (0 on success, E_JOURNAL otherwise)
+ */
+int naval_replay_open(struct naval_replay* replay, const char* path)
+{
+    struct journal_header header;
+    struct stat info;
+    size_t body, block, rest;
+    void* map;
+    int fd;
+
+    memset(replay, 0, sizeof(*replay));
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        return E_JOURNAL;
+    }
+    if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(header)) {
+        close(fd);
+        return E_JOURNAL;
+    }
+    map = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return E_JOURNAL;
+    }
+    replay->data = map;
+    replay->length = info.st_size;
+
+    memcpy(&header, map, sizeof(header));
+    if (memcmp(header.magic, JOURNAL_MAGIC, sizeof(header.magic)) ||
+            header.version != JOURNAL_VERSION || header.interval < 1 ||
+            header.interval > MAX * MAX * 2 ||
+            header.width < 0 || header.width > MAX ||
+            header.height < 0 || header.height > MAX ||
+            header.numShips < 0 || header.numShips > MAX_SHIPS) {
+        naval_replay_close(replay);
+        return E_JOURNAL;
+    }
+    replay->interval = header.interval;
+    body = replay->length - sizeof(header);
+    block = block_size(replay->interval);
+    rest = body % block / JOURNAL_SHOT;
+    replay->moves = body / block * replay->interval +
+            ((rest < (size_t)replay->interval) ? rest : replay->interval);
+    return 0;
+}
+
+/* Unmaps a journal opened with naval_replay_open.
+ *
+ * @param (struct naval_replay* replay) (journal to be closed)
+ */
+void naval_replay_close(struct naval_replay* replay)
+{
+    if (replay->data != NULL) {
+        munmap((void*)replay->data, replay->length);
+    }
+    memset(replay, 0, sizeof(*replay));
+}
+
+/* Reads the shot of a move.
+ *
+ * @param (const struct naval_replay* replay) (open journal)
+ * @param (int move) (move from 1 to replay->moves)
+ * @param (int* player) (set to PLAYER or CPU, the side that fired)
+ * @param (int* x) (set to the x coordinate of the shot)
+ * @param (int* y) (set to the y coordinate of the shot)
+ *
+ * @return (int) (the outcome recorded, one of enum Shots)
+ */
+int naval_replay_shot(const struct naval_replay* replay, int move,
+        int* player, int* x, int* y)
+{
+    const unsigned char* record = replay->data +
+            sizeof(struct journal_header) +
+            (size_t)((move - 1) / replay->interval) *
+            block_size(replay->interval) +
+            (size_t)((move - 1) % replay->interval) * JOURNAL_SHOT;
+
+    *player = record[0] & 3;
+    *x = record[1];
+    *y = record[2];
+    return record[0] >> 2;
+}
+
+/* Returns the snapshot taken after a whole number of intervals.
+ *
+ * @param (const struct naval_replay* replay) (open journal)
+ * @param (int index) (snapshot from 1, taken after index intervals)
+ *
+ * @return (struct journal_snapshot) (the snapshot as written)
+ */
+static struct journal_snapshot read_snapshot(
+        const struct naval_replay* replay, int index)
+{
+    struct journal_snapshot snapshot;
+
+    memcpy(&snapshot, replay->data + sizeof(struct journal_header) +
+            (size_t)index * block_size(replay->interval) - sizeof(snapshot),
+            sizeof(snapshot));
+    return snapshot;
+}
+
+/* Fires the shots of the snapshot at a game set up as placed. Shots only
+ * count off the positions hit, so their order does not matter.
+ *
+ * @param (struct naval_game* game) (game with no shot fired)
+ * @param (const struct journal_snapshot* snapshot) (shots to be fired)
+ *
+ * @return (int) (0 on success, E_JOURNAL if a shot is off the board)
+ */
+static int restore_shots(struct naval_game* game,
+        const struct journal_snapshot* snapshot)
+{
+    for (int side = 0; side < 2; side++) {
+        for (int i = 0; i < BITBOARD_BITS; i++) {
+            int x = i % BITBOARD_STRIDE;
+            int y = i / BITBOARD_STRIDE;
+
+            if (!bitboard_test(&snapshot->shots[side], x, y)) {
+                continue;
+            }
+            if (!check_bad_guess(x, y, game->width, game->height)) {
+                return E_JOURNAL;
+            }
+            check_hit(game, side + 1, x, y);
+        }
+    }
+    return 0;
+}
+
+/* Sets up game as it stood after a move: from the nearest snapshot taken
+ * before it, then firing the shots since. Each shot fired is checked
+ * against the outcome recorded, so a journal that does not agree with its
+ * own boards is caught, and the shot of move itself is always among them.
+ * game must have been created with naval_create.
+ *
+ * @param (const struct naval_replay* replay) (open journal)
+ * @param (struct naval_game* game) (game to be set up)
+ * @param (int move) (move from 0, before any shot, to replay->moves)
+ *
+ * @return (int) (0 on success, E_JOURNAL otherwise)
+ */
+int naval_replay_seek(const struct naval_replay* replay,
+        struct naval_game* game, int move)
+{
+    struct journal_header header;
+    struct journal_snapshot snapshot;
+    int index;
+
+    if (move < 0 || move > replay->moves) {
+        return E_JOURNAL;
+    }
+    memcpy(&header, replay->data, sizeof(header));
+    game->numShips = header.numShips;
+    for (int i = 0; i < header.numShips; i++) {
+        game->shipSizes[i] = header.shipSizes[i];
+    }
+    if (size_boards(game, header.width, header.height)) {
+        return E_JOURNAL;
+    }
+    restore_board(game, PLAYER, &header.ships[0][0][0]);
+    restore_board(game, CPU, &header.ships[1][0][0]);
+
+    // the last shot is always fired again, so its record is checked too
+    index = (move > 0) ? (move - 1) / replay->interval : 0;
+    // the snapshot after the last shot of a journal cut short may be lost
+    if (index > 0 && replay->length < sizeof(header) +
+            (size_t)index * block_size(replay->interval)) {
+        index--;
+    }
+    if (index > 0) {
+        snapshot = read_snapshot(replay, index);
+        if (snapshot.moves != (uint32_t)index * replay->interval ||
+                restore_shots(game, &snapshot)) {
+            return E_JOURNAL;
+        }
+    }
+    for (int i = index * replay->interval + 1; i <= move; i++) {
+        int player, x, y;
+        int shot = naval_replay_shot(replay, i, &player, &x, &y);
+
+        if ((player != PLAYER && player != CPU) ||
+                naval_fire(game, player, x, y) != shot) {
+            return E_JOURNAL;
+        }
+    }
+    return 0;
+}
+
+/* Replays every shot of a journal from the boards as placed, checking each
+ * outcome and every snapshot, and counts up the game as naval_play does.
+ *
+ * @param (const struct naval_replay* replay) (open journal)
+ * @param (struct naval_game* game) (game to be played on)
+ * @param (struct naval_result* result) (filled in with the outcome)
+ *
+ * @return (int) (0 on success, E_JOURNAL otherwise)
+ */
+int naval_replay_check(const struct naval_replay* replay,
+        struct naval_game* game, struct naval_result* result)
+{
+    struct journal_snapshot shots;
+
+    memset(result, 0, sizeof(*result));
+    memset(&shots, 0, sizeof(shots));
+    if (naval_replay_seek(replay, game, 0)) {
+        return result->error = E_JOURNAL;
+    }
+    for (int i = 1; i <= replay->moves; i++) {
+        int player, x, y;
+        int shot = naval_replay_shot(replay, i, &player, &x, &y);
+
+        if ((player != PLAYER && player != CPU) ||
+                naval_fire(game, player, x, y) != shot) {
+            return result->error = E_JOURNAL;
+        }
+        bitboard_set(&shots.shots[player - 1], x, y);
+        if (player == PLAYER) {
+            result->playerShots++;
+            result->playerSunk += (shot == SHOT_SUNK);
+        } else {
+            result->cpuShots++;
+            result->cpuSunk += (shot == SHOT_SUNK);
+        }
+        if (i % replay->interval == 0 && replay->length >=
+                sizeof(struct journal_header) +
+                (size_t)(i / replay->interval) *
+                block_size(replay->interval)) {
+            struct journal_snapshot snapshot = read_snapshot(replay,
+                    i / replay->interval);
+
+            if (snapshot.moves != (uint32_t)i ||
+                    memcmp(snapshot.shots, shots.shots, sizeof(shots.shots))) {
+                return result->error = E_JOURNAL;
+            }
+        }
+    }
+    result->winner = check_win(game);
+    return 0;
+}
@@ -0,0 +1,154 @@
+#include <string.h>
+
+#include "game.h"
+
+/* The board loops below are written once as inline templates taking the
+ * dimensions, then compiled again for each common size with constant
+ * bounds, so the compiler can unroll and vectorise every row. Only the
+ * array engine's boards are drawn here; other engines and sizes keep the
+ * generic loops.
+ */
+
+// Column letters of a board header, the first width of them used
+static const char columns[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
+/* Sets every position of the board to NONE.
+ *
+ * @param (struct board* board) (board to be cleared)
+ * @param (int width) (width of the board)
+ * @param (int height) (height of the board)
+ */
+static inline __attribute__((always_inline)) void clear_cells(
+        struct board* board, int width, int height)
+{
+    memset(&board->bits, 0, sizeof(board->bits));
+    memset(board->remaining, 0, sizeof(board->remaining));
+    board->afloat = 0;
+    memset(board->cells, NONE, (width + 2) * (height + 2));
+}
+
+/* Appends the header and the number of a row, as display_cpu_board and
+ * display_player_board do.
+ *
+ * @param (char* frame) (end of the frame so far)
+ * @param (int row) (row number, from 1)
+ *
+ * @return (char*) (end of the frame)
+ */
+static inline __attribute__((always_inline)) char* row_label(char* frame,
+        int row)
+{
+    *frame++ = (row < 10) ? ' ' : '0' + row / 10;
+    *frame++ = '0' + row % 10;
+    *frame++ = ' ';
+    return frame;
+}
+
+/* Appends the cpu board as display_cpu_board does, reading the array
+ * engine's cells directly.
+ *
+ * @param (char* frame) (end of the frame so far)
+ * @param (const struct board* board) (the cpu's board)
+ * @param (int width) (width of the board)
+ * @param (int height) (height of the board)
+ *
+ * @return (char*) (end of the frame)
+ */
+static inline __attribute__((always_inline)) char* cpu_rows(
+        char* restrict frame, const struct board* restrict board, int width,
+        int height)
+{
+    memcpy(frame, "   ", 3);
+    memcpy(frame + 3, columns, width);
+    frame[3 + width] = '\n';
+    frame += 4 + width;
+    for (int i = 1; i < height + 1; i++) {
+        const int8_t* restrict row = board->cells + i * (width + 2) + 1;
+
+        frame = row_label(frame, i);
+        for (int j = 0; j < width; j++) {
+            int value = row[j];
+
+            frame[j] = (value == HIT) ? '*' : (value == MISS) ? '/' : '.';
+        }
+        frame[width] = '\n';
+        frame += width + 1;
+    }
+    return frame;
+}
+
+/* Appends the === separator and the player board as display_player_board
+ * does, reading the array engine's cells directly.
+ *
+ * @param all the same as cpu_rows function, for the player's board
+ */
+static inline __attribute__((always_inline)) char* player_rows(
+        char* restrict frame, const struct board* restrict board, int width,
+        int height)
+{
+    memcpy(frame, "===\n   ", 7);
+    memcpy(frame + 7, columns, width);
+    frame[7 + width] = '\n';
+    frame += 8 + width;
+    for (int i = 1; i < height + 1; i++) {
+        const int8_t* restrict row = board->cells + i * (width + 2) + 1;
+
+        frame = row_label(frame, i);
+        for (int j = 0; j < width; j++) {
+            int value = row[j];
+
+            frame[j] = (value == HIT) ? '*' : (value <= NONE) ? '.' :
+                    (value > 9) ? value + 55 : value + '0';
+        }
+        frame[width] = '\n';
+        frame += width + 1;
+    }
+    return frame;
+}
+
+// Defines the kernels of one board size and their entry in the table
+#define SIZE_KERNELS(width, height) \
+    static void clear_##width##x##height(struct board* board) \
+    { \
+        clear_cells(board, width, height); \
+    } \
+    static char* cpu_##width##x##height(char* frame, \
+            const struct naval_game* game) \
+    { \
+        return cpu_rows(frame, &game->cpuBoard, width, height); \
+    } \
+    static char* player_##width##x##height(char* frame, \
+            const struct naval_game* game) \
+    { \
+        return player_rows(frame, &game->playerBoard, width, height); \
+    }
+
+#define SIZE_ENTRY(width, height) {width, height, clear_##width##x##height, \
+        cpu_##width##x##height, player_##width##x##height}
+
+SIZE_KERNELS(8, 8)
+SIZE_KERNELS(10, 10)
+SIZE_KERNELS(26, 26)
+
+static const struct kernels sizes[] = {
+    SIZE_ENTRY(8, 8),
+    SIZE_ENTRY(10, 10),
+    SIZE_ENTRY(26, 26)
+};
+
+/* Returns the kernels compiled for a board size.
+ *
+ * @param (int width) (width of the board)
+ * @param (int height) (height of the board)
+ *
+ * @return (const struct kernels*) (the kernels, NULL for a size with none)
+ */
+const struct kernels* find_kernels(int width, int height)
+{
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        if (sizes[i].width == width && sizes[i].height == height) {
+            return &sizes[i];
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,494 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "game.h"
+
+// Shots the search chooses between, the best the density ranks first
+#define MCTS_CANDIDATES 4
+// Most threads one search plays out on
+#define MCTS_MAX_THREADS 64
+
+/* Work of one search thread. Every thread plays out the same candidate
+ * shots on layouts of its own, the root parallel form of Monte Carlo tree
+ * search, and their shots are added up once the time is over.
+ */
+struct search {
+    const struct naval_ai* ai;
+    int candidates;
+    int cx[MCTS_CANDIDATES];
+    int cy[MCTS_CANDIDATES];
+    double shots[MCTS_CANDIDATES];
+    long playouts;
+    uint64_t seed;
+    struct timespec deadline;
+};
+
+/* Steps a xorshift generator and returns a number below limit.
+ *
+ * @param (uint64_t* seed) (state of the generator)
+ * @param (int limit) (one more than the largest number returned)
+ *
+ * @return (int) (number from 0 to limit - 1)
+ */
+static int next_random(uint64_t* seed, int limit)
+{
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 7;
+    *seed ^= *seed << 17;
+    return (int) ((*seed >> 33) % limit);
+}
+
+/* Checks that a ship fits at a placement of a sampled layout: on the board,
+ * over positions unshot or hit and free, and not over hits alone, since a
+ * ship with every position hit would have been sunk.
+ *
+ * @param (const struct naval_ai* ai) (ai whose knowledge is sampled)
+ * @param (signed char owner[][MAX + 2]) (ship at each position so far)
+ * @param (int size) (length of the ship)
+ * @param (int dir) (0 for a row of positions, 1 for a column)
+ * @param (int x) (x coordinate of the first position)
+ * @param (int y) (y coordinate of the first position)
+ *
+ * @return (int) (1 if the ship fits, 0 otherwise)
+ */
+static int fits(const struct naval_ai* ai, signed char owner[][MAX + 2],
+        int size, int dir, int x, int y)
+{
+    int unshot = 0;
+
+    if (x < 1 || y < 1 || (dir ? y + size - 1 > ai->height :
+            x + size - 1 > ai->width)) {
+        return 0;
+    }
+    for (int i = 0; i < size; i++) {
+        int px = dir ? x : x + i;
+        int py = dir ? y + i : y;
+        int cell = ai->known[py][px];
+
+        if (owner[py][px] || (cell != CELL_UNKNOWN && cell != CELL_HIT)) {
+            return 0;
+        }
+        unshot += (cell == CELL_UNKNOWN);
+    }
+    return unshot > 0;
+}
+
+/* Marks the positions of a placement as held by ship.
+ *
+ * @param (signed char owner[][MAX + 2]) (ship at each position)
+ * @param (int ship) (number of the ship placed)
+ * @param (int size) (length of the ship)
+ * @param (int dir) (0 for a row of positions, 1 for a column)
+ * @param (int x) (x coordinate of the first position)
+ * @param (int y) (y coordinate of the first position)
+ */
+static void place(signed char owner[][MAX + 2], int ship, int size, int dir,
+        int x, int y)
+{
+    for (int i = 0; i < size; i++) {
+        owner[dir ? y + i : y][dir ? x : x + i] = ship;
+    }
+}
+
+/* Draws a hidden layout of the ships that agrees with everything the ai has
+ * worked out from its shots: ships of the classes still afloat covering
+ * every hit not put down to a sunk ship and keeping clear of the misses
+ * and sunk ships. Each hit not yet covered is given
+ * one of the placements through it, then the other ships one of the
+ * placements still free, all picked uniformly. Layouts with more choices
+ * along the way are drawn less often, so weight is set to the product of
+ * the choices, which evens the odds out when playouts are weighed by it.
+ *
+ * @param (const struct naval_ai* ai) (ai whose knowledge is sampled)
+ * @param (uint64_t* seed) (state of the random generator)
+ * @param (signed char owner[][MAX + 2]) (set to the ship at each position)
+ * @param (double* weight) (set to the weight of the layout)
+ *
+ * @return (int) (1 if a layout was drawn, 0 if the ships do not fit)
+ */
+static int sample_layout(const struct naval_ai* ai, uint64_t* seed,
+        signed char owner[][MAX + 2], double* weight)
+{
+    int afloat[MAX_SHIPS];
+    int taken[MAX_SHIPS];
+    int count = 0;
+    int placed = 0;
+
+    *weight = 1;
+    memset(taken, 0, sizeof(taken));
+    // ships of a class are alike, so the first ones stand for those afloat
+    for (int ship = 1; ship <= ai->numShips; ship++) {
+        int c = ai->shipClass[ship - 1];
+
+        if (c >= 0 && taken[c] < ai->afloat[c]) {
+            taken[c]++;
+            afloat[count++] = ship;
+        }
+    }
+    for (int i = 0; i < (ai->height + 2); i++) {
+        for (int j = 0; j < (ai->width + 2); j++) {
+            owner[i][j] = 0;
+        }
+    }
+
+    for (int i = 1; i < (ai->height + 1); i++) {
+        for (int j = 1; j < (ai->width + 1); j++) {
+            int option[MAX_SHIPS * 2 * MAX];
+            int options = 0;
+            int pick, k, dir, offset, ship, size;
+
+            if (ai->known[i][j] != CELL_HIT || owner[i][j]) {
+                continue;
+            }
+            // every unplaced ship in either direction with any offset
+            for (k = placed; k < count; k++) {
+                size = ai->sizes[ai->shipClass[afloat[k] - 1]];
+                for (dir = 0; dir < 1 + (size > 1); dir++) {
+                    for (offset = 0; offset < size; offset++) {
+                        if (fits(ai, owner, size, dir, dir ? j : j - offset,
+                                dir ? i - offset : i)) {
+                            option[options++] = (k * 2 + dir) * MAX + offset;
+                        }
+                    }
+                }
+            }
+            if (options == 0) {
+                return 0;
+            }
+            *weight *= options;
+            pick = option[next_random(seed, options)];
+            k = pick / MAX / 2;
+            dir = pick / MAX % 2;
+            offset = pick % MAX;
+            ship = afloat[k];
+            size = ai->sizes[ai->shipClass[ship - 1]];
+            place(owner, ship, size, dir, dir ? j : j - offset,
+                    dir ? i - offset : i);
+            afloat[k] = afloat[placed];
+            afloat[placed++] = ship;
+        }
+    }
+
+    for (; placed < count; placed++) {
+        int ship = afloat[placed];
+        int size = ai->sizes[ai->shipClass[ship - 1]];
+        int fitting = 0;
+        int pick = 0;
+
+        // count the free placements, then walk them again to the one picked
+        for (int pass = 0; pass < 2; pass++) {
+            int seen = 0;
+
+            for (int dir = 0; dir < 1 + (size > 1); dir++) {
+                for (int y = 1; y < (ai->height + 1); y++) {
+                    for (int x = 1; x < (ai->width + 1); x++) {
+                        if (!fits(ai, owner, size, dir, x, y)) {
+                            continue;
+                        }
+                        if (pass == 1 && seen == pick) {
+                            place(owner, ship, size, dir, x, y);
+                        }
+                        seen++;
+                    }
+                }
+            }
+            if (pass == 0) {
+                if ((fitting = seen) == 0) {
+                    return 0;
+                }
+                pick = next_random(seed, fitting);
+            }
+        }
+        *weight *= fitting;
+    }
+    return 1;
+}
+
+/* Plays a game out on a sampled layout until the next ship goes down,
+ * starting with the shot at x, y and then firing next to unsunk hits when
+ * there are any, carrying on lines of hits first, and at random positions
+ * otherwise. Cutting the game short there keeps the spread of the outcome
+ * small, so fewer playouts tell the candidate shots apart.
+ *
+ * @param (const struct naval_ai* ai) (ai whose knowledge the game starts
+ *        from)
+ * @param (signed char owner[][MAX + 2]) (sampled ship at each position)
+ * @param (int x) (x coordinate of the first shot)
+ * @param (int y) (y coordinate of the first shot)
+ * @param (uint64_t* seed) (state of the random generator)
+ *
+ * @return (int) (shots taken to sink a ship)
+ */
+static int playout(const struct naval_ai* ai, signed char owner[][MAX + 2],
+        int x, int y, uint64_t* seed)
+{
+    static const int dx[4] = {1, -1, 0, 0};
+    static const int dy[4] = {0, 0, 1, -1};
+    unsigned char shot[MAX + 2][MAX + 2];
+    unsigned char hit[MAX + 2][MAX + 2];
+    short index[MAX + 2][MAX + 2];
+    short open[MAX * MAX];
+    short pending[MAX * MAX];
+    short candidates[4 * MAX * MAX];
+    int left[MAX_SHIPS + 1] = {0};
+    int opened = 0;
+    int hits = 0;
+    int shots = 0;
+
+    for (int i = 0; i < (ai->height + 2); i++) {
+        for (int j = 0; j < (ai->width + 2); j++) {
+            int inside = i >= 1 && j >= 1 && i <= ai->height &&
+                    j <= ai->width;
+
+            shot[i][j] = !inside || ai->known[i][j] != CELL_UNKNOWN;
+            hit[i][j] = inside && ai->known[i][j] == CELL_HIT;
+            if (hit[i][j]) {
+                pending[hits++] = i * (MAX + 2) + j;
+            } else if (!shot[i][j]) {
+                index[i][j] = opened;
+                open[opened++] = i * (MAX + 2) + j;
+                left[(int) owner[i][j]]++;
+            }
+        }
+    }
+
+    while (1) {
+        int last = open[--opened];
+        int ship = owner[y][x];
+        int count = 0;
+        int lined = 0;
+        int pick;
+
+        // fire at x, y, moving the last open position into its place
+        shot[y][x] = 1;
+        index[last / (MAX + 2)][last % (MAX + 2)] = index[y][x];
+        open[index[y][x]] = last;
+        shots++;
+        if (ship > 0) {
+            if (--left[ship] == 0) {
+                return shots;
+            }
+            hit[y][x] = 1;
+            pending[hits++] = y * (MAX + 2) + x;
+        }
+
+        for (int k = 0; k < hits; k++) {
+            int hx = pending[k] % (MAX + 2);
+            int hy = pending[k] / (MAX + 2);
+
+            for (int d = 0; d < 4; d++) {
+                int next = (hy + dy[d]) * (MAX + 2) + hx + dx[d];
+
+                if (shot[hy + dy[d]][hx + dx[d]]) {
+                    continue;
+                }
+                // positions carrying on a line of hits go to the front
+                if (hit[hy - dy[d]][hx - dx[d]]) {
+                    candidates[count++] = candidates[lined];
+                    candidates[lined++] = next;
+                } else {
+                    candidates[count++] = next;
+                }
+            }
+        }
+        if (count > 0) {
+            pick = candidates[next_random(seed, lined ? lined : count)];
+        } else {
+            pick = open[next_random(seed, opened)];
+        }
+        x = pick % (MAX + 2);
+        y = pick / (MAX + 2);
+    }
+}
+
+/* Runs playouts until the deadline. Each layout drawn plays out every
+ * candidate from the same state of the random generator, so the candidates
+ * are compared on equal terms and the differences between them show after
+ * few layouts.
+ *
+ * @param (void* arg) (struct search of the thread)
+ *
+ * @return (void*) (NULL)
+ */
+static void* search(void* arg)
+{
+    struct search* work = arg;
+    signed char owner[MAX + 2][MAX + 2];
+    struct timespec now;
+    double weight;
+
+    do {
+        if (sample_layout(work->ai, &work->seed, owner, &weight)) {
+            for (int c = 0; c < work->candidates; c++) {
+                uint64_t seed = work->seed;
+
+                work->shots[c] += weight * playout(work->ai, owner,
+                        work->cx[c], work->cy[c], &seed);
+                work->playouts++;
+            }
+            next_random(&work->seed, 2);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    } while (now.tv_sec < work->deadline.tv_sec ||
+            (now.tv_sec == work->deadline.tv_sec &&
+            now.tv_nsec < work->deadline.tv_nsec));
+    return NULL;
+}
+
+/* Picks the shots worth searching: the unshot positions the density of the
+ * ai ranks highest, in the same order naval_ai_choose uses.
+ *
+ * @param (const struct naval_ai* ai) (ai choosing the shot)
+ * @param (struct search* work) (set up with the candidate shots)
+ */
+static void pick_candidates(const struct naval_ai* ai, struct search* work)
+{
+    long score[MCTS_CANDIDATES];
+    long target[MCTS_CANDIDATES];
+
+    work->candidates = 0;
+    for (int i = 1; i < (ai->height + 1); i++) {
+        for (int j = 1; j < (ai->width + 1); j++) {
+            long s = ai->total[i][j];
+            long t = ai->pending ? ai->targetTotal[i][j] : 0;
+            int c = work->candidates;
+
+            if (ai->known[i][j] != CELL_UNKNOWN) {
+                continue;
+            }
+            // insert in order, dropping the worst once the list is full
+            while (c > 0 && (t > target[c - 1] || (t == target[c - 1] &&
+                    s > score[c - 1]))) {
+                if (c < MCTS_CANDIDATES) {
+                    score[c] = score[c - 1];
+                    target[c] = target[c - 1];
+                    work->cx[c] = work->cx[c - 1];
+                    work->cy[c] = work->cy[c - 1];
+                }
+                c--;
+            }
+            if (c < MCTS_CANDIDATES) {
+                score[c] = s;
+                target[c] = t;
+                work->cx[c] = j;
+                work->cy[c] = i;
+                if (work->candidates < MCTS_CANDIDATES) {
+                    work->candidates++;
+                }
+            }
+        }
+    }
+    // while chasing a ship only the positions that may be part of it count
+    while (work->candidates > 1 && target[0] > 0 &&
+            target[work->candidates - 1] == 0) {
+        work->candidates--;
+    }
+}
+
+/* Searches for the shot that sinks the next ship in the fewest shots on
+ * average over layouts agreeing with what the ai has seen, playing out
+ * games on ai->threads threads, or every core, for ai->thinkMs
+ * milliseconds. Falls back on the density's pick if no playout finished.
+ *
+ * @param (struct naval_ai* ai) (ai choosing the shot)
+ * @param (int* x) (set to the x coordinate of the shot)
+ * @param (int* y) (set to the y coordinate of the shot)
+ *
+ * @return (int) (1 if a position was picked, 0 if every one was shot)
+ */
+int mcts_choose(struct naval_ai* ai, int* x, int* y)
+{
+    struct search work[MCTS_MAX_THREADS];
+    pthread_t ids[MCTS_MAX_THREADS];
+    struct timespec start, end;
+    int threads = ai->threads;
+    int started = 0;
+    double shots[MCTS_CANDIDATES] = {0};
+    int best = 0;
+
+    if (threads < 1) {
+        threads = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (threads < 1) {
+        threads = 1;
+    } else if (threads > MCTS_MAX_THREADS) {
+        threads = MCTS_MAX_THREADS;
+    }
+    pick_candidates(ai, &work[0]);
+    if (work[0].candidates == 0) {
+        return 0;
+    } else if (work[0].candidates == 1) {
+        *x = work[0].cx[0];
+        *y = work[0].cy[0];
+        return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    work[0].deadline = start;
+    work[0].deadline.tv_sec += ai->thinkMs / 1000;
+    work[0].deadline.tv_nsec += (ai->thinkMs % 1000) * 1000000L;
+    if (work[0].deadline.tv_nsec >= 1000000000L) {
+        work[0].deadline.tv_sec++;
+        work[0].deadline.tv_nsec -= 1000000000L;
+    }
+    work[0].ai = ai;
+    for (int t = 0; t < threads; t++) {
+        work[t] = work[0];
+        memset(work[t].shots, 0, sizeof(work[t].shots));
+        work[t].playouts = 0;
+        work[t].seed = 0x9e3779b97f4a7c15ULL * (ai->playouts + t + 1);
+        if (pthread_create(&ids[t], NULL, search, &work[t])) {
+            break;
+        }
+        started++;
+    }
+    for (int t = 0; t < started; t++) {
+        pthread_join(ids[t], NULL);
+        for (int c = 0; c < work[t].candidates; c++) {
+            shots[c] += work[t].shots[c];
+        }
+        ai->playouts += work[t].playouts;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    ai->seconds += (end.tv_sec - start.tv_sec) +
+            (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    // every candidate was played out on the same layouts with equal weights
+    for (int c = 1; c < work[0].candidates; c++) {
+        if (shots[c] < shots[best]) {
+            best = c;
+        }
+    }
+    *x = work[0].cx[best];
+    *y = work[0].cy[best];
+    return 1;
+}
+
+/* Makes an ai search for its shots instead of taking the densest position.
+ *
+ * @param (struct naval_ai* ai) (ai to search with)
+ * @param (int threads) (threads to play out on, every core if below 1)
+ * @param (int thinkMs) (milliseconds each shot is searched for)
+ */
+void naval_ai_search(struct naval_ai* ai, int threads, int thinkMs)
+{
+    ai->threads = threads;
+    ai->thinkMs = thinkMs;
+}
+
+/* Reads how much searching an ai has done.
+ *
+ * @param (const struct naval_ai* ai) (ai that searched)
+ * @param (long* playouts) (set to the games played out so far)
+ * @param (double* seconds) (set to the seconds spent searching)
+ */
+void naval_ai_playouts(const struct naval_ai* ai, long* playouts,
+        double* seconds)
+{
+    *playouts = ai->playouts;
+    *seconds = ai->seconds;
+}
@@ -1,776 +1,288 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
+#include <unistd.h>
 
-#define PLAYER 1
-#define CPU 2
-#define GIVEUP 3
+#include "naval.h"
+#include "commands.h"
 
-#define NONE 0
-#define MISS -1
-#define HIT -2
-
-#define MAX 26
-
-int cpuBoard[MAX][MAX]; //initialises 2D array for the cpu board
-int playerBoard[MAX][MAX]; //initialises 2D array for the player board
-
-// Assigns exit codes to error codes
-enum Errors {
-    E_NOT_ENOUGH_PARAMETERS = 10,
-    E_RULES_MISSING = 20,
-    E_PLAYER_MAP_MISSING = 30,
-    E_CPU_MAP_MISSING = 31,
-    E_CPU_TURNS_MISSING = 40,
-    E_RULES = 50,
-    E_PLAYER_SHIP_OVERLAP = 60,
-    E_CPU_SHIP_OVERLAP = 70,
-    E_PLAYER_MAP_OOB = 80,
-    E_CPU_MAP_OOB = 90,
-    E_PLAYER_MAP = 100,
-    E_CPU_MAP = 110,
-    E_TURNS = 120,
-    E_PLAYER_GIVES_UP = 130,
-    E_CPU_GIVES_UP = 140
-};
-
-/* Prints the error message to stdout and exits with the exit code correspon
+/* Prints the error message to stderr and exits with the exit code correspon
  * ding to the error code parameter.
  *
  * @param (int code) (enumerator value corresponding to the error code)
  */
 void error_exit(int code)
 {
-    switch (code) {
-        case E_NOT_ENOUGH_PARAMETERS:
-            fprintf(stderr, "Usage: naval rules playermap cpumap turns\n");
-            exit(10);
-        case E_RULES_MISSING:
-            fprintf(stderr, "Missing rules file\n");
-            exit(20);
-        case E_PLAYER_MAP_MISSING:
-            fprintf(stderr, "Missing player map file\n");
-            exit(30);
-        case E_CPU_MAP_MISSING:
-            fprintf(stderr, "Missing CPU map file\n");
-            exit(31);
-        case E_CPU_TURNS_MISSING:
-            fprintf(stderr, "Missing CPU turns file\n");
-            exit(40);
-        case E_RULES:
-            fprintf(stderr, "Error in rules file\n");
-            exit(50);
-        case E_PLAYER_SHIP_OVERLAP:
-            fprintf(stderr, "Overlap in player map file\n");
-            exit(60);
-        case E_CPU_SHIP_OVERLAP:
-            fprintf(stderr, "Overlap in CPU map file\n");
-            exit(70);
-        case E_PLAYER_MAP_OOB:
-            fprintf(stderr, "Out of bounds in player map file\n");
-            exit(80);
-        case E_CPU_MAP_OOB:
-            fprintf(stderr, "Out of bounds in CPU map file\n");
-            exit(90);
-        case E_PLAYER_MAP:
-            fprintf(stderr, "Error in player map file\n");
-            exit(100);
-        case E_CPU_MAP:
-            fprintf(stderr, "Error in CPU map file\n");
-            exit(110);
-        case E_TURNS:
-            fprintf(stderr, "Error in turns file\n");
-            exit(120);
-        case E_PLAYER_GIVES_UP:
-            fprintf(stderr, "Bad guess\n");
-            exit(130);
-        case E_CPU_GIVES_UP:
-            fprintf(stderr, "CPU player gives up\n");
-            exit(140);
-        default:
-            exit(0);
-    }
-}
+    const char* message = naval_strerror(code);
 
-/* Initialises an empty cpu board.
- *
- * @param (int width) (width of the board)
- * @param (int height) (height of the board)
- */
-void initialise_cpu_board(int width, int height)
-{
-    for (int i = 1; i < (height + 1); i++) {
-        for (int j = 1; j < (width + 1); j++) {
-            cpuBoard[i][j] = NONE;
-        }
+    if (message == NULL) {
+        exit(0);
     }
+    fprintf(stderr, "%s\n", message);
+    exit(code);
 }
 
-/* Initialises an empty player board.
+/* Exits the game if the provided files are empty.
  *
- * @param (int width) (width of the board)
- * @param (int height) (height of the board)
+ * @param (FILE* files[]) (rules, player map, cpu map and turns files)
+ * @param (int count) (number of those files opened)
  */
-void initialise_player_board(int width, int height)
+void check_null_files(FILE* files[], int count)
 {
-    for (int i = 1; i < (height + 1); i++) {
-        for (int j = 1; j < (width + 1); j++) {
-            playerBoard[i][j] = NONE;
-        }
-    }
-}
+    static const int missing[4] = {E_RULES_MISSING, E_PLAYER_MAP_MISSING,
+            E_CPU_MAP_MISSING, E_CPU_TURNS_MISSING};
 
-/* Reads one line of the provided file and returns it.
- *
- * @param (FILE* file) (filename of the file to be read)
- *
- * @return (char* result) (the line read as a string)
- */
-char* read_line(FILE* file)
-{
-    char* result = malloc(sizeof(char) * 80);
-    int position = 0;
-    int next = 0;
-    
-    while (1) {
-        next = fgetc(file);
-        if (next == '#') {
-            read_line(file);
-        } else {
-            if (next == '\n' || next == EOF) {
-                result[position] = '\0';
-                return result;
-            } else {
-                result[position++] = (char)next;
-            }
+    for (int i = 0; i < count; i++) {
+        if (files[i] == NULL) {
+            error_exit(missing[i]);
         }
     }
 }
 
-/* Exits the game if the provided files are empty.
- *
- * @param (FILE* rules) (filename of the rules file)
- * @param (FILE* plrmap) (filename of the player map file)
- * @param (FILE* cpumap) (filename of the cpu map file)
- * @param (FILE* turns) (filename of the turns file)
- */
-void check_null_files(FILE* rules, FILE* plrmap, FILE* cpumap, FILE* turns)
-{
-    if (rules == NULL) {
-        error_exit(E_RULES_MISSING);
-    }
-    if (plrmap == NULL) {
-        error_exit(E_PLAYER_MAP_MISSING);
-    }
-    if (cpumap == NULL) {
-        error_exit(E_CPU_MAP_MISSING);
-    }
-    if (turns == NULL) {
-        error_exit(E_CPU_TURNS_MISSING);
-    }
-}
-
 /* Closes files at the end of the game.
  *
  * @param all the same as check_null_files function
  */
-void close_files(FILE* rules, FILE* plrmap, FILE* cpumap, FILE* turns)
+void close_files(FILE* files[], int count)
 {
-    fclose(rules);
-    fclose(plrmap);
-    fclose(cpumap);
-    fclose(turns);
+    for (int i = 0; i < count; i++) {
+        fclose(files[i]);
+    }
 }
 
-/* Removes leading and trailing whitespace from provided string.
- *
- * @param (char* string) (string to have whitespace removed from)
+/* Prints how fast the ai searched and the shots it solved exactly to
+ * stderr, so the think time and endgame threshold can be tuned against
+ * the time each move may take.
  *
- * @return (char* string) (string with whitespace removed)
+ * @param (const struct naval_ai* ai) (ai that made the cpus moves)
  */
-char* trim_whitespace(char* string)
+void report_search(const struct naval_ai* ai)
 {
-    char* end;
-    while (isspace((unsigned char)*string)) {
-        string++;
+    long playouts;
+    double seconds;
+
+    naval_ai_playouts(ai, &playouts, &seconds);
+    if (seconds > 0) {
+        fprintf(stderr, "%ld playouts in %.3f s, %.0f playouts/sec\n",
+                playouts, seconds, playouts / seconds);
     }
-    end = string + strlen(string) - 1;
-    while (end > string && isspace((unsigned char)*end)) {
-        end--;
+    if (naval_ai_solved(ai) > 0) {
+        fprintf(stderr, "%ld shots solved exactly\n", naval_ai_solved(ai));
     }
-    end[1] = '\0';
-    return string;
 }
 
-/* Returns a character based on the value. * for a hit, / for a miss and . 
- * otherwise. 
+/* Plays the game step by step on the terminal: text goes to stdout, the
+ * boards are drawn by the renderer and the player's lines are read from
+ * stdin.
  *
- * @param (int value) (status of position on the board) 
+ * @param (struct naval_session* session) (session started on the game)
+ * @param (struct naval_renderer* renderer) (renderer of the boards)
  *
- * @return (char c) (character to be placed in that position of the board) 
+ * @return (int) (exit code the game ends with)
  */
-char cpu_chars(int value)
+int play_session(struct naval_session* session,
+        struct naval_renderer* renderer)
 {
-    char c;
-    switch (value) {
-        case HIT:
-            c = '*';
-            break;
-        case MISS:
-            c = '/';
-            break;
-        case NONE:
-            c = '.';
-            break;
-        default:
-            c = '.';
-            break;
+    char move[NAVAL_LINE_MAX];
+    const char* text;
+    size_t length;
+    int step;
+
+    while ((step = naval_session_step(session, &text, &length)) !=
+            STEP_OVER) {
+        switch (step) {
+            case STEP_TEXT:
+                fwrite(text, 1, length, stdout);
+                break;
+            case STEP_BOARDS:
+                fflush(stdout);
+                naval_render(renderer, session->game);
+                break;
+            case STEP_INPUT:
+                naval_session_input(session, move,
+                        read_line(stdin, move, sizeof(move)));
+                break;
+        }
     }
-    return c;
+    return session->code;
 }
 
-/* Returns a character based on the value. * for a hit, the ship number for 
- * a ship and . otherwise. 
+/* Takes in filenames and opens them, initialises gameplay and loops until 
+ * the game has been won or an error occurs.
  *
- * @param (int value) (status of position on the board) 
+ * @param (int argc) (number of arguments)
+ * @param (char* argv[]) (array of argument strings)
  *
- * @return (char c) (character to be placed in that position of the board) 
+ * @return (int) (0 if game exits normally)
  */
-char player_chars(int value)
+int main(int argc, char* argv[])
 {
-    char c;
-    switch (value) {
-        case HIT:
-            c = '*';
-            break;
-        case MISS:
-            //remain as is 
-        case NONE:
-            c = '.';
-            break;
-        default:
-            if (value > 9) {
-                c = value + 55;
-            } else {
-                c = value + '0';
-            }
-            break;
-    } 
-    return c;
-}
-
-/* Checks if the input string is a valid move and returns 0 if so.
- * 
- * @param (char* move) (the ove just played as a string)
- *
- * @return (int) (0 if a bad move, 1 if not)
- */
-int check_bad_move(char* move)
-{ 
-    if (strlen(move) == 3) {
-        if (!(isupper(move[0])) || !(isdigit(move[1])) || 
-                !(isdigit(move[2]))) {
-            return 0;
+    struct options options = {ENGINE_ARRAY, CPU_SCRIPTED, 0,
+            THINK_MS_DEFAULT, 0};
+    struct naval_renderer* renderer;
+    const char* manifest = NULL;
+    const char* scenarioPath = NULL;
+    const char* address = NULL;
+    const char* journalPath = NULL;
+    int journalEvery = JOURNAL_EVERY_DEFAULT;
+    int diff = 0;
+    int heatmap = 0;
+    int first = 1;
+    int parsed;
+
+    while (first < argc && strncmp(argv[first], "--", 2) == 0) {
+        if ((parsed = parse_option(argc, argv, &first, &options)) < 0) {
+            error_exit(E_NOT_ENOUGH_PARAMETERS);
+        } else if (parsed) {
+            continue;
         }
-    } else if (strlen(move) == 2) {
-        if (!(isupper(move[0])) || !(isdigit(move[1]))) {
-            return 0;
+        if (strcmp(argv[first], "--batch") == 0 && first + 1 < argc) {
+            manifest = argv[first + 1];
+            first += 2;
+        } else if (strcmp(argv[first], "--scenario") == 0 &&
+                first + 1 < argc) {
+            scenarioPath = argv[first + 1];
+            first += 2;
+        } else if (strcmp(argv[first], "--diff") == 0) {
+            diff = 1;
+            first++;
+        } else if (strcmp(argv[first], "--journal") == 0 &&
+                first + 1 < argc) {
+            journalPath = argv[first + 1];
+            first += 2;
+        } else if (strcmp(argv[first], "--journal-every") == 0 &&
+                first + 1 < argc && atoi(argv[first + 1]) > 0) {
+            journalEvery = atoi(argv[first + 1]);
+            first += 2;
+        } else if (strcmp(argv[first], "--heatmap") == 0) {
+            heatmap = 1;
+            first++;
+        } else {
+            error_exit(E_NOT_ENOUGH_PARAMETERS);
         }
-    } else {
-        return 0;
     }
-    return 1;
-}
-
-/* Checks if the x and y coordinates are valid and returns 0 if so.
- * 
- * @param (int x) (x coordinate of the boards position)
- * @param (int y) (y coordinate of the boards position)
- * @param (int width) (width of the board)
- * @param (int height) (height of the board)
- *
- * @return (int) (0 if a bad guess, 1 if not)
- */
-int check_bad_guess(int x, int y, int width, int height)
-{
-    if ((x > width) || (x < 1) || (y < 1) || (y > height)) { 
-        return 0;
+    if (options.stats) {
+        start_stats();
     }
-    return 1;
-}
-
-/* Checks if the move just played has been played before.
- *
- * @param (int player) (PLAYER or CPU depending on which map file)
- * @param (int x) (x coordinate of the boards position)
- * @param (int y) (y coordinate of the boards position)
- *
- * @return (int) (0 if repeated guess, 1 if not)
- */
-int check_repeat(int player, int x, int y)
-{
-    if (player == CPU) {
-        if (playerBoard[y][x] == HIT || playerBoard[y][x] == MISS) {
-            return 0;
-        }
-    } else if (player == PLAYER) {
-        if (cpuBoard[y][x] == HIT || cpuBoard[y][x] == MISS) {
-            return 0;
-        }
+    if (manifest != NULL) {
+        error_exit(run_batch(manifest, &options));
     }
-    return 1;
-}
-
-/* Checks if the hit just played sunk a ship and prints sunk ship if so..
- *
- * @param (int player) (PLAYER or CPU depending on which map file)
- * @param (int ship) (ship number that was hit)
- * @param (int width) (width of the board)
- * @param (int height) (height of the board)
- */
-void check_sunk(int player, int ship, int width, int height)
-{
-    if (player == PLAYER) {
-        for (int i = 1; i < (height + 1); i++) {
-            for (int j = 1; j < (width + 1); j++) {
-                if (cpuBoard[i][j] == ship) {
-                    // another position exists with that ship in it
-                    return;
-                }
-            }
-        } 
-        // no other positions exists with that ship on it
-        printf("Ship sunk\n");
-    } else if (player == CPU) { 
-        for (int i = 1; i < (height + 1); i++) {
-            for (int j = 1; j < (width + 1); j++) {
-                if (playerBoard[i][j] == ship) {
-                    return;
-                }
-            }
+    if (first < argc && strcmp(argv[first], "compile") == 0) {
+        if (argc - first - 1 < COMPILE_FIELDS) {
+            error_exit(E_NOT_ENOUGH_PARAMETERS);
         }
-        printf("Ship sunk\n");
+        error_exit(run_compile(argv + first + 1));
     }
-}
-
-/* Checks if the move just played was a hit or miss and updates the board 
- * character accordingly.
- *
- * @param (int player) (PLAYER or CPU depending on which map file)
- * @param (int x) (x coordinate of the boards position)
- * @param (int y) (y coordinate of the boards position)
- * @param (int width) (width of the board)
- * @param (int height) (height of the board)
- *
- * @return (int) (0 if miss, 1 if hit)
- */
-int check_hit(int player, int x, int y, int width, int height) 
-{
-    if (player == CPU) {
-        if (!(playerBoard[y][x] == HIT || playerBoard[y][x] == MISS || 
-                playerBoard[y][x] == NONE)) {
-            // position is a ship
-            printf("Hit\n");
-            playerBoard[y][x] = HIT;
-            player_chars(playerBoard[y][x]);
-            return 1;
-        } else {
-            //position is not a ship
-            printf("Miss\n");
-            playerBoard[y][x] = MISS;
-            player_chars(playerBoard[y][x]);
-        }
-    } else if (player == PLAYER) {
-        if (!(cpuBoard[y][x] == HIT || cpuBoard[y][x] == MISS || 
-                cpuBoard[y][x] == NONE)) {
-            printf("Hit\n");
-            cpuBoard[y][x] = HIT;
-            cpu_chars(cpuBoard[y][x]);
-            return 1;
-        } else {
-            printf("Miss\n");
-            cpuBoard[y][x] = MISS;
-            cpu_chars(cpuBoard[y][x]);
-        }
+    if (first < argc && strcmp(argv[first], "replay") == 0) {
+        error_exit(run_replay(argc - first - 1, argv + first + 1, &options));
     }
-    return 0;
-}
-
-/* Reads the players move from stdin and if it is not a bad guess 
- * will then check for hit or miss and check for sunk ship.
- *
- * @param (int width) (width of the board)
- * @param (int height) (height of the board)
- */
-void get_player_move(int width, int height)
-{
-    char c;
-    int y;
-    char* move;
-    printf("(Your move)>");
-    move = read_line(stdin);
-    if (strlen(move) == 0) {
-        error_exit(E_PLAYER_GIVES_UP);
+    if (first < argc && strcmp(argv[first], "genmap") == 0) {
+        error_exit(run_genmap(argc - first - 1, argv + first + 1));
     }
-    if (!(check_bad_move(trim_whitespace(move)))) {
-        printf("Bad guess\n");
-        get_player_move(width, height);
-    } else {
-        // is a valid input
-        sscanf(trim_whitespace(move), "%c%i", &c, &y);
-        int x = c - 64;
-
-        if (!(check_bad_guess(x, y, width, height))) {
-            printf("Bad guess\n");
-            get_player_move(width, height);
-        } else if (!check_repeat(PLAYER, x, y)) {
-            printf("Repeated guess\n");
-            get_player_move(width, height);
-        } else {
-            // not a bad or repeated guess
-            int ship = cpuBoard[y][x];
-            check_hit(PLAYER, x, y, width, height);
-            check_sunk(PLAYER, ship, width, height);  
-        } 
+    if (first < argc && strcmp(argv[first], "validate") == 0) {
+        error_exit(run_validate(argc - first - 1, argv + first + 1,
+                &options));
     }
-}
-
-/* Reads the cpus move from the turns file and if it is not a bad guess 
- * will then check for hit or miss and check for sunk ship.
- *
- * @param (FILE* turns) (filename of the cpu turns file)
- * @param (int width) (width of the board)
- * @param (int height) (height of the board)
- */
-void get_cpu_move(FILE* turns, int width, int height)
-{
-    char c;
-    int y;
-    char* move;
-    printf("(CPU move)>");
-    move = read_line(turns);
-    if (strlen(move) == 0) {
-        error_exit(E_CPU_GIVES_UP);
+    if (first < argc && strcmp(argv[first], "evaluate") == 0) {
+        error_exit(run_evaluate(argc - first - 1, argv + first + 1,
+                &options));
     }
-    printf("%s\n", move);
-    if (!(check_bad_move(trim_whitespace(move)))) {
-        printf("Bad guess\n");
-        get_cpu_move(turns, width, height);
-    } else {
-        // is a valid input 
-        sscanf(trim_whitespace(move), "%c%i", &c, &y);
-        int x = c - 64;
-
-        if (!(check_bad_guess(x, y, width, height))) {
-            printf("Bad guess\n");
-            get_cpu_move(turns, width, height);
-        } else if (!check_repeat(CPU, x, y)) {
-            printf("Repeated guess\n");
-            get_cpu_move(turns, width, height);
-        } else {
-            // not a bad or repeated guess
-            int ship = playerBoard[y][x];
-            check_hit(CPU, x, y, width, height);
-            check_sunk(CPU, ship, width, height);
-        } 
+    if (first < argc && strcmp(argv[first], "serve") == 0) {
+        if (first + 1 == argc) {
+            error_exit(E_NOT_ENOUGH_PARAMETERS);
+        }
+        address = argv[first + 1];
+        first += 2;
+    }
+    struct naval_game* game = naval_create();
+    struct naval_scenario scenario = {NULL, 0};
+    struct naval_text turnsText = {NULL};
+    struct naval_turns turns = {NULL};
+    struct naval_ai* ai = NULL;
+    struct naval_session session;
+    FILE* files[4] = {NULL};
+    FILE* journal = NULL;
+    int scripted = (options.cpu == CPU_SCRIPTED);
+    int count = 0;
+    int error;
+
+    // out of memory before the rules are read, reported as --batch does
+    if (game == NULL) {
+        error_exit(E_RULES);
     }
-}
-
-/* Checks if any of the ships overlap another by checking each position on 
- * the boards status.
- *
- * @param (int player) (PLAYER or CPU depending on which map file)
- * @param (int shipNum) (ship number)
- * @param (int x) (x coordinate of the boards position)
- * @param (int y) (y coordinate of the boards position)
- */
-void check_overlap(int player, int shipNum, int x, int y){
-    if (player == PLAYER) {
-        if (playerBoard[y][x] == HIT || playerBoard[y][x] == MISS || 
-                playerBoard[y][x] == NONE) {
-            return;
+    naval_set_engine(game, options.engine);
+    if (scenarioPath != NULL) {
+        if ((error = naval_scenario_open(&scenario, scenarioPath)) ||
+                (error = naval_scenario_load(&scenario, game, &turns))) {
+            error_exit(error);
         }
-        error_exit(E_PLAYER_SHIP_OVERLAP);
-    } else if (player == CPU) {
-        if (cpuBoard[y][x] == HIT || cpuBoard[y][x] == MISS || 
-                cpuBoard[y][x] == NONE) {
-            return;
+    } else {
+        // the turns file is only needed when the cpu's moves are scripted
+        if (argc - first < 3 + scripted) {
+            error_exit(E_NOT_ENOUGH_PARAMETERS);
         }
-        error_exit(E_CPU_SHIP_OVERLAP);
-    }
-}
-
-/* Loops through each ship placing its corresponding number on the board.
- *
- * @param (int player) (PLAYER or CPU depending on which map file)
- * @param (int sizes[]) (array of ship sizes)
- * @param (int shipNum) (ship number)
- * @param (int x) (x coordinate of the boards position)
- * @param (int y) (y coordinate of the boards position)
- * @param (char dir) (direction ship is to be placed in)
- * @param (int width) (width of the board)
- * @param (int height) (height of the board)
- */
-void ship_directions(int player, int sizes[], int shipNum, int x, int y, 
-        char dir, int width, int height)
-{
-    for (int i = 0; i < sizes[shipNum - 1]; i++) {
-        check_overlap(player, shipNum, x, y);
-
-        (player == PLAYER) ? player_chars(playerBoard[y][x] = shipNum) 
-            : cpu_chars(cpuBoard[y][x] = shipNum);
-        switch (dir) {
-            case 'N':
-                y--;
-                break;
-            case 'E':
-                x++;
-                break;
-            case 'S':
-                y++;
-                break;
-            case 'W':
-                x--;
-                break;
-            default:
-                (player == PLAYER) ? error_exit(E_PLAYER_MAP) : 
-                    error_exit(E_CPU_MAP);
-                break;
+        count = scripted ? 4 : 3;
+        for (int i = 0; i < count; i++) {
+            files[i] = fopen(argv[first + i], "r");
         }
-        if (x < 0 || x > width + 1 || y < 0 || y > height + 1) {
-            (player == PLAYER) ? error_exit(E_PLAYER_MAP_OOB) : 
-                error_exit(E_CPU_MAP_OOB);
+        check_null_files(files, count);
+        if ((error = naval_load_rules(game, files[0])) ||
+                (error = naval_load_map(game, PLAYER, files[1])) ||
+                (error = naval_load_map(game, CPU, files[2]))) {
+            error_exit(error);
         }
-    }
-}
-
-/* Reads the map files line by line to get the ship location and direction, 
- * checks if the position is bad and checks if the number of ships aligns wi
- * th that in the rules file.
- *
- * @param (FILE* file) (filename of the map file)
- * @param (int player) (PLAYER or CPU depending on which map file)
- * @param (int sizes[]) (array of ship sizes)
- * @param (int num) (number of ships each player has)
- * @param (int width) (width of the board)
- * @param (int height) (height of the board)
- */
-void read_map(FILE* file, int player, int sizes[], int num, int width, 
-        int height)
-{
-    char* line;
-    char c, dir;
-    int x, y, shipNum = 0;
-    char* buffer[10];
-    while (line = trim_whitespace(read_line(file)), strlen(line) != 0) {
-        int i = 0;
-        char* token = strtok(line, " ");
-
-        while (token != NULL) {
-            buffer[i++] = token;
-            token = strtok(NULL, " ");
+        if (scripted && (naval_text_open(&turnsText, files[3]) ||
+                naval_turns_decode(&turns, &turnsText, game))) {
+            error_exit(E_CPU_GIVES_UP);
         }
-        if (i > 2) {
-            (player == PLAYER) ? error_exit(E_PLAYER_MAP) : 
-                error_exit(E_CPU_MAP);
-        } else {
-            char* move = trim_whitespace(buffer[0]);
-            char* direction = trim_whitespace(buffer[1]);
-
-            if (!(check_bad_move(move))) {
-                (player = PLAYER) ? error_exit(E_PLAYER_MAP) : 
-                    error_exit(E_CPU_MAP);
-            } else {
-                // is a valid move
-                sscanf(move, "%c%i", &c, &y);
-                x = c - 64;
-                if (check_bad_guess(x, y, width, height)) {
-                    // isnt out of bounds
-                    if (strlen(trim_whitespace(direction)) == 1) {
-                        // is a valid direction
-                        sscanf(direction, "%c", &dir);
-                        shipNum++;
-                        ship_directions(player, sizes, shipNum, x, y, dir, 
-                                width, height);
-                    }
-                }
-            }
-        }    
     }
-    if (shipNum != num) {
-        (player == PLAYER) ? error_exit(E_PLAYER_MAP) : 
-            error_exit(E_CPU_MAP);
-    }
-}
-
-/* Displays the cpu board after each player and cpu move with updated 
- * statues.
- *
- * @param (int width) (width of the board)
- * @param (int height) (height of the board)
- */
-void display_cpu_board(int width, int height)
-{
-    printf("   ");
-    for (char c = 65; c <= (width + 64); c++) {
-        printf("%c", c);
+    if (heatmap) {
+        error_exit(show_heatmap(game, &turns, &options));
     }
-    printf("\n");
-
-    for (int i = 1; i < (height + 1); i++) {
-        if (i < 10) {
-            printf(" %i ", i);
-        } else {
-            printf("%i ", i);
-        }
-        for (int j = 1; j < (width + 1); j++) {
-            printf("%c", cpu_chars(cpuBoard[i][j]));
-        }
-        printf("\n");
+    if (address != NULL) {
+        error_exit(run_server(address, game, &turns, &options));
     }
-}
-
-/* Displays the player board after each player and cpu move with updated 
- * statues.
- *
- * @param (int width) (width of the board)
- * @param (int height) (height of the board)
- */
-void display_player_board(int width, int height)
-{
-    printf("===\n   ");
-    for (char c = 65; c <= (width + 64); c++) {
-        printf("%c", c);
+    if (!scripted && (ai = naval_ai_create(game, CPU)) == NULL) {
+        error_exit(E_CPU_GIVES_UP);
     }
-    printf("\n");
-
-    for (int i = 1; i < (height + 1); i++) {
-        if (i < 10) {
-            printf(" %i ", i);
-        } else {
-            printf("%i ", i);
-        }
-        for (int j = 1; j < (width + 1); j++) {
-            printf("%c", player_chars(playerBoard[i][j]));
-        }
-        printf("\n");
+    if (options.cpu == CPU_MCTS) {
+        naval_ai_search(ai, options.threads, options.thinkMs);
     }
-}
-
-/* Checks if cpu has won the game by sinking all the cpu ships.
- *
- * @param (int width) (width of the board)
- * @param (int height) (height of the board)
- *
- * @return (int) (1 if cpu has won, 0 otherwise)
- */
-int check_cpu_win(int width, int height)
-{
-    for (int i = 1; i < (height + 1); i++) {
-        for (int j = 1; j < (width + 1); j++) {
-            if (!(playerBoard[i][j] == HIT || playerBoard[i][j] == MISS || 
-                    playerBoard[i][j] == NONE)) {
-                return 0;
-            }
-        }
+    if (ai != NULL && options.endgame > 0) {
+        naval_ai_endgame(ai, options.threads, options.endgame);
     }
-    return 1;
-}
 
-/* Checks if player has won the game by sinking all the cpu ships.
- *
- * @param (int width) (width of the board)
- * @param (int height) (height of the board)
- *
- * @return (int) (1 if player has won, 0 otherwise)
- */
-int check_player_win(int width, int height) 
-{
-    for (int i = 1; i < (height + 1); i++) {
-        for (int j = 1; j < (width + 1); j++) {
-            if (!(cpuBoard[i][j] == HIT || cpuBoard[i][j] == MISS || 
-                    cpuBoard[i][j] == NONE)) {
-                return 0;
-            }
-        }
+    if (journalPath != NULL && ((journal = fopen(journalPath, "wb")) ==
+            NULL || naval_journal_open(game, journal, journalEvery))) {
+        error_exit(E_JOURNAL);
     }
-    return 1;
-}
 
-/* Checks if either player has won the game and returns 0 if not.
- *
- * @param (int width) (width of the board)
- * @param (int height) (height of the board)
- *
- * @return (int) (0 if game is still going, 1 if otherwise)
- */
-int check_win(int width, int height)
-{
-    if (check_player_win(width, height)) {
-        printf("Game over - you win\n");
-        return 1;
-    } else if (check_cpu_win(width, height)) {
-        printf("Game over - you lose\n");
-        return 1;
+    // without a renderer the player cannot be shown the boards
+    if ((renderer = naval_renderer_create(STDOUT_FILENO, diff)) == NULL) {
+        error_exit(E_PLAYER_GIVES_UP);
     }
-    return 0;
-}
+    naval_session_start(&session, game, &turns, ai);
+    error = play_session(&session, renderer);
+    // the journal is kept however the game ends
+    if (journal != NULL) {
+        int closed = naval_journal_close(game);
 
-/* Takes in filenames and opens them, initialises gameplay and loops until 
- * the game has been won or an error occurs.
- *
- * @param (int argc) (number of arguments)
- * @param (char* argv[]) (array of argument strings)
- *
- * @return (int) (0 if game exits normally)
- */
-int main(int argc, char* argv[])
-{
-    if (argc < 5) {
-        error_exit(E_NOT_ENOUGH_PARAMETERS);
+        if (fclose(journal) != 0 || closed) {
+            error_exit(E_JOURNAL);
+        }
     }
-    int boardWidth, boardHeight, numShips;
-    int shipSizes[numShips];
-
-    FILE* rulesFile = fopen(argv[1], "r");
-    FILE* playerMapFile = fopen(argv[2], "r");
-    FILE* cpuMapFile = fopen(argv[3], "r");
-    FILE* turnsFile = fopen(argv[4], "r"); 
-
-    check_null_files(rulesFile, playerMapFile, cpuMapFile, turnsFile);
-    sscanf(read_line(rulesFile), "%i %i", &boardWidth, &boardHeight);
-    sscanf(read_line(rulesFile), "%i ", &numShips);
-    
-    for (int i = 0; i < numShips; i++) {
-        sscanf(read_line(rulesFile), "%i", &shipSizes[i]);
+    if (error) {
+        error_exit(error);
     }
-    if ((boardWidth < 0) || (boardHeight < 0) || (boardWidth > MAX) || 
-            (boardHeight > MAX) || (numShips > 15)) {
-        error_exit(E_RULES);
-    } 
-
-    initialise_cpu_board(boardWidth, boardHeight);
-    initialise_player_board(boardWidth, boardHeight);
-
-    read_map(playerMapFile, PLAYER, shipSizes, numShips, boardWidth, 
-            boardHeight);
-    read_map(cpuMapFile, CPU, shipSizes, numShips, boardWidth, 
-            boardHeight);
-
-    while (!check_win(boardWidth, boardHeight)) {
-        display_cpu_board(boardWidth, boardHeight);
-        display_player_board(boardWidth, boardHeight);
-        get_player_move(boardWidth, boardHeight);
-        if (check_win(boardWidth, boardHeight)) {
-            break;
-        }        
-        get_cpu_move(turnsFile, boardWidth, boardHeight);
-        if (check_win(boardWidth, boardHeight)) {
-            return 0;
-        }    
+    if (ai != NULL) {
+        report_search(ai);
     }
-    
-    close_files(rulesFile, playerMapFile, cpuMapFile, turnsFile);
+    naval_renderer_destroy(renderer);
+    naval_ai_destroy(ai);
+    naval_turns_free(&turns);
+    naval_text_close(&turnsText);
+    naval_scenario_close(&scenario);
+    naval_destroy(game);
+    close_files(files, count);
     return 0;
 }
@@ -0,0 +1,650 @@
+#ifndef NAVAL_H
+#define NAVAL_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#define PLAYER 1
+#define CPU 2
+#define GIVEUP 3
+
+#define NONE 0
+#define MISS -1
+#define HIT -2
+
+/* Widest and tallest board the rules may give, as far as the coordinates of
+ * a struct naval_turn reach
+ */
+#define SIDE_MAX 65535
+/* Widest and tallest board held in the fixed-size tables of the bitboard
+ * engine, the ai, heatmaps, scenarios and journals
+ */
+#define MAX 26
+#define MAX_SHIPS 15
+
+// Longest line kept from commented input or stdin
+#define NAVAL_LINE_MAX 256
+// Longest name of a position, as written by naval_move_name
+#define NAVAL_MOVE_MAX 16
+
+// Assigns exit codes to error codes
+enum Errors {
+    E_NOT_ENOUGH_PARAMETERS = 10,
+    E_RULES_MISSING = 20,
+    E_PLAYER_MAP_MISSING = 30,
+    E_CPU_MAP_MISSING = 31,
+    E_CPU_TURNS_MISSING = 40,
+    E_PLAYER_MOVES_MISSING = 41,
+    E_RULES = 50,
+    E_PLAYER_SHIP_OVERLAP = 60,
+    E_CPU_SHIP_OVERLAP = 70,
+    E_PLAYER_MAP_OOB = 80,
+    E_CPU_MAP_OOB = 90,
+    E_PLAYER_MAP = 100,
+    E_CPU_MAP = 110,
+    E_TURNS = 120,
+    E_PLAYER_GIVES_UP = 130,
+    E_CPU_GIVES_UP = 140,
+    E_SCENARIO = 150,
+    E_HEATMAP = 160,
+    E_SERVER = 170,
+    E_SERVER_CPU = 171,
+    E_JOURNAL = 180,
+    E_GENMAP = 190,
+    E_EVALUATE = 200
+};
+
+// Outcomes of a single move
+enum Shots {
+    SHOT_BAD,
+    SHOT_REPEATED,
+    SHOT_MISS,
+    SHOT_HIT,
+    SHOT_SUNK
+};
+
+// Board representations a game can be played on, with identical results
+enum Engines {
+    ENGINE_ARRAY,
+    ENGINE_BITBOARD,
+    ENGINE_SPARSE
+};
+
+// Where the CPU's moves come from
+enum Opponents {
+    CPU_SCRIPTED,
+    CPU_DENSITY,
+    CPU_MCTS
+};
+
+// Opaque state of one game, any number of which may exist at once
+struct naval_game;
+
+/* Allocates an empty game. Returns NULL if out of memory.
+ */
+struct naval_game* naval_create(void);
+
+/* Frees a game created with naval_create.
+ */
+void naval_destroy(struct naval_game* game);
+
+/* Allocates a copy of a game in the state it is in, so a game loaded once
+ * can be played many times over. Returns NULL if out of memory.
+ */
+struct naval_game* naval_copy(const struct naval_game* game);
+
+/* Selects the board representation. Must be called before the rules are
+ * loaded; games use ENGINE_ARRAY otherwise, as do boards larger than MAX.
+ * Boards of more than SPARSE_AREA positions always use ENGINE_SPARSE.
+ */
+void naval_set_engine(struct naval_game* game, int engine);
+
+/* Reads the board dimensions and ship sizes from the rules file and clears
+ * both boards.
+ *
+ * @return (int) (0 on success, E_RULES otherwise)
+ */
+int naval_load_rules(struct naval_game* game, FILE* rules);
+
+/* As naval_load_rules, for the contents of a rules file held in memory.
+ */
+int naval_load_rules_buffer(struct naval_game* game, const char* data,
+        size_t length);
+
+/* Places the ships of the map file on the board owned by player. The rules
+ * must have been loaded first.
+ *
+ * @return (int) (0 on success, otherwise the map error for that player)
+ */
+int naval_load_map(struct naval_game* game, int player, FILE* map);
+
+/* As naval_load_map, for the contents of a map file held in memory.
+ */
+int naval_load_map_buffer(struct naval_game* game, int player,
+        const char* data, size_t length);
+
+// Kinds of problem naval_check_map finds in a map
+enum MapProblems {
+    MAP_LINE,
+    MAP_OVERLAP,
+    MAP_OOB,
+    MAP_DIRECTION,
+    MAP_SHIPS
+};
+
+/* One problem of a map. line is the line of the file it is on, from 1, or
+ * 0 for too few ships. ship is the ship concerned, or for MAP_SHIPS the
+ * ships the map gives, and code the error naval_load_map would stop with.
+ */
+struct naval_map_problem {
+    int line;
+    int kind;
+    int ship;
+    int code;
+};
+
+/* Checks a map held in memory against the loaded rules as
+ * naval_load_map_buffer would, but carries on past every problem instead
+ * of stopping at the first, so the first problem found is the error it
+ * would return. The board owned by player is cleared first and is left
+ * with the ships that fit; ships that do not are left off, so later ones
+ * are checked against the others. Only the game is written to, so any
+ * number of games may be checked on different threads at once.
+ *
+ * @return (int) (number of problems found, of which up to capacity are
+ *         stored in problems)
+ */
+int naval_check_map(struct naval_game* game, int player, const char* data,
+        size_t length, struct naval_map_problem* problems, int capacity);
+
+/* Fires the shot of player at position x, y of the opposing board.
+ *
+ * @return (int) (one of enum Shots)
+ */
+int naval_fire(struct naval_game* game, int player, int x, int y);
+
+/* Parses a move such as "C7" and fires it for player.
+ *
+ * @return (int) (one of enum Shots, SHOT_BAD if the move does not parse)
+ */
+int naval_move(struct naval_game* game, int player, const char* move);
+
+/* As naval_move, for a move of length characters that need not be NUL
+ * terminated, such as a line returned by naval_text_line.
+ */
+int naval_move_n(struct naval_game* game, int player, const char* move,
+        size_t length);
+
+/* Writes the name of position x, y as a move is typed, such as C7 or AB120,
+ * into a buffer of NAVAL_MOVE_MAX bytes.
+ *
+ * @return (size_t) (length of the name)
+ */
+size_t naval_move_name(int x, int y, char* buffer);
+
+/* Returns the status (NONE, MISS, HIT or a ship number) of position x, y on
+ * the board owned by player.
+ */
+int naval_cell(const struct naval_game* game, int player, int x, int y);
+
+/* Returns PLAYER or CPU once that side has sunk every opposing ship, 0 while
+ * the game is still going.
+ */
+int naval_winner(const struct naval_game* game);
+
+int naval_width(const struct naval_game* game);
+int naval_height(const struct naval_game* game);
+int naval_ships(const struct naval_game* game);
+
+/* Returns the number of positions ship covers, from 1 to naval_ships.
+ */
+int naval_ship_size(const struct naval_game* game, int ship);
+
+// Summary of a game played to the end by naval_play
+struct naval_result {
+    int winner;
+    int error;
+    int playerShots;
+    int cpuShots;
+    int playerSunk;
+    int cpuSunk;
+};
+
+/* Plays a loaded game to the end, reading the player's moves and the CPU's
+ * turns line by line exactly as the interactive game does, but printing
+ * nothing. playerSunk counts the CPU ships sunk by the player and cpuSunk
+ * the player ships sunk by the CPU.
+ *
+ * @return (int) (0 if the game was won, otherwise the give up error)
+ */
+int naval_play(struct naval_game* game, FILE* playerMoves, FILE* cpuTurns,
+        struct naval_result* result);
+
+// A shot fired at a board, with the outcome naval_fire returned for it
+struct naval_shot {
+    unsigned char x;
+    unsigned char y;
+    unsigned char outcome;
+};
+
+/* Sets heat to the exact chance that each position of a board with the
+ * rules of game holds a ship, given count shots fired at it in order, by
+ * counting every placement of the ships that agrees with their outcomes
+ * alone. ways is set to the number of such placements. Shots with an
+ * outcome other than SHOT_MISS, SHOT_HIT or SHOT_SUNK are left out.
+ *
+ * @return (int) (0 on success, -1 if there are too many to count, a shot
+ *         is off the board or the board is larger than MAX)
+ */
+int naval_heatmap(const struct naval_game* game,
+        const struct naval_shot* shots, int count, int threads,
+        double heat[][MAX + 2], double* ways);
+
+// Built in opponent firing where the most placements of the ships left fit
+struct naval_ai;
+
+/* Starts targeting the board opposing player in a game with its rules
+ * loaded. Returns NULL if out of memory or the board is larger than MAX.
+ */
+struct naval_ai* naval_ai_create(const struct naval_game* game, int player);
+
+void naval_ai_destroy(struct naval_ai* ai);
+
+/* Picks the next shot without firing it.
+ *
+ * @return (int) (1 if a position was picked, 0 if every one was shot)
+ */
+int naval_ai_choose(const struct naval_ai* ai, int* x, int* y);
+
+/* Picks the next shot, fires it for the ai's side and learns the outcome.
+ *
+ * @return (int) (one of enum Shots, SHOT_BAD if no position is left)
+ */
+int naval_ai_move(struct naval_ai* ai, struct naval_game* game, int* x,
+        int* y);
+
+/* Makes ai pick each shot by Monte Carlo tree search for thinkMs
+ * milliseconds, playing games out on threads threads (every core if below
+ * 1) over layouts of the opposing ships that agree with the shots so far.
+ */
+void naval_ai_search(struct naval_ai* ai, int threads, int thinkMs);
+
+/* Sets playouts to the games the search of ai has played out and seconds
+ * to the time it took, so playouts per second can be reported.
+ */
+void naval_ai_playouts(const struct naval_ai* ai, long* playouts,
+        double* seconds);
+
+/* Makes ai pick its shots by an exact search once no more than ships of the
+ * opposing ships are afloat, minimising the shots expected to sink them
+ * over every layout that agrees with the shots so far. The first shots are
+ * searched on threads threads (every core if below 1). Shots with too many
+ * layouts left to search fall back on the ai's usual choice.
+ */
+void naval_ai_endgame(struct naval_ai* ai, int threads, int ships);
+
+// Returns the shots ai has picked by the exact endgame search
+long naval_ai_solved(const struct naval_ai* ai);
+
+/* As naval_play, with the CPU's moves made by ai instead of a turns file.
+ */
+int naval_play_ai(struct naval_game* game, FILE* playerMoves,
+        struct naval_ai* ai, struct naval_result* result);
+
+/* Boards sharing one rules file that are all shot at by the same sequence
+ * of moves, resolving each shot for many boards per instruction. Suited to
+ * scoring one turns file against many maps.
+ */
+struct naval_pool;
+
+/* Allocates a pool for up to capacity boards of the game's rules. Returns
+ * NULL if out of memory or the board is larger than MAX.
+ */
+struct naval_pool* naval_pool_create(const struct naval_game* game,
+        int capacity);
+
+void naval_pool_destroy(struct naval_pool* pool);
+
+/* Removes every board and shot so the pool can be filled again.
+ */
+void naval_pool_reset(struct naval_pool* pool);
+
+/* Copies the freshly loaded board owned by player into the next lane.
+ *
+ * @return (int) (lane of the board, -1 if full or shooting has started)
+ */
+int naval_pool_add(struct naval_pool* pool, const struct naval_game* game,
+        int player);
+
+/* Fires at position x, y of every board that still has a ship afloat.
+ *
+ * @return (int) (SHOT_BAD, SHOT_REPEATED or SHOT_MISS once fired)
+ */
+int naval_pool_fire(struct naval_pool* pool, int x, int y);
+
+/* Parses a move such as "C7" and fires it at every board.
+ */
+int naval_pool_move(struct naval_pool* pool, const char* move);
+
+/* Returns the number of boards that still have a ship afloat.
+ */
+int naval_pool_playing(const struct naval_pool* pool);
+
+/* Reports the shots it took to sink every ship of a lane (-1 while any is
+ * afloat), the hits and the ships sunk so far.
+ */
+void naval_pool_lane(const struct naval_pool* pool, int lane, int* shots,
+        int* hits, int* sunk);
+
+// One ship of a layout as a line of a map file places it
+struct naval_placement {
+    unsigned char x;
+    unsigned char y;
+    char dir;
+};
+
+/* Draws random legal layouts of the ships of a rules file from a seed,
+ * picking each ship from a list of its placements made up front.
+ */
+struct naval_generator;
+
+/* Starts drawing layouts for the rules loaded in game. With uniform set
+ * every legal layout is drawn equally often; otherwise each ship is drawn
+ * among the placements left free by those before it, which is quicker on
+ * crowded boards but favours some layouts. Returns NULL if out of memory or
+ * the board is larger than MAX.
+ */
+struct naval_generator* naval_generator_create(const struct naval_game* game,
+        unsigned long long seed, int uniform);
+
+void naval_generator_destroy(struct naval_generator* generator);
+
+/* Draws the next layout, setting one placement per ship of the rules, in
+ * the order of the rules. Placing them with naval_load_map gives a valid
+ * board.
+ *
+ * @return (int) (0 on success, -1 if the ships do not seem to fit)
+ */
+int naval_generate(struct naval_generator* generator,
+        struct naval_placement* placements);
+
+/* Draws both boards of a game to a file descriptor, building each frame in
+ * one buffer and sending it with a single write().
+ */
+struct naval_renderer;
+
+/* Allocates a renderer. With diff set the first frame is drawn at the top
+ * of the screen with later output scrolling beneath it, and each following
+ * frame only repaints the positions that changed, using ANSI escapes.
+ * Otherwise every frame is the plain boards. Returns NULL if out of memory.
+ */
+struct naval_renderer* naval_renderer_create(int fd, int diff);
+
+void naval_renderer_destroy(struct naval_renderer* renderer);
+
+/* Draws the cpu board and then the player board. Anything buffered for the
+ * same descriptor must be flushed first.
+ *
+ * @return (int) (0 on success, -1 on a write error)
+ */
+int naval_render(struct naval_renderer* renderer,
+        const struct naval_game* game);
+
+/* Builds the plain boards as naval_render draws them without diff, into a
+ * buffer of naval_boards_size bytes instead of a file descriptor.
+ *
+ * @return (size_t) (length of the frame)
+ */
+size_t naval_render_boards(const struct naval_game* game, char* buffer);
+
+/* Returns the length of the longest frame naval_render_boards builds for
+ * the size of the game.
+ */
+size_t naval_boards_size(const struct naval_game* game);
+
+/* Returns the message printed for an error code.
+ */
+const char* naval_strerror(int code);
+
+/* A rules, map or turns file mapped into memory and scanned one line at a
+ * time without copying, except for lines joined across # comments.
+ */
+struct naval_text {
+    const char* next;
+    const char* end;
+    void* map;
+    size_t mapLength;
+    char* copy;
+    char line[NAVAL_LINE_MAX];
+};
+
+/* Maps the rest of an open file, or reads it whole if it cannot be mapped.
+ *
+ * @return (int) (0 on success, -1 if it could not be read)
+ */
+int naval_text_open(struct naval_text* text, FILE* file);
+
+/* Scans a buffer owned by the caller, which must outlive the text.
+ */
+void naval_text_buffer(struct naval_text* text, const char* data,
+        size_t length);
+
+void naval_text_close(struct naval_text* text);
+
+/* Sets line and length to the next line, which is not NUL terminated. Text
+ * from a # to the end of its line is skipped as read_line does.
+ *
+ * @return (int) (1 if a line was read, 0 at the end of the text)
+ */
+int naval_text_line(struct naval_text* text, const char** line,
+        size_t* length);
+
+/* A move of a turns file decoded ahead of the game. kind is SHOT_BAD for a
+ * line that is not a move on the board, SHOT_REPEATED for one already
+ * fired earlier in the file and SHOT_MISS for a move still to be fired.
+ */
+struct naval_turn {
+    unsigned short x;
+    unsigned short y;
+    unsigned char kind;
+};
+
+/* Every move of a turns file up to the line where the side gives up, with
+ * the line each was read from kept for echoing.
+ */
+struct naval_turns {
+    struct naval_turn* moves;
+    const char** lines;
+    int* lengths;
+    int count;
+    int capacity;
+    int next;
+    char* joined;
+    size_t joinedLength;
+};
+
+/* Decodes the rest of a turns text for the board size of game. The text
+ * must stay open while lines are used.
+ *
+ * @return (int) (0 on success, -1 if out of memory)
+ */
+int naval_turns_decode(struct naval_turns* turns, struct naval_text* text,
+        const struct naval_game* game);
+
+void naval_turns_free(struct naval_turns* turns);
+
+/* Returns the next move, NULL once the side has given up.
+ */
+const struct naval_turn* naval_turns_next(struct naval_turns* turns);
+
+// What naval_session_step asks of the caller next
+enum Steps {
+    STEP_TEXT,
+    STEP_BOARDS,
+    STEP_INPUT,
+    STEP_OVER
+};
+
+/* One interactive game as a resumable state machine, so a single thread
+ * can interleave any number of games with no stack or thread of their own.
+ * Each step yields text to print, a point where the boards are to be
+ * drawn, a wait for the player's next line or the end of the game, with
+ * exactly the prompts and replies of the naval CLI. A session holds no
+ * memory of its own, so it can be embedded and needs no freeing. Once the
+ * game is over code is its exit code: 0, or E_PLAYER_GIVES_UP or
+ * E_CPU_GIVES_UP, which the caller prints as the CLI would.
+ */
+struct naval_session {
+    struct naval_game* game;
+    struct naval_turns* turns;
+    struct naval_ai* ai;
+    int state;
+    int code;
+    unsigned long long start;
+    char line[NAVAL_LINE_MAX];
+    char text[64];
+};
+
+/* Starts a session on a loaded game, with the cpu's moves made by ai if it
+ * is set and otherwise taken from turns. Nothing is copied: the game,
+ * turns and ai are played on in place.
+ */
+void naval_session_start(struct naval_session* session,
+        struct naval_game* game, struct naval_turns* turns,
+        struct naval_ai* ai);
+
+/* Runs the session up to its next step. For STEP_TEXT, text and length
+ * are set to output that stays valid until the next step.
+ *
+ * @return (int) (one of enum Steps, STEP_INPUT until a line is given)
+ */
+int naval_session_step(struct naval_session* session, const char** text,
+        size_t* length);
+
+/* Gives the line the player typed, without its newline, as read_line
+ * returns it. A line of length 0, as at the end of input, gives up.
+ */
+void naval_session_input(struct naval_session* session, const char* line,
+        size_t length);
+
+// A compiled scenario mapped into memory
+struct naval_scenario {
+    const unsigned char* data;
+    size_t length;
+};
+
+/* Writes the rules, placed boards and decoded cpu turns of a game, before
+ * any shot is fired, as one versioned and checksummed binary scenario.
+ *
+ * @return (int) (0 on success, -1 if it could not be written or the board
+ *         is larger than MAX)
+ */
+int naval_scenario_write(const struct naval_game* game,
+        const struct naval_turns* turns, FILE* file);
+
+/* Maps a scenario and checks it was written by this version.
+ *
+ * @return (int) (0 on success, E_SCENARIO otherwise)
+ */
+int naval_scenario_open(struct naval_scenario* scenario, const char* path);
+
+/* Sets up game and turns from the scenario with no parsing. The scenario
+ * must stay open while the lines of turns are used.
+ *
+ * @return (int) (0 on success, E_SCENARIO otherwise)
+ */
+int naval_scenario_load(const struct naval_scenario* scenario,
+        struct naval_game* game, struct naval_turns* turns);
+
+void naval_scenario_close(struct naval_scenario* scenario);
+
+/* Starts recording every shot fired in the game to a binary journal of a
+ * few bytes per shot, with the rules and boards as placed at its start and
+ * a snapshot of the shots so far after every interval of them. The game
+ * must not have had a shot fired yet.
+ *
+ * @return (int) (0 on success, -1 if it could not be written or the board
+ *         is larger than MAX)
+ */
+int naval_journal_open(struct naval_game* game, FILE* file, int interval);
+
+/* Stops the journal of a game, if any, and flushes its file, leaving it
+ * open. naval_destroy does the same.
+ *
+ * @return (int) (0 if every shot was written, -1 otherwise)
+ */
+int naval_journal_close(struct naval_game* game);
+
+// A journal mapped into memory to be replayed, with its count of moves
+struct naval_replay {
+    const unsigned char* data;
+    size_t length;
+    int interval;
+    int moves;
+};
+
+/* Maps a journal and checks it was written by this version.
+ *
+ * @return (int) (0 on success, E_JOURNAL otherwise)
+ */
+int naval_replay_open(struct naval_replay* replay, const char* path);
+
+void naval_replay_close(struct naval_replay* replay);
+
+/* Reads the side, position and recorded outcome of a move, from 1.
+ *
+ * @return (int) (SHOT_MISS, SHOT_HIT or SHOT_SUNK)
+ */
+int naval_replay_shot(const struct naval_replay* replay, int move,
+        int* player, int* x, int* y);
+
+/* Sets up game as it stood after move shots, from 0 to replay->moves,
+ * starting from the nearest snapshot so only the shots since it are fired.
+ *
+ * @return (int) (0 on success, E_JOURNAL if the journal disagrees with
+ *         its own boards)
+ */
+int naval_replay_seek(const struct naval_replay* replay,
+        struct naval_game* game, int move);
+
+/* Fires every shot of the journal at game, checking each outcome and
+ * snapshot, and sums up the game as naval_play does.
+ *
+ * @return (int) (0 on success, E_JOURNAL otherwise)
+ */
+int naval_replay_check(const struct naval_replay* replay,
+        struct naval_game* game, struct naval_result* result);
+
+/* Reads one line of the provided file into line, skipping # comments and
+ * dropping characters past size - 1.
+ *
+ * @return (int) (length of the line read, 0 at the end of the file)
+ */
+int read_line(FILE* file, char* line, int size);
+
+/* Process wide instrumentation behind --stats. While it is off every timed
+ * part of a game costs one test of a flag. Once on, the library counts the
+ * cycles spent parsing rules, in each read_map call, taking in moves,
+ * resolving hits and checking for sunk ships and wins, and rendering, along
+ * with its allocations. Hardware counters are opened through
+ * perf_event_open where the kernel allows it.
+ */
+void naval_stats_enable(void);
+
+/* Returns the time to pass to naval_stats_move, 0 while stats are off.
+ */
+unsigned long long naval_stats_now(void);
+
+/* Adds the time since start to the histogram of move latencies.
+ */
+void naval_stats_move(unsigned long long start);
+
+/* Counts bytes written to standard output.
+ */
+void naval_stats_output(size_t bytes);
+
+/* Prints the counts as one line of JSON.
+ */
+void naval_stats_print(FILE* file);
+
+#endif
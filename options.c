@@ -0,0 +1,129 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "naval.h"
+#include "commands.h"
+
+/* Reads the option at argv[*index] and its value, if it is one shared by
+ * naval and naval-tourney, moving index past them.
+ *
+ * @param (int argc) (number of arguments)
+ * @param (char* argv[]) (array of argument strings)
+ * @param (int* index) (position of the option in argv)
+ * @param (struct options* options) (updated with the option read)
+ *
+ * @return (int) (1 if an option was read, 0 if argv[*index] is not one,
+ *         -1 if its value is missing or unknown)
+ */
+int parse_option(int argc, char* argv[], int* index, struct options* options)
+{
+    const char* option = argv[*index];
+    const char* value = (*index + 1 < argc) ? argv[*index + 1] : NULL;
+
+    if (strcmp(option, "--engine") == 0) {
+        if (value == NULL) {
+            return -1;
+        } else if (strcmp(value, "array") == 0) {
+            options->engine = ENGINE_ARRAY;
+        } else if (strcmp(value, "bitboard") == 0) {
+            options->engine = ENGINE_BITBOARD;
+        } else if (strcmp(value, "sparse") == 0) {
+            options->engine = ENGINE_SPARSE;
+        } else {
+            return -1;
+        }
+        *index += 2;
+        return 1;
+    }
+    if (strcmp(option, "--threads") == 0) {
+        if (value == NULL || (options->threads = atoi(value)) < 1) {
+            return -1;
+        }
+        *index += 2;
+        return 1;
+    }
+    if (strcmp(option, "--stats") == 0) {
+        options->stats = 1;
+        *index += 1;
+        return 1;
+    }
+    if (strcmp(option, "--cpu-think-ms") == 0) {
+        if (value == NULL || (options->thinkMs = atoi(value)) < 1) {
+            return -1;
+        }
+        *index += 2;
+        return 1;
+    }
+    if (strcmp(option, "--cpu-endgame") == 0) {
+        if (value == NULL || (options->endgame = atoi(value)) < 1) {
+            return -1;
+        }
+        *index += 2;
+        return 1;
+    }
+    if (strcmp(option, "--cpu") == 0) {
+        if (value == NULL) {
+            return -1;
+        } else if (strcmp(value, "scripted") == 0) {
+            options->cpu = CPU_SCRIPTED;
+        } else if (strcmp(value, "density") == 0) {
+            options->cpu = CPU_DENSITY;
+        } else if (strcmp(value, "mcts") == 0) {
+            options->cpu = CPU_MCTS;
+        } else {
+            return -1;
+        }
+        *index += 2;
+        return 1;
+    }
+    return 0;
+}
+
+/* Writes standard output through to its file descriptor, counting the
+ * bytes for --stats.
+ *
+ * @param (void* cookie) (unused)
+ * @param (const char* buffer) (bytes to be written)
+ * @param (size_t size) (number of bytes)
+ *
+ * @return (ssize_t) (bytes written, -1 on a write error)
+ */
+static ssize_t write_counted(void* cookie, const char* buffer, size_t size)
+{
+    ssize_t written = write(STDOUT_FILENO, buffer, size);
+
+    if (written > 0) {
+        naval_stats_output(written);
+    }
+    return written;
+}
+
+/* Prints the --stats summary once everything is written.
+ */
+static void print_stats(void)
+{
+    fflush(stdout);
+    naval_stats_print(stderr);
+}
+
+/* Turns on --stats for the process: counts every byte sent to standard
+ * output and prints the summary to stderr on exit, however the command
+ * ends.
+ */
+void start_stats(void)
+{
+    static const cookie_io_functions_t counted = {NULL, write_counted, NULL,
+            NULL};
+    FILE* file;
+
+    naval_stats_enable();
+    fflush(stdout);
+    if ((file = fopencookie(NULL, "w", counted)) != NULL) {
+        setvbuf(file, NULL, isatty(STDOUT_FILENO) ? _IOLBF : _IOFBF, BUFSIZ);
+        stdout = file;
+    }
+    atexit(print_stats);
+}
@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "game.h"
+
+// Where one side's moves come from: decoded turns, or an ai if it is set
+struct side {
+    struct naval_turns turns;
+    struct naval_ai* ai;
+};
+
+/* Takes moves for player until one is neither a bad nor a repeated guess
+ * and fires it, counting the shot in the result.
+ *
+ * @param (struct naval_game* game) (game being played)
+ * @param (int player) (PLAYER or CPU depending on who is moving)
+ * @param (struct side* side) (where the moves of that player come from)
+ * @param (struct naval_result* result) (counters to be updated)
+ *
+ * @return (int) (0 once a shot is fired, the give up error otherwise)
+ */
+static int take_turn(struct naval_game* game, int player, struct side* side,
+        struct naval_result* result)
+{
+    unsigned long long start = naval_stats_now();
+    const struct naval_turn* move;
+    int x, y;
+    int shot;
+
+    if (side->ai != NULL) {
+        shot = naval_ai_move(side->ai, game, &x, &y);
+    } else {
+        do {
+            move = naval_turns_next(&side->turns);
+        } while (move != NULL && move->kind != SHOT_MISS);
+        shot = (move == NULL) ? SHOT_BAD :
+                naval_fire(game, player, move->x, move->y);
+    }
+    if (shot == SHOT_BAD) {
+        return (player == PLAYER) ? E_PLAYER_GIVES_UP : E_CPU_GIVES_UP;
+    }
+    naval_stats_move(start);
+
+    if (player == PLAYER) {
+        result->playerShots++;
+        result->playerSunk += (shot == SHOT_SUNK);
+    } else {
+        result->cpuShots++;
+        result->cpuSunk += (shot == SHOT_SUNK);
+    }
+    return 0;
+}
+
+/* Decodes the moves of one side from an open file.
+ *
+ * @param (struct side* side) (set up with the decoded moves)
+ * @param (FILE* file) (file the moves are read from)
+ * @param (const struct naval_game* game) (game with the rules loaded)
+ *
+ * @return (int) (0 on success, -1 if the file could not be read)
+ */
+static int read_side(struct side* side, FILE* file,
+        const struct naval_game* game)
+{
+    struct naval_text text;
+    int decoded;
+
+    side->ai = NULL;
+    if (naval_text_open(&text, file)) {
+        return -1;
+    }
+    decoded = naval_turns_decode(&side->turns, &text, game);
+    naval_text_close(&text);
+    return decoded;
+}
+
+/* Plays the game to the end in the same order as the interactive game: the
+ * player moves first and the game stops as soon as either side wins.
+ *
+ * @param (struct naval_game* game) (game with rules and maps loaded)
+ * @param (struct side* player) (where the player's moves come from)
+ * @param (struct side* cpu) (where the cpu's moves come from)
+ * @param (struct naval_result* result) (filled in with the outcome)
+ */
+static void play_sides(struct naval_game* game, struct side* player,
+        struct side* cpu, struct naval_result* result)
+{
+    while (!(result->winner = check_win(game))) {
+        if ((result->error = take_turn(game, PLAYER, player, result))) {
+            break;
+        }
+        if ((result->winner = check_win(game))) {
+            break;
+        }
+        if ((result->error = take_turn(game, CPU, cpu, result))) {
+            break;
+        }
+    }
+}
+
+/* Plays a loaded game to the end in the same order as the interactive game:
+ * the player moves first and the game stops as soon as either side wins.
+ *
+ * @param (struct naval_game* game) (game with rules and maps loaded)
+ * @param (FILE* playerMoves) (file the player's moves are read from)
+ * @param (FILE* cpuTurns) (file the cpu's moves are read from)
+ * @param (struct naval_result* result) (filled in with the outcome)
+ *
+ * @return (int) (0 if the game was won, otherwise the give up error)
+ */
+int naval_play(struct naval_game* game, FILE* playerMoves, FILE* cpuTurns,
+        struct naval_result* result)
+{
+    struct side player, cpu;
+
+    memset(result, 0, sizeof(*result));
+    if (read_side(&player, playerMoves, game)) {
+        return result->error = E_PLAYER_GIVES_UP;
+    }
+    if (read_side(&cpu, cpuTurns, game)) {
+        naval_turns_free(&player.turns);
+        return result->error = E_CPU_GIVES_UP;
+    }
+    play_sides(game, &player, &cpu, result);
+    naval_turns_free(&player.turns);
+    naval_turns_free(&cpu.turns);
+    return result->error;
+}
+
+/* Plays a loaded game to the end as naval_play does, with the cpu's moves
+ * made by an ai.
+ *
+ * @param (struct naval_game* game) (game with rules and maps loaded)
+ * @param (FILE* playerMoves) (file the player's moves are read from)
+ * @param (struct naval_ai* ai) (ai making the cpu's moves)
+ * @param (struct naval_result* result) (filled in with the outcome)
+ *
+ * @return (int) (0 if the game was won, otherwise the give up error)
+ */
+int naval_play_ai(struct naval_game* game, FILE* playerMoves,
+        struct naval_ai* ai, struct naval_result* result)
+{
+    struct side player, cpu;
+
+    memset(result, 0, sizeof(*result));
+    if (read_side(&player, playerMoves, game)) {
+        return result->error = E_PLAYER_GIVES_UP;
+    }
+    memset(&cpu, 0, sizeof(cpu));
+    cpu.ai = ai;
+    play_sides(game, &player, &cpu, result);
+    naval_turns_free(&player.turns);
+    return result->error;
+}
@@ -0,0 +1,322 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "game.h"
+
+// Lanes are allocated in multiples of the widest vector
+#define POOL_ALIGN 64
+#define POOL_CELLS ((MAX + 2) * (MAX + 2))
+
+/* Boards that share one rules file and are shot at by one sequence of
+ * moves. Every per board value is stored lane by lane, so the state of
+ * neighbouring boards at a position or for a ship sits in one vector.
+ * Moves are the same in every lane, which leaves bad and repeated guesses
+ * to be checked once for the whole pool.
+ */
+struct naval_pool {
+    int width;
+    int height;
+    int numShips;
+    int fleet;
+    int shipCells;
+    int capacity;
+    int lanes;
+    int shots;
+    int playing;
+    char fired[MAX + 2][MAX + 2];
+    int8_t* cells;
+    int8_t* remaining;
+    int8_t* afloat;
+    int16_t* wonAt;
+    void (*step)(struct naval_pool* pool, int cell);
+};
+
+/* Marks the lanes that sank their last ship on this shot as won.
+ *
+ * @param (struct naval_pool* pool) (pool being shot at)
+ * @param (int first) (first lane of the vector that finished)
+ * @param (int count) (number of lanes in that vector)
+ */
+static void finish_lanes(struct naval_pool* pool, int first, int count)
+{
+    for (int lane = first; lane < first + count && lane < pool->lanes;
+            lane++) {
+        if (pool->afloat[lane] == 0 && pool->wonAt[lane] < 0) {
+            pool->wonAt[lane] = pool->shots;
+            pool->playing--;
+        }
+    }
+}
+
+/* Resolves a shot at one position of every board, one lane at a time.
+ *
+ * @param (struct naval_pool* pool) (pool being shot at)
+ * @param (int cell) (index of the position shot at)
+ */
+static void step_scalar(struct naval_pool* pool, int cell)
+{
+    const int8_t* ships = pool->cells + (size_t)cell * pool->capacity;
+
+    for (int lane = 0; lane < pool->lanes; lane++) {
+        int ship = ships[lane];
+
+        if (ship != NONE && pool->afloat[lane] > 0) {
+            int8_t* remaining = pool->remaining +
+                    (size_t)(ship - 1) * pool->capacity;
+
+            if (--remaining[lane] == 0 && --pool->afloat[lane] == 0) {
+                finish_lanes(pool, lane, 1);
+            }
+        }
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+typedef int8_t v32 __attribute__((vector_size(32)));
+typedef int8_t v64 __attribute__((vector_size(64)));
+
+/* Defines a step function resolving a shot for sizeof(vec) lanes per
+ * instruction. Comparisons give -1 in every lane where they hold, so adding
+ * a mask decrements exactly the lanes it selects.
+ */
+#define DEFINE_STEP(name, vec, isa)                                           \
+__attribute__((target(isa)))                                                  \
+static void name(struct naval_pool* pool, int cell)                           \
+{                                                                             \
+    const int8_t* ships = pool->cells + (size_t)cell * pool->capacity;        \
+                                                                              \
+    for (int lane = 0; lane < pool->lanes; lane += sizeof(vec)) {             \
+        vec ship, afloat, live, hit, left, done;                              \
+        uint64_t any[sizeof(vec) / 8];                                        \
+        uint64_t finished = 0;                                                \
+                                                                              \
+        memcpy(&ship, ships + lane, sizeof(vec));                             \
+        memcpy(&afloat, pool->afloat + lane, sizeof(vec));                    \
+        live = afloat > 0;                                                    \
+        for (int s = 1; s <= pool->numShips; s++) {                           \
+            int8_t* remaining = pool->remaining +                             \
+                    (size_t)(s - 1) * pool->capacity + lane;                  \
+                                                                              \
+            hit = (ship == (int8_t)s) & live;                                 \
+            memcpy(&left, remaining, sizeof(vec));                            \
+            left += hit;                                                      \
+            memcpy(remaining, &left, sizeof(vec));                            \
+            afloat += (left == 0) & hit;                                      \
+        }                                                                     \
+        memcpy(pool->afloat + lane, &afloat, sizeof(vec));                    \
+                                                                              \
+        done = live & (afloat == 0);                                          \
+        memcpy(any, &done, sizeof(vec));                                      \
+        for (unsigned i = 0; i < sizeof(vec) / 8; i++) {                      \
+            finished |= any[i];                                               \
+        }                                                                     \
+        if (finished) {                                                       \
+            finish_lanes(pool, lane, sizeof(vec));                            \
+        }                                                                     \
+    }                                                                         \
+}
+
+DEFINE_STEP(step_avx2, v32, "avx2")
+DEFINE_STEP(step_avx512, v64, "avx512bw")
+
+#endif
+
+/* Allocates a pool for boards of the game's rules.
+ *
+ * @param (const struct naval_game* game) (game with the rules loaded)
+ * @param (int capacity) (number of boards the pool can hold)
+ *
+ * @return (struct naval_pool*) (the new pool, NULL if out of memory or
+ *         the board is larger than MAX)
+ */
+struct naval_pool* naval_pool_create(const struct naval_game* game,
+        int capacity)
+{
+    struct naval_pool* pool;
+    void* cells = NULL;
+    void* remaining = NULL;
+    void* afloat = NULL;
+
+    if (game->width > MAX || game->height > MAX ||
+            (pool = calloc(1, sizeof(struct naval_pool))) == NULL) {
+        return NULL;
+    }
+    pool->width = game->width;
+    pool->height = game->height;
+    pool->numShips = game->numShips;
+    for (int i = 0; i < game->numShips; i++) {
+        if (game->shipSizes[i] > 0) {
+            pool->fleet++;
+            pool->shipCells += game->shipSizes[i];
+        }
+    }
+    pool->capacity = (capacity + POOL_ALIGN - 1) / POOL_ALIGN * POOL_ALIGN;
+    if (pool->capacity == 0) {
+        pool->capacity = POOL_ALIGN;
+    }
+    if (posix_memalign(&cells, POOL_ALIGN,
+                (size_t)POOL_CELLS * pool->capacity) ||
+            posix_memalign(&remaining, POOL_ALIGN,
+                (size_t)MAX_SHIPS * pool->capacity) ||
+            posix_memalign(&afloat, POOL_ALIGN, pool->capacity) ||
+            (pool->wonAt = malloc(pool->capacity * sizeof(int16_t))) == NULL) {
+        free(cells);
+        free(remaining);
+        free(afloat);
+        free(pool);
+        return NULL;
+    }
+    pool->cells = cells;
+    pool->remaining = remaining;
+    pool->afloat = afloat;
+
+    pool->step = step_scalar;
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512bw")) {
+        pool->step = step_avx512;
+    } else if (__builtin_cpu_supports("avx2")) {
+        pool->step = step_avx2;
+    }
+#endif
+    naval_pool_reset(pool);
+    return pool;
+}
+
+/* Frees a pool created with naval_pool_create.
+ *
+ * @param (struct naval_pool* pool) (pool to be freed)
+ */
+void naval_pool_destroy(struct naval_pool* pool)
+{
+    if (pool != NULL) {
+        free(pool->cells);
+        free(pool->remaining);
+        free(pool->afloat);
+        free(pool->wonAt);
+        free(pool);
+    }
+}
+
+/* Removes every board and shot so the pool can be filled again.
+ *
+ * @param (struct naval_pool* pool) (pool to be emptied)
+ */
+void naval_pool_reset(struct naval_pool* pool)
+{
+    pool->lanes = 0;
+    pool->shots = 0;
+    pool->playing = 0;
+    memset(pool->fired, 0, sizeof(pool->fired));
+    memset(pool->cells, 0, (size_t)POOL_CELLS * pool->capacity);
+    memset(pool->remaining, 0, (size_t)MAX_SHIPS * pool->capacity);
+    memset(pool->afloat, 0, pool->capacity);
+}
+
+/* Copies the board owned by player into the next lane of the pool. The
+ * board must have its ships placed and not have been shot at.
+ *
+ * @param (struct naval_pool* pool) (pool to be added to)
+ * @param (const struct naval_game* game) (game with the map loaded)
+ * @param (int player) (PLAYER or CPU, owner of the board)
+ *
+ * @return (int) (lane of the board, -1 if the pool is full)
+ */
+int naval_pool_add(struct naval_pool* pool, const struct naval_game* game,
+        int player)
+{
+    const struct board* board = (player == PLAYER) ? &game->playerBoard :
+            &game->cpuBoard;
+    int lane = pool->lanes;
+
+    if (lane == pool->capacity || pool->shots > 0) {
+        return -1;
+    }
+    for (int i = 1; i < (pool->height + 1); i++) {
+        for (int j = 1; j < (pool->width + 1); j++) {
+            pool->cells[(size_t)(i * (MAX + 2) + j) * pool->capacity + lane] =
+                    naval_cell(game, player, j, i);
+        }
+    }
+    for (int ship = 0; ship < pool->numShips; ship++) {
+        pool->remaining[(size_t)ship * pool->capacity + lane] =
+                board->remaining[ship];
+    }
+    pool->afloat[lane] = board->afloat;
+    pool->wonAt[lane] = (board->afloat == 0) ? 0 : -1;
+    pool->playing += (board->afloat != 0);
+    return pool->lanes++;
+}
+
+/* Fires a shot at position x, y of every board still being played.
+ *
+ * @param (struct naval_pool* pool) (pool being shot at)
+ * @param (int x) (x coordinate of the boards position)
+ * @param (int y) (y coordinate of the boards position)
+ *
+ * @return (int) (SHOT_BAD, SHOT_REPEATED or SHOT_MISS once the shot has
+ *         been resolved in every lane)
+ */
+int naval_pool_fire(struct naval_pool* pool, int x, int y)
+{
+    if (!(check_bad_guess(x, y, pool->width, pool->height))) {
+        return SHOT_BAD;
+    }
+    if (pool->fired[y][x]) {
+        return SHOT_REPEATED;
+    }
+    pool->fired[y][x] = 1;
+    pool->shots++;
+    pool->step(pool, y * (MAX + 2) + x);
+    return SHOT_MISS;
+}
+
+/* Parses a move such as "C7" and fires it at every board.
+ *
+ * @param (struct naval_pool* pool) (pool being shot at)
+ * @param (const char* move) (the move as read from the input)
+ *
+ * @return (int) (as naval_pool_fire, SHOT_BAD if the move does not parse)
+ */
+int naval_pool_move(struct naval_pool* pool, const char* move)
+{
+    int x, y;
+
+    if (!parse_move(move, strlen(move), &x, &y)) {
+        return SHOT_BAD;
+    }
+    return naval_pool_fire(pool, x, y);
+}
+
+/* Returns the number of boards that still have a ship afloat.
+ *
+ * @param (const struct naval_pool* pool) (pool being shot at)
+ */
+int naval_pool_playing(const struct naval_pool* pool)
+{
+    return pool->playing;
+}
+
+/* Reports how the shots so far went on one board.
+ *
+ * @param (const struct naval_pool* pool) (pool being shot at)
+ * @param (int lane) (lane of the board)
+ * @param (int* shots) (set to the shots it took to sink every ship, -1 if
+ *        some are still afloat)
+ * @param (int* hits) (set to the number of shots that hit)
+ * @param (int* sunk) (set to the number of ships sunk)
+ */
+void naval_pool_lane(const struct naval_pool* pool, int lane, int* shots,
+        int* hits, int* sunk)
+{
+    int left = 0;
+
+    for (int ship = 0; ship < pool->numShips; ship++) {
+        left += pool->remaining[(size_t)ship * pool->capacity + lane];
+    }
+    *shots = pool->wonAt[lane];
+    *hits = pool->shipCells - left;
+    *sunk = pool->fleet - pool->afloat[lane];
+}
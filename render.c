@@ -0,0 +1,558 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "game.h"
+
+/* Longest repaint of one position, "\0337\033[row;columnH", its character
+ * and "\0338"
+ */
+#define REPAINT_SIZE 32
+// Repaints kept in the frame before it is written out in parts
+#define REPAINTS_MAX 4096
+
+/* Builds each frame of the boards in one buffer and sends it with a single
+ * write(), or in parts if more positions changed than the buffer holds
+ * repaints for. In diff mode the first frame is drawn at the top of the
+ * screen, with everything printed afterwards scrolling below it, and later
+ * frames only repaint the positions that changed since. Both buffers are
+ * sized to the board drawn.
+ */
+struct naval_renderer {
+    int fd;
+    int diff;
+    int drawn;
+    int width;
+    int height;
+    char* last;
+    char* frame;
+    size_t capacity;
+};
+
+/* Returns a character based on the value. * for a hit, / for a miss and . 
+ * otherwise. 
+ *
+ * @param (int value) (status of position on the board) 
+ *
+ * @return (char c) (character to be placed in that position of the board) 
+ */
+char cpu_chars(int value)
+{
+    char c;
+    switch (value) {
+        case HIT:
+            c = '*';
+            break;
+        case MISS:
+            c = '/';
+            break;
+        case NONE:
+            c = '.';
+            break;
+        default:
+            c = '.';
+            break;
+    }
+    return c;
+}
+
+/* Returns a character based on the value. * for a hit, the ship number for 
+ * a ship and . otherwise. 
+ *
+ * @param (int value) (status of position on the board) 
+ *
+ * @return (char c) (character to be placed in that position of the board) 
+ */
+char player_chars(int value)
+{
+    char c;
+    switch (value) {
+        case HIT:
+            c = '*';
+            break;
+        case MISS:
+            //remain as is 
+        case NONE:
+            c = '.';
+            break;
+        default:
+            if (value > 9) {
+                c = value + 55;
+            } else {
+                c = value + '0';
+            }
+            break;
+    } 
+    return c;
+}
+
+/* Returns the number of letters in the name of the last column, columns
+ * being named A to Z, then AA to ZZ and so on.
+ *
+ * @param (int width) (width of the board)
+ */
+static int column_letters(int width)
+{
+    int letters = 1;
+
+    for (long span = 26; width > span; span *= 26) {
+        width -= span;
+        letters++;
+    }
+    return letters;
+}
+
+/* Returns the number of characters taken by the row numbers, at least 2.
+ *
+ * @param (int height) (height of the board)
+ */
+static int row_digits(int height)
+{
+    int digits = 2;
+
+    for (long limit = 100; height >= limit; limit *= 10) {
+        digits++;
+    }
+    return digits;
+}
+
+/* Returns the letter of a column's name shown on one line of the header.
+ * Names are right aligned on the last line, with spaces above the shorter
+ * ones.
+ *
+ * @param (int x) (x coordinate of the column)
+ * @param (int line) (line of the header, from 0)
+ * @param (int lines) (lines in the header, the letters of the longest name)
+ *
+ * @return (char) (the letter, or a space)
+ */
+static char column_letter(int x, int line, int lines)
+{
+    for (int k = lines - 1; k > line; k--) {
+        x = (x - 1) / 26;
+    }
+    return (x > 0) ? 'A' + (x - 1) % 26 : ' ';
+}
+
+/* Appends the column names of a board above the space taken by the row
+ * numbers, one line for each of their letters.
+ *
+ * @param (char* frame) (end of the frame so far)
+ * @param (const struct naval_game* game) (game being played)
+ * @param (int digits) (characters taken by the row numbers)
+ *
+ * @return (char*) (end of the frame)
+ */
+static char* column_header(char* frame, const struct naval_game* game,
+        int digits)
+{
+    int lines = column_letters(game->width);
+
+    for (int line = 0; line < lines; line++) {
+        memset(frame, ' ', digits + 1);
+        frame += digits + 1;
+        for (int j = 1; j < (game->width + 1); j++) {
+            *frame++ = column_letter(j, line, lines);
+        }
+        *frame++ = '\n';
+    }
+    return frame;
+}
+
+/* Appends the number of a row, right aligned, and the space after it.
+ *
+ * @param (char* frame) (end of the frame so far)
+ * @param (int row) (row number, from 1)
+ * @param (int digits) (characters taken by the row numbers)
+ *
+ * @return (char*) (end of the frame)
+ */
+static char* row_number(char* frame, int row, int digits)
+{
+    for (int k = digits - 1; k >= 0; k--) {
+        frame[k] = (row > 0) ? '0' + row % 10 : ' ';
+        row /= 10;
+    }
+    frame[digits] = ' ';
+    return frame + digits + 1;
+}
+
+/* Appends the rows of a board played on ENGINE_SPARSE, first as open sea
+ * and then drawing only its ships and shots, so a lightly populated board
+ * costs no lookup per position.
+ *
+ * @param (char* frame) (end of the frame so far)
+ * @param (const struct naval_game* game) (game being played)
+ * @param (int player) (PLAYER to draw its ships too, CPU for its misses)
+ * @param (int digits) (characters taken by the row numbers)
+ *
+ * @return (char*) (end of the frame)
+ */
+static char* sparse_rows(char* frame, const struct naval_game* game,
+        int player, int digits)
+{
+    const struct sparse* board = (player == PLAYER) ?
+            &game->playerBoard.sparse : &game->cpuBoard.sparse;
+    size_t rowLength = digits + 1 + game->width + 1;
+    // position x, y is at origin[(y - 1) * rowLength + x]
+    char* origin = frame + digits;
+
+    for (int i = 1; i < (game->height + 1); i++) {
+        frame = row_number(frame, i, digits);
+        memset(frame, '.', game->width);
+        frame += game->width;
+        *frame++ = '\n';
+    }
+    if (player == PLAYER) {
+        const struct segments* lists[] = {&board->across, &board->down};
+
+        for (int l = 0; l < 2; l++) {
+            for (int r = 0; r < lists[l]->count; r++) {
+                const struct segment* run = &lists[l]->items[r];
+                char c = player_chars(run->ship);
+
+                for (int k = 0; k < run->length; k++) {
+                    origin[(size_t)(run->y - 1 + l * k) * rowLength +
+                            run->x + (1 - l) * k] = c;
+                }
+            }
+        }
+    }
+    for (uint32_t k = 0; board->shots.mask && k <= board->shots.mask; k++) {
+        uint32_t key = board->shots.keys[k];
+        int x = SPARSE_X(key);
+        int y = SPARSE_Y(key);
+
+        if (key != 0) {
+            char c = (sparse_ship_at(board, x, y) != NONE) ? '*' :
+                    (player == PLAYER) ? '.' : '/';
+
+            origin[(size_t)(y - 1) * rowLength + x] = c;
+        }
+    }
+    return frame;
+}
+
+/* Appends the column names and then each row of the cpu board to the
+ * frame.
+ *
+ * @param (char* frame) (end of the frame so far)
+ * @param (const struct naval_game* game) (game being played)
+ *
+ * @return (char*) (end of the frame)
+ */
+char* display_cpu_board(char* frame, const struct naval_game* game)
+{
+    int digits = row_digits(game->height);
+
+    if (game->kernels != NULL && game->engine == ENGINE_ARRAY) {
+        return game->kernels->cpuBoard(frame, game);
+    }
+    frame = column_header(frame, game, digits);
+    if (game->engine == ENGINE_SPARSE) {
+        return sparse_rows(frame, game, CPU, digits);
+    }
+
+    for (int i = 1; i < (game->height + 1); i++) {
+        frame = row_number(frame, i, digits);
+        for (int j = 1; j < (game->width + 1); j++) {
+            *frame++ = cpu_chars(naval_cell(game, CPU, j, i));
+        }
+        *frame++ = '\n';
+    }
+    return frame;
+}
+
+/* Appends the === separator, the column names and then each row of the
+ * player board to the frame.
+ *
+ * @param (char* frame) (end of the frame so far)
+ * @param (const struct naval_game* game) (game being played)
+ *
+ * @return (char*) (end of the frame)
+ */
+char* display_player_board(char* frame, const struct naval_game* game)
+{
+    int digits = row_digits(game->height);
+
+    if (game->kernels != NULL && game->engine == ENGINE_ARRAY) {
+        return game->kernels->playerBoard(frame, game);
+    }
+    memcpy(frame, "===\n", 4);
+    frame = column_header(frame + 4, game, digits);
+    if (game->engine == ENGINE_SPARSE) {
+        return sparse_rows(frame, game, PLAYER, digits);
+    }
+
+    for (int i = 1; i < (game->height + 1); i++) {
+        frame = row_number(frame, i, digits);
+        for (int j = 1; j < (game->width + 1); j++) {
+            *frame++ = player_chars(naval_cell(game, PLAYER, j, i));
+        }
+        *frame++ = '\n';
+    }
+    return frame;
+}
+
+/* Returns the length of the longest frame of both plain boards: a header
+ * for each, the board rows and the === line.
+ *
+ * @param (const struct naval_game* game) (game with its rules loaded)
+ */
+size_t naval_boards_size(const struct naval_game* game)
+{
+    size_t lines = column_letters(game->width) + game->height;
+
+    return 2 * lines * (row_digits(game->height) + game->width + 2) + 4;
+}
+
+/* Allocates a renderer writing to a file descriptor.
+ *
+ * @param (int fd) (file descriptor the frames are written to)
+ * @param (int diff) (1 to only repaint changed positions, 0 for the plain
+ *        boards every time)
+ *
+ * @return (struct naval_renderer*) (the new renderer, NULL if out of memory)
+ */
+struct naval_renderer* naval_renderer_create(int fd, int diff)
+{
+    struct naval_renderer* renderer = malloc(sizeof(struct naval_renderer));
+
+    STATS_ALLOC(1);
+    if (renderer != NULL) {
+        renderer->fd = fd;
+        renderer->diff = diff;
+        renderer->drawn = 0;
+        renderer->last = NULL;
+        renderer->frame = NULL;
+        renderer->capacity = 0;
+    }
+    return renderer;
+}
+
+/* Frees a renderer created with naval_renderer_create.
+ *
+ * @param (struct naval_renderer* renderer) (renderer to be freed)
+ */
+void naval_renderer_destroy(struct naval_renderer* renderer)
+{
+    if (renderer != NULL) {
+        free(renderer->last);
+        free(renderer->frame);
+    }
+    free(renderer);
+}
+
+/* Grows the frame to hold the boards of the game, with room in diff mode
+ * for the escape codes around them and a repaint of every position, up to
+ * REPAINTS_MAX of them.
+ *
+ * @param (struct naval_renderer* renderer) (renderer of the game)
+ * @param (const struct naval_game* game) (game to be drawn)
+ *
+ * @return (int) (0 on success, -1 if out of memory)
+ */
+static int size_frame(struct naval_renderer* renderer,
+        const struct naval_game* game)
+{
+    size_t repaints = 2 * (size_t)game->width * game->height;
+    size_t capacity = naval_boards_size(game) + 64;
+    char* frame;
+
+    if (renderer->diff) {
+        capacity += REPAINT_SIZE * ((repaints < REPAINTS_MAX) ? repaints :
+                REPAINTS_MAX);
+    }
+    if (capacity <= renderer->capacity) {
+        return 0;
+    }
+    STATS_ALLOC(1);
+    if ((frame = realloc(renderer->frame, capacity)) == NULL) {
+        return -1;
+    }
+    renderer->frame = frame;
+    renderer->capacity = capacity;
+    return 0;
+}
+
+/* Writes the whole buffer, retrying after short writes and interrupts.
+ *
+ * @param (int fd) (file descriptor to be written to)
+ * @param (const char* buffer) (bytes to be written)
+ * @param (size_t length) (number of bytes)
+ *
+ * @return (int) (0 on success, -1 on a write error)
+ */
+static int write_all(int fd, const char* buffer, size_t length)
+{
+    while (length > 0) {
+        ssize_t written = write(fd, buffer, length);
+
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (fd == STDOUT_FILENO) {
+            naval_stats_output(written);
+        }
+        buffer += written;
+        length -= written;
+    }
+    return 0;
+}
+
+/* Remembers the character shown at every position so the next frame can
+ * be compared against it.
+ *
+ * @param (struct naval_renderer* renderer) (renderer that drew the frame)
+ * @param (const struct naval_game* game) (game that was drawn)
+ *
+ * @return (int) (0 on success, -1 if out of memory)
+ */
+static int remember_cells(struct naval_renderer* renderer,
+        const struct naval_game* game)
+{
+    size_t size = (size_t)game->width * game->height;
+    char* last = renderer->last;
+
+    if (!renderer->drawn || renderer->width != game->width ||
+            renderer->height != game->height) {
+        STATS_ALLOC(1);
+        if ((last = realloc(renderer->last, 2 * size + 1)) == NULL) {
+            return -1;
+        }
+        renderer->last = last;
+    }
+    for (int i = 1; i < (game->height + 1); i++) {
+        for (int j = 1; j < (game->width + 1); j++) {
+            *last = cpu_chars(naval_cell(game, CPU, j, i));
+            last[size] = player_chars(naval_cell(game, PLAYER, j, i));
+            last++;
+        }
+    }
+    renderer->width = game->width;
+    renderer->height = game->height;
+    renderer->drawn = 1;
+    return 0;
+}
+
+/* Appends the escape codes repainting one position, leaving the cursor
+ * where the scrolling text below the boards left it.
+ *
+ * @param (char* frame) (end of the frame so far)
+ * @param (int row) (screen row of the position, from 1)
+ * @param (int column) (screen column of the position, from 1)
+ * @param (char c) (character to be shown there)
+ *
+ * @return (char*) (end of the frame)
+ */
+static char* repaint(char* frame, int row, int column, char c)
+{
+    return frame + sprintf(frame, "\0337\033[%d;%dH%c\0338", row, column, c);
+}
+
+/* Draws the cpu and then the player board.
+ *
+ * @param (struct naval_renderer* renderer) (renderer of the game)
+ * @param (const struct naval_game* game) (game being played)
+ *
+ * @return (int) (0 on success, -1 on a write error or out of memory)
+ */
+static int draw(struct naval_renderer* renderer,
+        const struct naval_game* game)
+{
+    size_t size = (size_t)game->width * game->height;
+    int letters = column_letters(game->width);
+    int digits = row_digits(game->height);
+    // rows of both boards: a header for each, the board rows and the ===
+    int lines = 2 * (game->height + letters) + 1;
+    char* frame;
+    char* last;
+
+    if (size_frame(renderer, game)) {
+        return -1;
+    }
+    frame = renderer->frame;
+    if (!renderer->diff) {
+        frame = display_cpu_board(frame, game);
+        frame = display_player_board(frame, game);
+        return write_all(renderer->fd, renderer->frame, frame - renderer->frame);
+    }
+
+    if (!renderer->drawn || renderer->width != game->width ||
+            renderer->height != game->height) {
+        // clear the screen, draw both boards and scroll text beneath them
+        frame += sprintf(frame, "\033[r\033[H\033[2J");
+        frame = display_cpu_board(frame, game);
+        frame = display_player_board(frame, game);
+        frame += sprintf(frame, "\033[%dr\033[%d;1H", lines + 1, lines + 1);
+        if (remember_cells(renderer, game)) {
+            return -1;
+        }
+        return write_all(renderer->fd, renderer->frame, frame - renderer->frame);
+    }
+
+    last = renderer->last;
+    for (int i = 1; i < (game->height + 1); i++) {
+        for (int j = 1; j < (game->width + 1); j++, last++) {
+            char cpu = cpu_chars(naval_cell(game, CPU, j, i));
+            char player = player_chars(naval_cell(game, PLAYER, j, i));
+
+            if (renderer->frame + renderer->capacity - frame <
+                    2 * REPAINT_SIZE) {
+                if (write_all(renderer->fd, renderer->frame,
+                        frame - renderer->frame)) {
+                    return -1;
+                }
+                frame = renderer->frame;
+            }
+            if (cpu != *last) {
+                frame = repaint(frame, letters + i, digits + 1 + j, cpu);
+                *last = cpu;
+            }
+            if (player != last[size]) {
+                frame = repaint(frame, game->height + 2 * letters + 1 + i,
+                        digits + 1 + j, player);
+                last[size] = player;
+            }
+        }
+    }
+    return write_all(renderer->fd, renderer->frame, frame - renderer->frame);
+}
+
+/* Draws the boards as draw does, timing it for --stats.
+ *
+ * @param (struct naval_renderer* renderer) (renderer of the game)
+ * @param (const struct naval_game* game) (game being played)
+ *
+ * @return (int) (0 on success, -1 on a write error)
+ */
+int naval_render(struct naval_renderer* renderer,
+        const struct naval_game* game)
+{
+    unsigned long long start = STATS_START();
+    int error = draw(renderer, game);
+
+    STATS_STOP(PHASE_RENDER, start);
+    return error;
+}
+
+/* Builds the plain boards into a buffer, timing it for --stats.
+ *
+ * @param (const struct naval_game* game) (game being played)
+ * @param (char* buffer) (buffer of naval_boards_size bytes)
+ *
+ * @return (size_t) (length of the frame)
+ */
+size_t naval_render_boards(const struct naval_game* game, char* buffer)
+{
+    unsigned long long start = STATS_START();
+    char* frame = display_player_board(display_cpu_board(buffer, game), game);
+
+    STATS_STOP(PHASE_RENDER, start);
+    return frame - buffer;
+}
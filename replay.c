@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "naval.h"
+#include "commands.h"
+
+/* Prints the boards of a journal as they stood after a move, with the move
+ * that led there.
+ *
+ * @param (const char* path) (filename of the journal)
+ * @param (int move) (move to seek to, from 0)
+ * @param (const struct options* options) (settings of the game)
+ *
+ * @return (int) (0 on success, E_JOURNAL otherwise)
+ */
+static int show_move(const char* path, int move, const struct options* options)
+{
+    static const char* outcomes[] = {"bad", "repeated", "miss", "hit",
+            "sunk"};
+    struct naval_replay replay;
+    struct naval_game* game;
+    char name[NAVAL_MOVE_MAX];
+    char* boards;
+    int player, x, y;
+    int shot = SHOT_BAD;
+    int error;
+
+    if ((error = naval_replay_open(&replay, path))) {
+        return error;
+    }
+    if ((game = naval_create()) == NULL) {
+        naval_replay_close(&replay);
+        return E_JOURNAL;
+    }
+    naval_set_engine(game, options->engine);
+    error = naval_replay_seek(&replay, game, move);
+    if (!error && move > 0) {
+        shot = naval_replay_shot(&replay, move, &player, &x, &y);
+        // the seek checks the shot, but the names are never read past
+        if (shot > SHOT_SUNK || (player != PLAYER && player != CPU)) {
+            error = E_JOURNAL;
+        }
+    }
+    if (!error) {
+        printf("Move %d of %d", move, replay.moves);
+        if (move > 0) {
+            naval_move_name(x, y, name);
+            printf(": %s %s %s", (player == PLAYER) ? "player" : "cpu", name,
+                    outcomes[shot]);
+        }
+        printf("\n");
+        if ((boards = malloc(naval_boards_size(game))) == NULL) {
+            error = E_JOURNAL;
+        } else {
+            fwrite(boards, 1, naval_render_boards(game, boards), stdout);
+            free(boards);
+        }
+    }
+    naval_destroy(game);
+    naval_replay_close(&replay);
+    return error;
+}
+
+/* Replays a whole journal, checking every shot against the boards.
+ *
+ * @param (const char* path) (filename of the journal)
+ * @param (const struct options* options) (settings of the game)
+ * @param (struct naval_result* result) (filled in with the outcome)
+ *
+ * @return (int) (0 if the journal checks out, E_JOURNAL otherwise)
+ */
+static int check_journal(const char* path, const struct options* options,
+        struct naval_result* result)
+{
+    struct naval_replay replay;
+    struct naval_game* game;
+    int error;
+
+    memset(result, 0, sizeof(*result));
+    if ((error = naval_replay_open(&replay, path))) {
+        return error;
+    }
+    if ((game = naval_create()) == NULL) {
+        naval_replay_close(&replay);
+        return E_JOURNAL;
+    }
+    naval_set_engine(game, options->engine);
+    error = naval_replay_check(&replay, game, result);
+    naval_destroy(game);
+    naval_replay_close(&replay);
+    return error;
+}
+
+/* Replays journals written with --journal. With --seek N the boards of
+ * each journal after move N are printed; otherwise each journal is played
+ * through and checked, printing one result line per journal as --batch
+ * does, with code 180 for a journal that does not check out.
+ *
+ * @param (int argc) (number of arguments after replay)
+ * @param (char* argv[]) (arguments after replay: --seek N and journals)
+ * @param (const struct options* options) (settings of every game)
+ *
+ * @return (int) (exit code of the naval process)
+ */
+int run_replay(int argc, char* argv[], const struct options* options)
+{
+    int first = 0;
+    int seek = -1;
+    int error;
+
+    if (argc >= 2 && strcmp(argv[0], "--seek") == 0) {
+        if ((seek = atoi(argv[1])) < 0) {
+            return E_NOT_ENOUGH_PARAMETERS;
+        }
+        first = 2;
+    }
+    if (first == argc) {
+        return E_NOT_ENOUGH_PARAMETERS;
+    }
+    for (int i = first; i < argc; i++) {
+        struct naval_result result;
+
+        if (seek >= 0) {
+            if ((error = show_move(argv[i], seek, options))) {
+                return error;
+            }
+        } else {
+            error = check_journal(argv[i], options, &result);
+            print_result(i - first + 1, &result, error);
+        }
+    }
+    return 0;
+}
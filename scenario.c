@@ -0,0 +1,313 @@
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "game.h"
+
+#define SCENARIO_MAGIC "NAVALSCN"
+#define SCENARIO_VERSION 2
+
+/* Start of a compiled scenario, in host byte order. It is followed by the
+ * length of every turn line, the decoded turns and the text of the lines,
+ * which are all covered by the checksum along with the rest of the header.
+ */
+struct scenario_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t checksum;
+    int32_t width;
+    int32_t height;
+    int32_t numShips;
+    int32_t shipSizes[MAX_SHIPS];
+    int8_t ships[2][MAX + 2][MAX + 2];
+    uint32_t turns;
+    uint32_t textLength;
+};
+
+/* Returns the FNV-1a hash of the bytes, continuing from hash.
+ *
+ * @param (uint32_t hash) (hash of the bytes before these)
+ * @param (const void* data) (bytes to be hashed)
+ * @param (size_t length) (number of bytes)
+ */
+static uint32_t fnv1a(uint32_t hash, const void* data, size_t length)
+{
+    const unsigned char* bytes = data;
+
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/* Returns the checksum of a whole scenario, skipping the checksum field.
+ *
+ * @param (const unsigned char* data) (start of the scenario)
+ * @param (size_t length) (length of the scenario)
+ */
+static uint32_t scenario_checksum(const unsigned char* data, size_t length)
+{
+    size_t skip = offsetof(struct scenario_header, checksum);
+    uint32_t hash = fnv1a(2166136261u, data, skip);
+
+    skip += sizeof(uint32_t);
+    return fnv1a(hash, data + skip, length - skip);
+}
+
+/* Checks that every ship of a scenario covers as many cells of both
+ * boards as its size in the rules, since restore_board takes the number
+ * of cells left afloat from the boards alone.
+ *
+ * @param (const struct scenario_header* header) (header of the scenario,
+ *        with its size and number of ships already checked)
+ *
+ * @return (int) (1 if both fleets match the rules, 0 otherwise)
+ */
+static int fleets_match(const struct scenario_header* header)
+{
+    int cells[MAX_SHIPS];
+
+    for (int k = 0; k < 2; k++) {
+        memset(cells, 0, sizeof(cells));
+        for (int i = 1; i < (header->height + 1); i++) {
+            for (int j = 1; j < (header->width + 1); j++) {
+                int ship = header->ships[k][i][j];
+
+                if (ship >= 1 && ship <= header->numShips) {
+                    cells[ship - 1]++;
+                }
+            }
+        }
+        for (int i = 0; i < header->numShips; i++) {
+            if (cells[i] != header->shipSizes[i]) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+/* Writes the rules, placed boards and decoded turns of a game as a
+ * scenario that naval_scenario_load can start without any parsing.
+ *
+ * @param (const struct naval_game* game) (game with rules and maps loaded
+ *        and no shots fired)
+ * @param (const struct naval_turns* turns) (decoded cpu turns)
+ * @param (FILE* file) (file opened for writing)
+ *
+ * @return (int) (0 on success, -1 if it could not be written)
+ */
+int naval_scenario_write(const struct naval_game* game,
+        const struct naval_turns* turns, FILE* file)
+{
+    struct scenario_header header;
+    unsigned char* data;
+    unsigned char* p;
+    size_t length;
+    int written;
+
+    if (game->width > MAX || game->height > MAX) {
+        return -1;
+    }
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SCENARIO_MAGIC, sizeof(header.magic));
+    header.version = SCENARIO_VERSION;
+    header.width = game->width;
+    header.height = game->height;
+    header.numShips = game->numShips;
+    for (int i = 0; i < game->numShips; i++) {
+        header.shipSizes[i] = game->shipSizes[i];
+    }
+    for (int i = 1; i < (game->height + 1); i++) {
+        for (int j = 1; j < (game->width + 1); j++) {
+            header.ships[0][i][j] = naval_cell(game, PLAYER, j, i);
+            header.ships[1][i][j] = naval_cell(game, CPU, j, i);
+        }
+    }
+    header.turns = turns->count;
+    for (int i = 0; i < turns->count; i++) {
+        header.textLength += turns->lengths[i];
+    }
+
+    length = sizeof(header) + header.turns * (sizeof(uint32_t) +
+            sizeof(struct naval_turn)) + header.textLength;
+    STATS_ALLOC(1);
+    if ((data = malloc(length)) == NULL) {
+        return -1;
+    }
+    p = data + sizeof(header);
+    for (int i = 0; i < turns->count; i++) {
+        uint32_t lineLength = turns->lengths[i];
+
+        memcpy(p, &lineLength, sizeof(lineLength));
+        p += sizeof(lineLength);
+    }
+    for (int i = 0; i < turns->count; i++) {
+        struct naval_turn move;
+
+        // copied field by field so the padding is zero in the checksum
+        memset(&move, 0, sizeof(move));
+        move.x = turns->moves[i].x;
+        move.y = turns->moves[i].y;
+        move.kind = turns->moves[i].kind;
+        memcpy(p, &move, sizeof(move));
+        p += sizeof(move);
+    }
+    for (int i = 0; i < turns->count; i++) {
+        memcpy(p, turns->lines[i], turns->lengths[i]);
+        p += turns->lengths[i];
+    }
+    memcpy(data, &header, sizeof(header));
+    header.checksum = scenario_checksum(data, length);
+    memcpy(data, &header, sizeof(header));
+
+    written = fwrite(data, 1, length, file) == length;
+    free(data);
+    return written ? 0 : -1;
+}
+
+/* Maps a compiled scenario and checks its version, size and checksum.
+ *
+ * @param (struct naval_scenario* scenario) (set to the mapped scenario)
+ * @param (const char* path) (filename of the scenario)
+ *
+ * @return (int) (0 on success, E_SCENARIO otherwise)
+ */
+int naval_scenario_open(struct naval_scenario* scenario, const char* path)
+{
+    struct scenario_header header;
+    struct stat info;
+    void* map;
+    int fd;
+
+    memset(scenario, 0, sizeof(*scenario));
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        return E_SCENARIO;
+    }
+    if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(header)) {
+        close(fd);
+        return E_SCENARIO;
+    }
+    map = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return E_SCENARIO;
+    }
+    scenario->data = map;
+    scenario->length = info.st_size;
+
+    memcpy(&header, map, sizeof(header));
+    if (memcmp(header.magic, SCENARIO_MAGIC, sizeof(header.magic)) ||
+            header.version != SCENARIO_VERSION ||
+            header.width < 0 || header.width > MAX ||
+            header.height < 0 || header.height > MAX ||
+            header.numShips < 0 || header.numShips > MAX_SHIPS ||
+            scenario->length != sizeof(header) + (size_t)header.turns *
+                (sizeof(uint32_t) + sizeof(struct naval_turn)) +
+                header.textLength ||
+            header.checksum != scenario_checksum(scenario->data,
+                scenario->length)) {
+        naval_scenario_close(scenario);
+        return E_SCENARIO;
+    }
+    return 0;
+}
+
+/* Unmaps a scenario opened with naval_scenario_open.
+ *
+ * @param (struct naval_scenario* scenario) (scenario to be closed)
+ */
+void naval_scenario_close(struct naval_scenario* scenario)
+{
+    if (scenario->data != NULL) {
+        munmap((void*)scenario->data, scenario->length);
+    }
+    memset(scenario, 0, sizeof(*scenario));
+}
+
+/* Sets up a game and its cpu turns from an open scenario. The boards are
+ * copied as placed and the turns as decoded, so nothing is parsed or
+ * checked again. The lines of the turns point into the scenario, which
+ * must stay open while they are used.
+ *
+ * @param (const struct naval_scenario* scenario) (scenario to be loaded)
+ * @param (struct naval_game* game) (game to be set up)
+ * @param (struct naval_turns* turns) (filled in with the cpu turns)
+ *
+ * @return (int) (0 on success, E_SCENARIO if a ship does not cover as
+ *         many cells of either board as its size, a turn is not one
+ *         decoding gives, the line lengths do not add up to the text or
+ *         out of memory)
+ */
+int naval_scenario_load(const struct naval_scenario* scenario,
+        struct naval_game* game, struct naval_turns* turns)
+{
+    struct scenario_header header;
+    const unsigned char* p = scenario->data + sizeof(header);
+    const char* text;
+    uint32_t textLength = 0;
+    int valid;
+    int count;
+
+    memcpy(&header, scenario->data, sizeof(header));
+    if (!fleets_match(&header)) {
+        return E_SCENARIO;
+    }
+    game->numShips = header.numShips;
+    for (int i = 0; i < header.numShips; i++) {
+        game->shipSizes[i] = header.shipSizes[i];
+    }
+    if (size_boards(game, header.width, header.height)) {
+        return E_SCENARIO;
+    }
+    restore_board(game, PLAYER, &header.ships[0][0][0]);
+    restore_board(game, CPU, &header.ships[1][0][0]);
+
+    memset(turns, 0, sizeof(*turns));
+    count = header.turns;
+    STATS_ALLOC((count > 0) * 3);
+    if (count > 0 && ((turns->moves = malloc(count *
+            sizeof(struct naval_turn))) == NULL ||
+            (turns->lines = malloc(count * sizeof(char*))) == NULL ||
+            (turns->lengths = malloc(count * sizeof(int))) == NULL)) {
+        naval_turns_free(turns);
+        return E_SCENARIO;
+    }
+    turns->count = turns->capacity = count;
+    text = (const char*)p + count * (sizeof(uint32_t) +
+            sizeof(struct naval_turn));
+    for (int i = 0; i < count; i++) {
+        uint32_t lineLength;
+
+        memcpy(&lineLength, p + i * sizeof(uint32_t), sizeof(lineLength));
+        if (lineLength > header.textLength - textLength) {
+            naval_turns_free(turns);
+            return E_SCENARIO;
+        }
+        textLength += lineLength;
+        turns->lengths[i] = lineLength;
+        turns->lines[i] = text;
+        text += lineLength;
+    }
+    memcpy(turns->moves, p + count * sizeof(uint32_t),
+            count * sizeof(struct naval_turn));
+    // the lines are echoed and the kinds index the replies, so neither is
+    // trusted to the checksum
+    valid = (textLength == header.textLength);
+    for (int i = 0; i < count && valid; i++) {
+        const struct naval_turn* move = &turns->moves[i];
+
+        valid = (move->kind == SHOT_BAD || ((move->kind == SHOT_REPEATED ||
+                move->kind == SHOT_MISS) && check_bad_guess(move->x, move->y,
+                game->width, game->height)));
+    }
+    if (!valid) {
+        naval_turns_free(turns);
+        return E_SCENARIO;
+    }
+    return 0;
+}
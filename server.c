@@ -0,0 +1,627 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "naval.h"
+#include "commands.h"
+
+// Most loop threads started, whatever --threads asks for
+#define SERVER_MAX_THREADS 64
+// Events taken from epoll in one wait
+#define SERVER_EVENTS 256
+// Bytes read from a connection in one call
+#define SERVER_READ 4096
+// Connections accepted in one wake up before serving the others again
+#define SERVER_ACCEPTS 64
+// Connections the kernel holds waiting to be accepted
+#define SERVER_BACKLOG 4096
+
+// Bytes built up to be sent, growing as needed
+struct buffer {
+    char* data;
+    size_t length;
+    size_t capacity;
+};
+
+/* One game played over one connection. Lines are gathered from the socket
+ * with # comments skipped as read_line does, and whatever the socket will
+ * not take yet is kept in pending, during which nothing more is read from
+ * the player. Once the game is over (closing) and everything is sent, the
+ * rest of what the player sends is read and dropped until they hang up, so
+ * the last replies are not lost to a reset.
+ */
+struct session {
+    int fd;
+    int closing;
+    int hungUp;
+    struct naval_game* game;
+    struct naval_ai* ai;
+    struct naval_turns turns;
+    struct naval_session play;
+    char line[NAVAL_LINE_MAX];
+    int position;
+    int depth;
+    struct buffer pending;
+    struct session* prev;
+    struct session* next;
+};
+
+// What every session starts from, shared read only by all loops
+struct server {
+    const struct naval_game* game;
+    const struct naval_turns* turns;
+    const struct options* options;
+    int listener;
+    int wake;
+};
+
+/* One epoll thread and the sessions it owns. Only this thread touches
+ * them, so nothing is locked.
+ */
+struct loop {
+    struct server* server;
+    pthread_t thread;
+    int epoll;
+    struct session* sessions;
+    struct buffer out;
+};
+
+// Written to by the signal handler to stop every loop
+static int wakeFd = -1;
+
+/* Stands in epoll_data for the wake eventfd, which has no session. The
+ * listener is tagged NULL and every other descriptor with its session.
+ */
+static const char wakeTag;
+
+/* Grows a buffer to have room for more bytes after those it holds.
+ *
+ * @param (struct buffer* buffer) (buffer to be grown)
+ * @param (size_t length) (number of bytes to make room for)
+ *
+ * @return (int) (0 on success, -1 if out of memory)
+ */
+static int reserve(struct buffer* buffer, size_t length)
+{
+    if (buffer->length + length > buffer->capacity) {
+        size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+        char* grown;
+
+        while (capacity < buffer->length + length) {
+            capacity *= 2;
+        }
+        if ((grown = realloc(buffer->data, capacity)) == NULL) {
+            return -1;
+        }
+        buffer->data = grown;
+        buffer->capacity = capacity;
+    }
+    return 0;
+}
+
+/* Appends bytes to a buffer.
+ *
+ * @param (struct buffer* buffer) (buffer to be added to)
+ * @param (const char* data) (bytes to be added)
+ * @param (size_t length) (number of bytes)
+ *
+ * @return (int) (0 on success, -1 if out of memory)
+ */
+static int append(struct buffer* buffer, const char* data, size_t length)
+{
+    if (reserve(buffer, length)) {
+        return -1;
+    }
+    memcpy(buffer->data + buffer->length, data, length);
+    buffer->length += length;
+    return 0;
+}
+
+/* Appends a NUL terminated string to a buffer.
+ *
+ * @param all the same as append function
+ */
+static int append_text(struct buffer* buffer, const char* text)
+{
+    return append(buffer, text, strlen(text));
+}
+
+/* Runs the game of a session until it waits for the player's next line or
+ * is over, adding the output of each step. A cpu that gives up says so to
+ * the player, where the CLI would print it to stderr.
+ *
+ * @param (struct loop* loop) (loop owning the session)
+ * @param (struct session* session) (session being played)
+ */
+static void run_steps(struct loop* loop, struct session* session)
+{
+    const char* text;
+    size_t length;
+    int step;
+
+    while ((step = naval_session_step(&session->play, &text, &length)) !=
+            STEP_INPUT) {
+        if (step == STEP_TEXT) {
+            append(&loop->out, text, length);
+        } else if (step == STEP_BOARDS) {
+            // built straight into the output
+            if (!reserve(&loop->out, naval_boards_size(session->game))) {
+                loop->out.length += naval_render_boards(session->game,
+                        loop->out.data + loop->out.length);
+            }
+        } else {
+            if (session->play.code == E_CPU_GIVES_UP) {
+                append_text(&loop->out, naval_strerror(E_CPU_GIVES_UP));
+                append(&loop->out, "\n", 1);
+            }
+            session->closing = 1;
+            return;
+        }
+    }
+}
+
+/* Feeds bytes read from the player into the line being gathered, playing
+ * each line as it ends.
+ *
+ * @param (struct loop* loop) (loop owning the session)
+ * @param (struct session* session) (session being played)
+ * @param (const char* data) (bytes read)
+ * @param (size_t length) (number of bytes)
+ */
+static void feed(struct loop* loop, struct session* session,
+        const char* data, size_t length)
+{
+    for (size_t i = 0; i < length && !session->closing; i++) {
+        char next = data[i];
+
+        if (session->depth > 0) {
+            if (next == '#') {
+                session->depth++;
+            } else if (next == '\n') {
+                session->depth--;
+            }
+        } else if (next == '#') {
+            session->depth = 1;
+        } else if (next == '\n') {
+            naval_session_input(&session->play, session->line,
+                    session->position);
+            session->position = 0;
+            run_steps(loop, session);
+        } else if (session->position < NAVAL_LINE_MAX - 1) {
+            session->line[session->position++] = next;
+        }
+    }
+}
+
+/* Frees a session and closes its connection.
+ *
+ * @param (struct loop* loop) (loop owning the session)
+ * @param (struct session* session) (session to be ended)
+ */
+static void end_session(struct loop* loop, struct session* session)
+{
+    if (session->prev != NULL) {
+        session->prev->next = session->next;
+    } else {
+        loop->sessions = session->next;
+    }
+    if (session->next != NULL) {
+        session->next->prev = session->prev;
+    }
+    close(session->fd);
+    naval_ai_destroy(session->ai);
+    naval_destroy(session->game);
+    free(session->pending.data);
+    free(session);
+}
+
+/* Sends what the session has pending, waiting for the socket to take the
+ * rest before reading anything more from the player.
+ *
+ * @param (struct loop* loop) (loop owning the session)
+ * @param (struct session* session) (session to be written to)
+ *
+ * @return (int) (0 if the session goes on, -1 if it was ended)
+ */
+static int send_pending(struct loop* loop, struct session* session)
+{
+    struct buffer* pending = &session->pending;
+    struct epoll_event event;
+    size_t sent = 0;
+
+    while (sent < pending->length) {
+        ssize_t written = send(session->fd, pending->data + sent,
+                pending->length - sent, MSG_NOSIGNAL);
+
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                end_session(loop, session);
+                return -1;
+            }
+            break;
+        }
+        sent += written;
+    }
+    memmove(pending->data, pending->data + sent, pending->length - sent);
+    pending->length -= sent;
+    if (pending->length == 0 && session->closing) {
+        if (session->hungUp || shutdown(session->fd, SHUT_WR)) {
+            end_session(loop, session);
+            return -1;
+        }
+    }
+
+    event.events = (pending->length > 0) ? EPOLLOUT : EPOLLIN;
+    event.data.ptr = session;
+    epoll_ctl(loop->epoll, EPOLL_CTL_MOD, session->fd, &event);
+    return 0;
+}
+
+/* Sends the output built for a session, keeping what the socket will not
+ * take yet.
+ *
+ * @param (struct loop* loop) (loop owning the session)
+ * @param (struct session* session) (session to be written to)
+ *
+ * @return (int) (0 if the session goes on, -1 if it was ended)
+ */
+static int flush(struct loop* loop, struct session* session)
+{
+    int wasPending = session->pending.length > 0;
+
+    if (append(&session->pending, loop->out.data, loop->out.length)) {
+        loop->out.length = 0;
+        end_session(loop, session);
+        return -1;
+    }
+    loop->out.length = 0;
+    if (wasPending) {
+        return 0;
+    }
+    return send_pending(loop, session);
+}
+
+/* Reads what the player has sent and plays it. A player who hangs up gives
+ * up, as at the end of stdin, after any last unfinished line is played.
+ *
+ * @param (struct loop* loop) (loop owning the session)
+ * @param (struct session* session) (session that can be read)
+ */
+static void receive(struct loop* loop, struct session* session)
+{
+    char data[SERVER_READ];
+    ssize_t length = recv(session->fd, data, sizeof(data), 0);
+
+    if (length < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            end_session(loop, session);
+        }
+        return;
+    }
+    if (session->closing) {
+        // everything is sent, so only the player hanging up is waited for
+        if (length == 0) {
+            end_session(loop, session);
+        }
+        return;
+    }
+    if (length == 0) {
+        if (session->position > 0) {
+            session->depth = 0;
+            feed(loop, session, "\n", 1);
+        }
+        if (!session->closing) {
+            naval_session_input(&session->play, "", 0);
+            run_steps(loop, session);
+        }
+        session->hungUp = 1;
+    } else {
+        feed(loop, session, data, length);
+    }
+    flush(loop, session);
+}
+
+/* Starts a session on a newly accepted connection, sending the boards and
+ * the first prompt.
+ *
+ * @param (struct loop* loop) (loop the connection was accepted on)
+ * @param (int fd) (non-blocking connection)
+ */
+static void start_session(struct loop* loop, int fd)
+{
+    const struct server* server = loop->server;
+    struct session* session = calloc(1, sizeof(struct session));
+    struct epoll_event event;
+    int one = 1;
+
+    if (session == NULL || (session->game = naval_copy(server->game)) ==
+            NULL) {
+        free(session);
+        close(fd);
+        return;
+    }
+    session->fd = fd;
+    // the decoded turns are shared, only the next turn is the session's own
+    session->turns = *server->turns;
+    session->turns.next = 0;
+    if (server->options->cpu != CPU_SCRIPTED) {
+        session->ai = naval_ai_create(session->game, CPU);
+        if (session->ai != NULL && server->options->endgame > 0) {
+            naval_ai_endgame(session->ai, 1, server->options->endgame);
+        }
+    }
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    session->next = loop->sessions;
+    if (loop->sessions != NULL) {
+        loop->sessions->prev = session;
+    }
+    loop->sessions = session;
+    event.events = EPOLLIN;
+    event.data.ptr = session;
+    if (epoll_ctl(loop->epoll, EPOLL_CTL_ADD, fd, &event)) {
+        end_session(loop, session);
+        return;
+    }
+
+    if (server->options->cpu != CPU_SCRIPTED && session->ai == NULL) {
+        append_text(&loop->out, naval_strerror(E_CPU_GIVES_UP));
+        append(&loop->out, "\n", 1);
+        session->closing = 1;
+    } else {
+        naval_session_start(&session->play, session->game, &session->turns,
+                session->ai);
+        run_steps(loop, session);
+    }
+    flush(loop, session);
+}
+
+/* Accepts waiting connections, leaving the rest to the next wake up so one
+ * burst of connections does not hold up the moves of the others.
+ *
+ * @param (struct loop* loop) (loop woken by the listener)
+ */
+static void accept_sessions(struct loop* loop)
+{
+    for (int i = 0; i < SERVER_ACCEPTS; i++) {
+        int fd = accept4(loop->server->listener, NULL, NULL,
+                SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+        if (fd < 0) {
+            return;
+        }
+        start_session(loop, fd);
+    }
+}
+
+/* Serves the sessions of one loop until the server is stopped.
+ *
+ * @param (void* argument) (the loop)
+ *
+ * @return (void*) (NULL)
+ */
+static void* run_loop(void* argument)
+{
+    struct loop* loop = argument;
+    struct epoll_event events[SERVER_EVENTS];
+
+    for (;;) {
+        int count = epoll_wait(loop->epoll, events, SERVER_EVENTS, -1);
+
+        for (int i = 0; i < count; i++) {
+            struct session* session = events[i].data.ptr;
+
+            if (events[i].data.ptr == NULL) {
+                accept_sessions(loop);
+            } else if (events[i].data.ptr == &wakeTag) {
+                return NULL;
+            } else if (session->pending.length > 0) {
+                send_pending(loop, session);
+            } else if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                receive(loop, session);
+            }
+        }
+    }
+}
+
+/* Wakes every loop so the server stops.
+ *
+ * @param (int number) (SIGINT or SIGTERM)
+ */
+static void stop_server(int number)
+{
+    uint64_t one = 1;
+
+    if (write(wakeFd, &one, sizeof(one)) < 0) {
+        _exit(1);
+    }
+}
+
+/* Opens a non-blocking listening socket on the address: unix:path for a
+ * Unix socket, otherwise host:port or just port for TCP on every address.
+ *
+ * @param (const char* address) (address to listen on)
+ *
+ * @return (int) (the listening socket, -1 if it could not be opened)
+ */
+static int open_listener(const char* address)
+{
+    const char* colon = strrchr(address, ':');
+    struct addrinfo hints, *found;
+    char host[NAVAL_LINE_MAX] = "";
+    int listener = -1;
+    int one = 1;
+
+    if (strncmp(address, "unix:", 5) == 0) {
+        struct sockaddr_un local = {.sun_family = AF_UNIX};
+        struct stat status;
+
+        if (strlen(address + 5) >= sizeof(local.sun_path)) {
+            return -1;
+        }
+        strcpy(local.sun_path, address + 5);
+        // a socket left behind by an earlier server is replaced
+        if (stat(local.sun_path, &status) == 0 && S_ISSOCK(status.st_mode)) {
+            unlink(local.sun_path);
+        }
+        listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                0);
+        if (listener >= 0 && (bind(listener, (struct sockaddr*)&local,
+                sizeof(local)) || listen(listener, SERVER_BACKLOG))) {
+            close(listener);
+            return -1;
+        }
+        return listener;
+    }
+
+    if (colon != NULL) {
+        // [::1]:port names an IPv6 host
+        const char* start = (address[0] == '[') ? address + 1 : address;
+        size_t length = colon - start - (colon > start && colon[-1] == ']');
+
+        if (length >= sizeof(host)) {
+            return -1;
+        }
+        memcpy(host, start, length);
+        host[length] = '\0';
+    }
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    if (getaddrinfo(host[0] ? host : NULL, colon ? colon + 1 : address,
+            &hints, &found)) {
+        return -1;
+    }
+    for (struct addrinfo* entry = found; entry != NULL && listener < 0;
+            entry = entry->ai_next) {
+        listener = socket(entry->ai_family, entry->ai_socktype |
+                SOCK_NONBLOCK | SOCK_CLOEXEC, entry->ai_protocol);
+        if (listener < 0) {
+            continue;
+        }
+        setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(listener, entry->ai_addr, entry->ai_addrlen) ||
+                listen(listener, SERVER_BACKLOG)) {
+            close(listener);
+            listener = -1;
+        }
+    }
+    freeaddrinfo(found);
+    return listener;
+}
+
+/* Lets the process hold as many connections as the hard limit allows.
+ */
+static void raise_file_limit(void)
+{
+    struct rlimit limit;
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 &&
+            limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+/* Serves the loaded game to every player who connects, each connection
+ * playing its own copy with the same prompts and replies as the CLI.
+ * Sessions are spread over threads epoll loops, every core unless
+ * --threads is given, until SIGINT or SIGTERM. The mcts cpu is refused,
+ * since its searches would run on the loops.
+ *
+ * @param (const char* address) (address to listen on)
+ * @param (const struct naval_game* game) (game with rules and maps loaded)
+ * @param (const struct naval_turns* turns) (decoded cpu turns)
+ * @param (const struct options* options) (settings of every game)
+ *
+ * @return (int) (exit code of the naval process)
+ */
+int run_server(const char* address, const struct naval_game* game,
+        const struct naval_turns* turns, const struct options* options)
+{
+    struct server server = {game, turns, options, -1, -1};
+    struct loop* loops;
+    struct sigaction action;
+    int threads = options->threads;
+    int started = 0;
+
+    // a search would hold up every session of its loop for the think time
+    if (options->cpu == CPU_MCTS) {
+        return E_SERVER_CPU;
+    }
+    if (threads < 1) {
+        threads = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (threads < 1) {
+        threads = 1;
+    } else if (threads > SERVER_MAX_THREADS) {
+        threads = SERVER_MAX_THREADS;
+    }
+    raise_file_limit();
+    if ((server.listener = open_listener(address)) < 0) {
+        return E_SERVER;
+    }
+    if ((server.wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0 ||
+            (loops = calloc(threads, sizeof(struct loop))) == NULL) {
+        close(server.listener);
+        return E_SERVER;
+    }
+    wakeFd = server.wake;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stop_server;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    for (int i = 0; i < threads; i++) {
+        struct epoll_event listen = {EPOLLIN | EPOLLEXCLUSIVE, {.ptr = NULL}};
+        struct epoll_event wake = {EPOLLIN, {.ptr = (void*)&wakeTag}};
+
+        loops[i].server = &server;
+        if ((loops[i].epoll = epoll_create1(EPOLL_CLOEXEC)) < 0 ||
+                epoll_ctl(loops[i].epoll, EPOLL_CTL_ADD, server.listener,
+                &listen) || epoll_ctl(loops[i].epoll, EPOLL_CTL_ADD,
+                server.wake, &wake) || pthread_create(&loops[i].thread,
+                NULL, run_loop, &loops[i])) {
+            break;
+        }
+        started++;
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(loops[i].thread, NULL);
+        while (loops[i].sessions != NULL) {
+            end_session(&loops[i], loops[i].sessions);
+        }
+        free(loops[i].out.data);
+    }
+    for (int i = 0; i < threads; i++) {
+        if (loops[i].epoll > 0) {
+            close(loops[i].epoll);
+        }
+    }
+    close(server.wake);
+    close(server.listener);
+    if (strncmp(address, "unix:", 5) == 0) {
+        unlink(address + 5);
+    }
+    free(loops);
+    return started ? 0 : E_SERVER;
+}
@@ -0,0 +1,237 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "game.h"
+
+// Where a session is between steps
+enum States {
+    STATE_TURN,
+    STATE_PROMPT,
+    STATE_INPUT,
+    STATE_MOVE,
+    STATE_CPU,
+    STATE_ECHO,
+    STATE_FIRE,
+    STATE_OVER
+};
+
+// What each outcome of a move is answered with
+static const char* shotReplies[] = {"Bad guess\n", "Repeated guess\n",
+        "Miss\n", "Hit\n", "Hit\nShip sunk\n"};
+
+/* Starts a session at the top of the game loop, before the first check for
+ * a winner.
+ *
+ * @param (struct naval_session* session) (session to be started)
+ * @param (struct naval_game* game) (game with rules and maps loaded)
+ * @param (struct naval_turns* turns) (decoded cpu turns, unused with an ai)
+ * @param (struct naval_ai* ai) (ai making the cpu's moves, or NULL)
+ */
+void naval_session_start(struct naval_session* session,
+        struct naval_game* game, struct naval_turns* turns,
+        struct naval_ai* ai)
+{
+    session->game = game;
+    session->turns = turns;
+    session->ai = ai;
+    session->state = STATE_TURN;
+    session->code = 0;
+    session->start = 0;
+    session->line[0] = '\0';
+}
+
+/* Appends the result line if either side has won.
+ *
+ * @param (struct naval_session* session) (session being played)
+ * @param (char* text) (end of the text so far)
+ *
+ * @return (char*) (end of the text, NULL if the game is still going)
+ */
+static char* game_over(struct naval_session* session, char* text)
+{
+    switch (check_win(session->game)) {
+        case PLAYER:
+            return stpcpy(text, "Game over - you win\n");
+        case CPU:
+            return stpcpy(text, "Game over - you lose\n");
+    }
+    return NULL;
+}
+
+/* Fires the player's line and appends the reply, with the next prompt if
+ * the move has to be made again or the result if it wins.
+ *
+ * @param (struct naval_session* session) (session being played)
+ *
+ * @return (char*) (end of the text)
+ */
+static char* player_move(struct naval_session* session)
+{
+    int shot = naval_move(session->game, PLAYER, session->line);
+    char* text = stpcpy(session->text, shotReplies[shot]);
+    char* over;
+
+    if (shot == SHOT_BAD || shot == SHOT_REPEATED) {
+        session->state = STATE_INPUT;
+        return stpcpy(text, "(Your move)>");
+    }
+    naval_stats_move(session->start);
+    if ((over = game_over(session, text)) != NULL) {
+        session->state = STATE_OVER;
+        return over;
+    }
+    session->state = STATE_CPU;
+    return text;
+}
+
+/* Prompts for the cpu's move and takes it from the ai or the turns. A
+ * scripted move is echoed straight from its line in the turns, so the
+ * reply to it is left to the next steps.
+ *
+ * @param (struct naval_session* session) (session being played)
+ *
+ * @return (char*) (end of the text)
+ */
+static char* cpu_move(struct naval_session* session)
+{
+    char* text = stpcpy(session->text, "(CPU move)>");
+    char* over;
+    int x, y;
+    int shot;
+
+    session->start = naval_stats_now();
+    if (session->ai == NULL) {
+        if (session->turns == NULL || naval_turns_next(session->turns) ==
+                NULL) {
+            session->code = E_CPU_GIVES_UP;
+            session->state = STATE_OVER;
+        } else {
+            session->state = STATE_ECHO;
+        }
+        return text;
+    }
+    if ((shot = naval_ai_move(session->ai, session->game, &x, &y)) ==
+            SHOT_BAD) {
+        session->code = E_CPU_GIVES_UP;
+        session->state = STATE_OVER;
+        return text;
+    }
+    text += naval_move_name(x, y, text);
+    *text++ = '\n';
+    text = stpcpy(text, shotReplies[shot]);
+    naval_stats_move(session->start);
+    if ((over = game_over(session, text)) != NULL) {
+        session->state = STATE_OVER;
+        return over;
+    }
+    session->state = STATE_TURN;
+    return text;
+}
+
+/* Fires the scripted move just echoed and appends the reply, going back to
+ * the cpu's prompt if it was a bad or repeated guess.
+ *
+ * @param (struct naval_session* session) (session being played)
+ *
+ * @return (char*) (end of the text)
+ */
+static char* cpu_fire(struct naval_session* session)
+{
+    const struct naval_turn* move =
+            &session->turns->moves[session->turns->next - 1];
+    int shot = (move->kind == SHOT_MISS) ?
+            naval_fire(session->game, CPU, move->x, move->y) : move->kind;
+    char* text = stpcpy(stpcpy(session->text, "\n"), shotReplies[shot]);
+    char* over;
+
+    if (shot == SHOT_BAD || shot == SHOT_REPEATED) {
+        session->state = STATE_CPU;
+        return text;
+    }
+    naval_stats_move(session->start);
+    if ((over = game_over(session, text)) != NULL) {
+        session->state = STATE_OVER;
+        return over;
+    }
+    session->state = STATE_TURN;
+    return text;
+}
+
+/* Runs the session up to the next point where the caller has to act.
+ *
+ * @param (struct naval_session* session) (session being played)
+ * @param (const char** text) (set to the output of a STEP_TEXT)
+ * @param (size_t* length) (set to the length of that output)
+ *
+ * @return (int) (one of enum Steps)
+ */
+int naval_session_step(struct naval_session* session, const char** text,
+        size_t* length)
+{
+    const struct naval_turns* turns = session->turns;
+    char* end;
+
+    *text = session->text;
+    switch (session->state) {
+        case STATE_TURN:
+            if ((end = game_over(session, session->text)) != NULL) {
+                session->state = STATE_OVER;
+                break;
+            }
+            session->state = STATE_PROMPT;
+            return STEP_BOARDS;
+        case STATE_PROMPT:
+            end = stpcpy(session->text, "(Your move)>");
+            session->state = STATE_INPUT;
+            break;
+        case STATE_INPUT:
+            return STEP_INPUT;
+        case STATE_MOVE:
+            end = player_move(session);
+            break;
+        case STATE_CPU:
+            end = cpu_move(session);
+            break;
+        case STATE_ECHO:
+            // the line is echoed from the turns however long it is
+            session->state = STATE_FIRE;
+            *text = turns->lines[turns->next - 1];
+            *length = turns->lengths[turns->next - 1];
+            return STEP_TEXT;
+        case STATE_FIRE:
+            end = cpu_fire(session);
+            break;
+        default:
+            return STEP_OVER;
+    }
+    *length = end - session->text;
+    return STEP_TEXT;
+}
+
+/* Takes the player's line while the session waits for one, keeping as much
+ * of it as read_line would.
+ *
+ * @param (struct naval_session* session) (session waiting for input)
+ * @param (const char* line) (line typed, without its newline)
+ * @param (size_t length) (length of the line, 0 to give up)
+ */
+void naval_session_input(struct naval_session* session, const char* line,
+        size_t length)
+{
+    if (session->state != STATE_INPUT) {
+        return;
+    }
+    if (length == 0) {
+        session->code = E_PLAYER_GIVES_UP;
+        session->state = STATE_OVER;
+        return;
+    }
+    if (length > NAVAL_LINE_MAX - 1) {
+        length = NAVAL_LINE_MAX - 1;
+    }
+    memcpy(session->line, line, length);
+    session->line[length] = '\0';
+    // time from the move being typed, not from the prompt
+    session->start = naval_stats_now();
+    session->state = STATE_MOVE;
+}
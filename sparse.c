@@ -0,0 +1,421 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "game.h"
+
+/* Returns the slot a key is first looked for in.
+ *
+ * @param (const struct positions* set) (set with slots allocated)
+ * @param (uint32_t key) (key of the position)
+ */
+static uint32_t first_slot(const struct positions* set, uint32_t key)
+{
+    return (uint32_t)((key * 0x9E3779B97F4A7C15ull) >> 32) & set->mask;
+}
+
+/* Doubles the slots of a set, or allocates its first ones, and puts every
+ * key back.
+ *
+ * @param (struct positions* set) (set to be grown)
+ *
+ * @return (int) (0 on success, -1 if out of memory)
+ */
+static int grow_positions(struct positions* set)
+{
+    uint32_t slots = (set->keys == NULL) ? 16 : 2 * (set->mask + 1);
+    uint32_t* old = set->keys;
+    uint32_t oldSlots = (old == NULL) ? 0 : set->mask + 1;
+
+    STATS_ALLOC(1);
+    if ((set->keys = calloc(slots, sizeof(uint32_t))) == NULL) {
+        set->keys = old;
+        return -1;
+    }
+    set->mask = slots - 1;
+    for (uint32_t i = 0; i < oldSlots; i++) {
+        if (old[i] != 0) {
+            uint32_t slot = first_slot(set, old[i]);
+
+            while (set->keys[slot] != 0) {
+                slot = (slot + 1) & set->mask;
+            }
+            set->keys[slot] = old[i];
+        }
+    }
+    free(old);
+    return 0;
+}
+
+/* Adds a position to a set, keeping it at most half full.
+ *
+ * @param (struct positions* set) (set to be added to)
+ * @param (uint32_t key) (key of the position, from SPARSE_KEY)
+ *
+ * @return (int) (1 if added, 0 if already there, -1 if out of memory)
+ */
+int positions_add(struct positions* set, uint32_t key)
+{
+    uint32_t slot;
+
+    if ((set->keys == NULL || 2 * (set->count + 1) > set->mask + 1) &&
+            grow_positions(set)) {
+        return -1;
+    }
+    slot = first_slot(set, key);
+    while (set->keys[slot] != 0) {
+        if (set->keys[slot] == key) {
+            return 0;
+        }
+        slot = (slot + 1) & set->mask;
+    }
+    set->keys[slot] = key;
+    set->count++;
+    return 1;
+}
+
+/* Returns 1 if the set holds a position, 0 otherwise.
+ *
+ * @param (const struct positions* set) (set to be looked in)
+ * @param (uint32_t key) (key of the position, from SPARSE_KEY)
+ */
+int positions_test(const struct positions* set, uint32_t key)
+{
+    uint32_t slot;
+
+    if (set->keys == NULL) {
+        return 0;
+    }
+    for (slot = first_slot(set, key); set->keys[slot] != 0;
+            slot = (slot + 1) & set->mask) {
+        if (set->keys[slot] == key) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Frees the slots of a set, leaving it empty.
+ *
+ * @param (struct positions* set) (set to be freed)
+ */
+void positions_free(struct positions* set)
+{
+    free(set->keys);
+    memset(set, 0, sizeof(*set));
+}
+
+/* Returns the key segments are ordered by: the row and then the column of
+ * their start across, the column and then the row down.
+ *
+ * @param (int x) (x coordinate of the start)
+ * @param (int y) (y coordinate of the start)
+ * @param (int down) (1 for segments down a column, 0 across a row)
+ */
+static uint32_t segment_key(int x, int y, int down)
+{
+    return down ? SPARSE_KEY(y, x) : SPARSE_KEY(x, y);
+}
+
+/* Finds the last segment starting at or before a position by binary search.
+ *
+ * @param (const struct segments* runs) (segments in order)
+ * @param (uint32_t key) (key of the position, from segment_key)
+ * @param (int down) (1 for segments down a column, 0 across a row)
+ *
+ * @return (int) (index of the segment, -1 if none starts that early)
+ */
+static int last_before(const struct segments* runs, uint32_t key, int down)
+{
+    int low = 0;
+    int high = runs->count;
+
+    while (low < high) {
+        int middle = (low + high) / 2;
+        const struct segment* run = &runs->items[middle];
+
+        if (segment_key(run->x, run->y, down) <= key) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low - 1;
+}
+
+/* Adds a segment in its place in the order.
+ *
+ * @param (struct segments* runs) (segments in order)
+ * @param (const struct segment* run) (segment to be added)
+ * @param (int down) (1 for segments down a column, 0 across a row)
+ *
+ * @return (int) (0 on success, -1 if out of memory)
+ */
+static int insert_segment(struct segments* runs, const struct segment* run,
+        int down)
+{
+    int at = last_before(runs, segment_key(run->x, run->y, down), down) + 1;
+
+    if (runs->count == runs->capacity) {
+        int capacity = runs->capacity ? runs->capacity * 2 : MAX_SHIPS;
+        struct segment* items = realloc(runs->items,
+                capacity * sizeof(struct segment));
+
+        STATS_ALLOC(1);
+        if (items == NULL) {
+            return -1;
+        }
+        runs->items = items;
+        runs->capacity = capacity;
+    }
+    memmove(&runs->items[at + 1], &runs->items[at],
+            (runs->count - at) * sizeof(struct segment));
+    runs->items[at] = *run;
+    runs->count++;
+    return 0;
+}
+
+/* Places a ship as one segment. Positions on the board are checked against
+ * the other ships before the rest is checked against the board, giving the
+ * same errors as placing the ship position by position.
+ *
+ * @param (struct sparse* board) (board being set up)
+ * @param (int width) (width of the board)
+ * @param (int height) (height of the board)
+ * @param (int player) (PLAYER or CPU depending on which map file)
+ * @param (int shipNum) (ship number)
+ * @param (int size) (number of positions the ship covers)
+ * @param (int x) (x coordinate of the boards position)
+ * @param (int y) (y coordinate of the boards position)
+ * @param (char dir) (direction ship is to be placed in)
+ *
+ * @return (int) (0 on success, otherwise the map error for that player)
+ */
+int sparse_place(struct sparse* board, int width, int height, int player,
+        int shipNum, int size, int x, int y, char dir)
+{
+    struct segment run = {x, y, size, shipNum};
+    int dx = 0, dy = 0;
+    long endX, endY;
+
+    if (size <= 0) {
+        return 0;
+    }
+    switch (dir) {
+        case 'N':
+            dy = -1;
+            break;
+        case 'E':
+            dx = 1;
+            break;
+        case 'S':
+            dy = 1;
+            break;
+        case 'W':
+            dx = -1;
+            break;
+    }
+    for (int i = 0; i < size; i++) {
+        int px = x + i * dx;
+        int py = y + i * dy;
+
+        if (px < 1 || px > width || py < 1 || py > height) {
+            break;
+        }
+        if (sparse_ship_at(board, px, py) != NONE) {
+            return (player == PLAYER) ? E_PLAYER_SHIP_OVERLAP :
+                    E_CPU_SHIP_OVERLAP;
+        }
+        if (dx == 0 && dy == 0) {
+            // only the first position is checked before the direction
+            return (player == PLAYER) ? E_PLAYER_MAP : E_CPU_MAP;
+        }
+    }
+    endX = x + (long)(size - 1) * dx;
+    endY = y + (long)(size - 1) * dy;
+    if (endX < 1 || endX > width || endY < 1 || endY > height) {
+        return (player == PLAYER) ? E_PLAYER_MAP_OOB : E_CPU_MAP_OOB;
+    }
+    run.x = (dx < 0) ? (int)endX : x;
+    run.y = (dy < 0) ? (int)endY : y;
+    if (insert_segment((dy == 0) ? &board->across : &board->down, &run,
+            dy != 0)) {
+        return (player == PLAYER) ? E_PLAYER_MAP : E_CPU_MAP;
+    }
+    return 0;
+}
+
+/* Adds one position of a ship, extending the segment across its row that
+ * ends just before it. Positions must be added row by row, left to right.
+ *
+ * @param (struct sparse* board) (board being set up)
+ * @param (int ship) (ship number)
+ * @param (int x) (x coordinate of the boards position)
+ * @param (int y) (y coordinate of the boards position)
+ *
+ * @return (int) (0 on success, -1 if out of memory)
+ */
+int sparse_set(struct sparse* board, int ship, int x, int y)
+{
+    struct segments* runs = &board->across;
+    struct segment run = {x, y, 1, ship};
+
+    if (runs->count > 0) {
+        struct segment* last = &runs->items[runs->count - 1];
+
+        if (last->ship == ship && last->y == y && last->x + last->length ==
+                x) {
+            last->length++;
+            return 0;
+        }
+    }
+    return insert_segment(runs, &run, 0);
+}
+
+/* Returns the number of the ship covering position x, y, NONE if there is
+ * no ship there.
+ *
+ * @param (const struct sparse* board) (board to be looked at)
+ * @param (int x) (x coordinate of the boards position)
+ * @param (int y) (y coordinate of the boards position)
+ */
+int sparse_ship_at(const struct sparse* board, int x, int y)
+{
+    int i;
+
+    if ((i = last_before(&board->across, SPARSE_KEY(x, y), 0)) >= 0) {
+        const struct segment* run = &board->across.items[i];
+
+        if (run->y == y && x < run->x + run->length) {
+            return run->ship;
+        }
+    }
+    if ((i = last_before(&board->down, SPARSE_KEY(y, x), 1)) >= 0) {
+        const struct segment* run = &board->down.items[i];
+
+        if (run->x == x && y < run->y + run->length) {
+            return run->ship;
+        }
+    }
+    return NONE;
+}
+
+/* Returns the status of position x, y in the same terms as the array board.
+ *
+ * @param (const struct sparse* board) (board to be looked at)
+ * @param (int x) (x coordinate of the boards position)
+ * @param (int y) (y coordinate of the boards position)
+ *
+ * @return (int) (NONE, MISS, HIT or the ship number)
+ */
+int sparse_cell(const struct sparse* board, int x, int y)
+{
+    int ship = sparse_ship_at(board, x, y);
+
+    if (positions_test(&board->shots, SPARSE_KEY(x, y))) {
+        return (ship == NONE) ? MISS : HIT;
+    }
+    return ship;
+}
+
+/* Records a shot at position x, y.
+ *
+ * @param (struct sparse* board) (board shot at)
+ * @param (int x) (x coordinate of the boards position)
+ * @param (int y) (y coordinate of the boards position)
+ *
+ * @return (int) (NONE if miss, the number of the ship hit otherwise)
+ */
+int sparse_hit(struct sparse* board, int x, int y)
+{
+    positions_add(&board->shots, SPARSE_KEY(x, y));
+    return sparse_ship_at(board, x, y);
+}
+
+/* Takes every ship and shot off a board, keeping its memory.
+ *
+ * @param (struct sparse* board) (board to be cleared)
+ */
+void sparse_clear(struct sparse* board)
+{
+    board->across.count = 0;
+    board->down.count = 0;
+    if (board->shots.keys != NULL) {
+        memset(board->shots.keys, 0,
+                (board->shots.mask + 1) * sizeof(uint32_t));
+    }
+    board->shots.count = 0;
+}
+
+/* Copies the segments of one list over another.
+ *
+ * @param (struct segments* to) (list to be overwritten)
+ * @param (const struct segments* from) (list to be copied)
+ *
+ * @return (int) (0 on success, -1 if out of memory)
+ */
+static int copy_segments(struct segments* to, const struct segments* from)
+{
+    if (to->capacity < from->count) {
+        struct segment* items = realloc(to->items,
+                from->count * sizeof(struct segment));
+
+        STATS_ALLOC(1);
+        if (items == NULL) {
+            return -1;
+        }
+        to->items = items;
+        to->capacity = from->count;
+    }
+    if (from->count > 0) {
+        memcpy(to->items, from->items, from->count * sizeof(struct segment));
+    }
+    to->count = from->count;
+    return 0;
+}
+
+/* Copies the ships and shots of one board over another, which keeps its
+ * own memory.
+ *
+ * @param (struct sparse* to) (board to be overwritten)
+ * @param (const struct sparse* from) (board to be copied)
+ *
+ * @return (int) (0 on success, -1 if out of memory)
+ */
+int sparse_copy(struct sparse* to, const struct sparse* from)
+{
+    size_t slots = (size_t)from->shots.mask + 1;
+
+    if (copy_segments(&to->across, &from->across) ||
+            copy_segments(&to->down, &from->down)) {
+        return -1;
+    }
+    if (from->shots.keys == NULL) {
+        positions_free(&to->shots);
+        return 0;
+    }
+    if (to->shots.keys == NULL || to->shots.mask != from->shots.mask) {
+        uint32_t* keys = realloc(to->shots.keys, slots * sizeof(uint32_t));
+
+        STATS_ALLOC(1);
+        if (keys == NULL) {
+            return -1;
+        }
+        to->shots.keys = keys;
+    }
+    memcpy(to->shots.keys, from->shots.keys, slots * sizeof(uint32_t));
+    to->shots.mask = from->shots.mask;
+    to->shots.count = from->shots.count;
+    return 0;
+}
+
+/* Frees the memory of a board, leaving it empty.
+ *
+ * @param (struct sparse* board) (board to be freed)
+ */
+void sparse_free(struct sparse* board)
+{
+    free(board->across.items);
+    free(board->down.items);
+    positions_free(&board->shots);
+    memset(board, 0, sizeof(*board));
+}
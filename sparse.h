@@ -0,0 +1,70 @@
+#ifndef SPARSE_H
+#define SPARSE_H
+
+#include <stdint.h>
+
+#include "naval.h"
+
+// Boards with more positions than this are played on ENGINE_SPARSE
+#define SPARSE_AREA (256 * 256)
+
+/* Position x, y as a key of a position set. Coordinates are at most
+ * SIDE_MAX, so both fit in 16 bits, and no position has key 0.
+ */
+#define SPARSE_KEY(x, y) ((uint32_t)(y) << 16 | (uint32_t)(x))
+#define SPARSE_X(key) ((int)((key) & 0xffff))
+#define SPARSE_Y(key) ((int)((key) >> 16))
+
+// The positions of one ship along a row or down a column, from x, y on
+struct segment {
+    int x;
+    int y;
+    int length;
+    int ship;
+};
+
+/* Segments in position order: those across a row by row and then column,
+ * those down a column by column and then row. As ships never overlap, the
+ * segment covering a position is the last one starting at or before it.
+ */
+struct segments {
+    struct segment* items;
+    int count;
+    int capacity;
+};
+
+/* Open addressing hash set of position keys, 0 marking an empty slot. mask
+ * is the number of slots less one, a power of two, or 0 before any key is
+ * added.
+ */
+struct positions {
+    uint32_t* keys;
+    uint32_t mask;
+    uint32_t count;
+};
+
+/* One side's board under ENGINE_SPARSE: the segments of its ships, each as
+ * placed by ship_directions, and the positions shot at. Memory grows with
+ * the ships and shots, not with the size of the board.
+ */
+struct sparse {
+    struct segments across;
+    struct segments down;
+    struct positions shots;
+};
+
+int positions_add(struct positions* set, uint32_t key);
+int positions_test(const struct positions* set, uint32_t key);
+void positions_free(struct positions* set);
+
+int sparse_place(struct sparse* board, int width, int height, int player,
+        int shipNum, int size, int x, int y, char dir);
+int sparse_set(struct sparse* board, int ship, int x, int y);
+int sparse_ship_at(const struct sparse* board, int x, int y);
+int sparse_cell(const struct sparse* board, int x, int y);
+int sparse_hit(struct sparse* board, int x, int y);
+void sparse_clear(struct sparse* board);
+int sparse_copy(struct sparse* to, const struct sparse* from);
+void sparse_free(struct sparse* board);
+
+#endif
@@ -0,0 +1,214 @@
+#include <linux/perf_event.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "game.h"
+
+// Calls of read_map whose cycles are listed one by one
+#define STATS_MAP_CALLS 16
+// Buckets of the move latency histogram, each twice as wide as the last
+#define STATS_BUCKETS 40
+
+// Hardware counters read through perf_event_open when the kernel allows it
+enum Counters {
+    COUNTER_CYCLES,
+    COUNTER_INSTRUCTIONS,
+    COUNTER_CACHE_MISSES,
+    COUNTER_BRANCH_MISSES,
+    COUNTERS
+};
+
+int statsOn;
+
+static const char* phaseNames[PHASES] = {"rules_parse", "read_map",
+        "move_intake", "hit_resolution", "sunk_win_checks", "render"};
+static const char* counterNames[COUNTERS] = {"cycles", "instructions",
+        "cache_misses", "branch_misses"};
+static const unsigned long long counterConfigs[COUNTERS] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+
+/* Totals of the whole process. Games may be played on many threads at
+ * once, so every count is added to atomically.
+ */
+static struct {
+    unsigned long long calls[PHASES];
+    unsigned long long cycles[PHASES];
+    unsigned long long mapCycles[STATS_MAP_CALLS];
+    unsigned long long allocations;
+    unsigned long long bytes;
+    unsigned long long moves;
+    unsigned long long latency[STATS_BUCKETS];
+    int counters[COUNTERS];
+} stats;
+
+/* Reads the cycle counter of the cpu, or a nanosecond clock where there is
+ * none to read.
+ *
+ * @return (unsigned long long) (the count)
+ */
+unsigned long long stats_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec time;
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1000000000ULL + time.tv_nsec;
+#endif
+}
+
+/* Adds the cycles since start to a phase.
+ *
+ * @param (int phase) (one of enum Phases)
+ * @param (unsigned long long start) (count returned by stats_cycles)
+ */
+void stats_phase(int phase, unsigned long long start)
+{
+    unsigned long long cycles = stats_cycles() - start;
+    unsigned long long call = __atomic_fetch_add(&stats.calls[phase], 1,
+            __ATOMIC_RELAXED);
+
+    __atomic_fetch_add(&stats.cycles[phase], cycles, __ATOMIC_RELAXED);
+    if (phase == PHASE_MAP && call < STATS_MAP_CALLS) {
+        stats.mapCycles[call] = cycles;
+    }
+}
+
+/* Counts allocations made by the library.
+ *
+ * @param (int count) (number of allocations)
+ */
+void stats_alloc(int count)
+{
+    __atomic_fetch_add(&stats.allocations, count, __ATOMIC_RELAXED);
+}
+
+/* Opens one hardware counter for this process and the threads it starts.
+ *
+ * @param (unsigned long long config) (PERF_COUNT_HW_ counter to open)
+ *
+ * @return (int) (file descriptor of the counter, -1 if not allowed)
+ */
+static int open_counter(unsigned long long config)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.inherit = 1;
+    return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/* Turns on the counters and opens what hardware counters are available.
+ */
+void naval_stats_enable(void)
+{
+    for (int i = 0; i < COUNTERS; i++) {
+        stats.counters[i] = open_counter(counterConfigs[i]);
+    }
+    statsOn = 1;
+}
+
+/* Returns a monotonic time in nanoseconds to time a move from.
+ *
+ * @return (unsigned long long) (the time, 0 with the counters off)
+ */
+unsigned long long naval_stats_now(void)
+{
+    struct timespec time;
+
+    if (!statsOn) {
+        return 0;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1000000000ULL + time.tv_nsec;
+}
+
+/* Adds the time since start to the histogram of move latencies. Bucket i
+ * holds moves that took less than 2^i nanoseconds.
+ *
+ * @param (unsigned long long start) (time returned by naval_stats_now)
+ */
+void naval_stats_move(unsigned long long start)
+{
+    unsigned long long elapsed;
+    int bucket = 0;
+
+    if (!statsOn) {
+        return;
+    }
+    elapsed = naval_stats_now() - start;
+    while (bucket < STATS_BUCKETS - 1 && (elapsed >> bucket) != 0) {
+        bucket++;
+    }
+    __atomic_fetch_add(&stats.moves, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats.latency[bucket], 1, __ATOMIC_RELAXED);
+}
+
+/* Counts bytes written to standard output.
+ *
+ * @param (size_t bytes) (number of bytes written)
+ */
+void naval_stats_output(size_t bytes)
+{
+    if (statsOn) {
+        __atomic_fetch_add(&stats.bytes, bytes, __ATOMIC_RELAXED);
+    }
+}
+
+/* Prints everything counted so far as one JSON object.
+ *
+ * @param (FILE* file) (file the summary is printed to)
+ */
+void naval_stats_print(FILE* file)
+{
+    const char* separator = "";
+
+    fprintf(file, "{\"phases\": {");
+    for (int i = 0; i < PHASES; i++) {
+        fprintf(file, "%s\"%s\": {\"calls\": %llu, \"cycles\": %llu}",
+                i ? ", " : "", phaseNames[i], stats.calls[i],
+                stats.cycles[i]);
+    }
+    fprintf(file, "}, \"read_map_cycles\": [");
+    for (unsigned long long i = 0; i < stats.calls[PHASE_MAP] &&
+            i < STATS_MAP_CALLS; i++) {
+        fprintf(file, "%s%llu", i ? ", " : "", stats.mapCycles[i]);
+    }
+    fprintf(file, "], \"allocations\": %llu, \"stdout_bytes\": %llu, "
+            "\"moves\": %llu, \"move_latency_ns\": [", stats.allocations,
+            stats.bytes, stats.moves);
+    for (int i = 0; i < STATS_BUCKETS; i++) {
+        if (stats.latency[i] != 0) {
+            fprintf(file, "%s{\"below\": %llu, \"moves\": %llu}", separator,
+                    1ULL << i, stats.latency[i]);
+            separator = ", ";
+        }
+    }
+    fprintf(file, "], \"perf\": {");
+    separator = "";
+    for (int i = 0; i < COUNTERS; i++) {
+        unsigned long long value;
+
+        if (statsOn && stats.counters[i] >= 0 && read(stats.counters[i],
+                &value, sizeof(value)) == sizeof(value)) {
+            fprintf(file, "%s\"%s\": %llu", separator, counterNames[i],
+                    value);
+            separator = ", ";
+        }
+    }
+    fprintf(file, "}}\n");
+}
@@ -0,0 +1,189 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "game.h"
+
+/* Maps the rest of an open file into memory so its lines can be scanned in
+ * place. Streams that cannot be mapped, such as pipes, are read into one
+ * buffer instead.
+ *
+ * @param (struct naval_text* text) (text to be set up)
+ * @param (FILE* file) (file opened for reading)
+ *
+ * @return (int) (0 on success, -1 if the file could not be read)
+ */
+int naval_text_open(struct naval_text* text, FILE* file)
+{
+    struct stat info;
+    off_t offset = ftello(file);
+
+    memset(text, 0, sizeof(*text));
+    if (fstat(fileno(file), &info) == 0 && S_ISREG(info.st_mode) &&
+            offset >= 0 && offset <= info.st_size) {
+        if (info.st_size == 0) {
+            return 0;
+        }
+        text->map = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE,
+                fileno(file), 0);
+        if (text->map == MAP_FAILED) {
+            text->map = NULL;
+            return -1;
+        }
+        text->mapLength = info.st_size;
+        madvise(text->map, text->mapLength, MADV_SEQUENTIAL);
+        text->next = (const char*)text->map + offset;
+        text->end = (const char*)text->map + info.st_size;
+        return 0;
+    }
+
+    size_t capacity = 0;
+    size_t length = 0;
+    size_t got;
+
+    do {
+        if (length == capacity) {
+            char* grown;
+
+            capacity = capacity ? capacity * 2 : 65536;
+            STATS_ALLOC(1);
+            if ((grown = realloc(text->copy, capacity)) == NULL) {
+                naval_text_close(text);
+                return -1;
+            }
+            text->copy = grown;
+        }
+        got = fread(text->copy + length, 1, capacity - length, file);
+        length += got;
+    } while (got > 0);
+    text->next = text->copy;
+    text->end = text->copy + length;
+    return 0;
+}
+
+/* Scans lines from a buffer owned by the caller.
+ *
+ * @param (struct naval_text* text) (text to be set up)
+ * @param (const char* data) (contents of the file)
+ * @param (size_t length) (number of bytes of data)
+ */
+void naval_text_buffer(struct naval_text* text, const char* data,
+        size_t length)
+{
+    memset(text, 0, sizeof(*text));
+    text->next = data;
+    text->end = data + length;
+}
+
+/* Unmaps or frees what naval_text_open set up.
+ *
+ * @param (struct naval_text* text) (text to be closed)
+ */
+void naval_text_close(struct naval_text* text)
+{
+    if (text->map != NULL) {
+        munmap(text->map, text->mapLength);
+    }
+    free(text->copy);
+    memset(text, 0, sizeof(*text));
+}
+
+/* Returns the next line, reading it the same way read_line does. A # skips
+ * to the end of its physical line and the text after that line carries on
+ * the same logical line, with every further # inside the comment skipping
+ * one more line. Lines without a # are returned in place; the rare
+ * commented ones are joined in the text's own buffer, dropping anything
+ * past NAVAL_LINE_MAX - 1 characters.
+ *
+ * @param (struct naval_text* text) (text being scanned)
+ * @param (const char** line) (set to the start of the line)
+ * @param (size_t* length) (set to the length of the line)
+ *
+ * @return (int) (1 if a line was read, 0 at the end of the text, where line
+ *         is set to an empty line)
+ */
+int naval_text_line(struct naval_text* text, const char** line,
+        size_t* length)
+{
+    const char* start = text->next;
+    const char* end = text->end;
+    const char* p = start;
+    size_t position;
+    int depth = 0;
+
+    if (p == NULL || p >= end) {
+        *line = "";
+        *length = 0;
+        return 0;
+    }
+    while (p < end && *p != '\n' && *p != '#') {
+        p++;
+    }
+    if (p == end || *p == '\n') {
+        *line = start;
+        *length = p - start;
+        text->next = (p < end) ? p + 1 : p;
+        return 1;
+    }
+
+    position = p - start;
+    if (position > NAVAL_LINE_MAX - 1) {
+        position = NAVAL_LINE_MAX - 1;
+    }
+    memcpy(text->line, start, position);
+    for (; p < end; p++) {
+        if (depth > 0) {
+            if (*p == '#') {
+                depth++;
+            } else if (*p == '\n') {
+                depth--;
+            }
+        } else if (*p == '#') {
+            depth = 1;
+        } else if (*p == '\n') {
+            break;
+        } else if (position < NAVAL_LINE_MAX - 1) {
+            text->line[position++] = *p;
+        }
+    }
+    text->next = (p < end) ? p + 1 : p;
+    *line = text->line;
+    *length = position;
+    return 1;
+}
+
+/* Reads one line of the provided file, skipping # comments like
+ * naval_text_line. Characters past size - 1 are dropped.
+ *
+ * @param (FILE* file) (filename of the file to be read)
+ * @param (char* line) (buffer the line is read into)
+ * @param (int size) (size of the buffer)
+ *
+ * @return (int) (length of the line read)
+ */
+int read_line(FILE* file, char* line, int size)
+{
+    int position = 0;
+    int depth = 0;
+    int next;
+
+    while ((next = fgetc(file)) != EOF) {
+        if (depth > 0) {
+            if (next == '#') {
+                depth++;
+            } else if (next == '\n') {
+                depth--;
+            }
+        } else if (next == '#') {
+            depth = 1;
+        } else if (next == '\n') {
+            break;
+        } else if (position < size - 1) {
+            line[position++] = (char)next;
+        }
+    }
+    line[position] = '\0';
+    return position;
+}
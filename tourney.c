@@ -0,0 +1,372 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "naval.h"
+#include "commands.h"
+
+#define MAX_THREADS 256
+#define EMPTY -1
+#define ABORT -2
+
+// One game of the manifest and the slot its worker writes the result to
+struct entry {
+    char* line;
+    char* paths[ENTRY_FIELDS];
+    int fields;
+    int error;
+    struct naval_result result;
+};
+
+/* Chase-Lev work-stealing deque of entry indices. The owner pops from the
+ * bottom while any other worker steals from the top, so the only contended
+ * operation is the last item being taken from both ends at once.
+ */
+struct deque {
+    long top;
+    long bottom;
+    int* items;
+} __attribute__((aligned(64)));
+
+struct worker {
+    int id;
+    int threads;
+    const struct options* options;
+    struct deque* deques;
+    struct entry* entries;
+    long games;
+    double seconds;
+} __attribute__((aligned(64)));
+
+/* Takes an entry from the bottom of the worker's own deque.
+ *
+ * @param (struct deque* deque) (deque owned by the calling worker)
+ *
+ * @return (int) (entry index, EMPTY if there is none left)
+ */
+static int deque_pop(struct deque* deque)
+{
+    long bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+    long top;
+    int item;
+
+    __atomic_store_n(&deque->bottom, bottom, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    top = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+
+    if (top > bottom) {
+        __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+        return EMPTY;
+    }
+    item = deque->items[bottom];
+    if (top == bottom) {
+        // last item, race any thief for it
+        if (!__atomic_compare_exchange_n(&deque->top, &top, top + 1, 0,
+                __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+            item = EMPTY;
+        }
+        __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+    }
+    return item;
+}
+
+/* Takes an entry from the top of another worker's deque.
+ *
+ * @param (struct deque* deque) (deque owned by the victim)
+ *
+ * @return (int) (entry index, EMPTY if there is none, ABORT if another
+ *         worker took it first)
+ */
+static int deque_steal(struct deque* deque)
+{
+    long top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    long bottom;
+    int item;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+    if (top >= bottom) {
+        return EMPTY;
+    }
+    item = deque->items[top];
+    if (!__atomic_compare_exchange_n(&deque->top, &top, top + 1, 0,
+            __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        return ABORT;
+    }
+    return item;
+}
+
+/* Finds the next entry for a worker, stealing once its own deque is empty.
+ * No entries are added after the workers start, so every deque reading
+ * empty in one full pass means the tournament is over.
+ *
+ * @param (struct worker* worker) (worker looking for work)
+ *
+ * @return (int) (entry index, EMPTY once no work is left anywhere)
+ */
+static int next_entry(struct worker* worker)
+{
+    int item = deque_pop(&worker->deques[worker->id]);
+    int contended = 1;
+
+    while (item == EMPTY && contended) {
+        contended = 0;
+        for (int i = 1; i < worker->threads && item < 0; i++) {
+            int victim = (worker->id + i) % worker->threads;
+
+            item = deque_steal(&worker->deques[victim]);
+            if (item == ABORT) {
+                contended = 1;
+            }
+        }
+        if (item < 0) {
+            item = EMPTY;
+        }
+    }
+    return item;
+}
+
+/* Returns the seconds passed since start.
+ *
+ * @param (const struct timespec* start) (monotonic time to measure from)
+ */
+static double elapsed(const struct timespec* start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* Plays entries until none are left. Results go straight into each entry's
+ * own slot, so workers never share anything but the deques.
+ *
+ * @param (void* arg) (the struct worker of this thread)
+ */
+static void* run_worker(void* arg)
+{
+    struct worker* worker = arg;
+    struct timespec start;
+    int item;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while ((item = next_entry(worker)) != EMPTY) {
+        struct entry* entry = &worker->entries[item];
+
+        if (entry->fields < ENTRY_FIELDS) {
+            entry->error = E_NOT_ENOUGH_PARAMETERS;
+        } else {
+            entry->error = play_entry(entry->paths, worker->options,
+                    &entry->result);
+        }
+        worker->games++;
+    }
+    worker->seconds = elapsed(&start);
+    return NULL;
+}
+
+/* Frees the entries read from a manifest.
+ *
+ * @param (struct entry* entries) (array of entries)
+ * @param (int count) (number of entries)
+ */
+static void free_entries(struct entry* entries, int count)
+{
+    for (int i = 0; i < count; i++) {
+        free(entries[i].line);
+    }
+    free(entries);
+}
+
+/* Reads every non-blank manifest line into an entry.
+ *
+ * @param (FILE* file) (manifest file)
+ * @param (struct entry** entries) (set to the array of entries, freed by
+ *        the caller)
+ * @param (int* count) (set to the number of entries read)
+ *
+ * @return (int) (0 on success, -1 if out of memory)
+ */
+static int read_entries(FILE* file, struct entry** entries, int* count)
+{
+    int capacity = 0;
+    char line[MANIFEST_LINE_MAX];
+
+    *entries = NULL;
+    *count = 0;
+    while (read_line(file, line, sizeof(line)) != 0 || !feof(file)) {
+        struct entry entry;
+
+        memset(&entry, 0, sizeof(entry));
+        if ((entry.line = strdup(line)) == NULL) {
+            free_entries(*entries, *count);
+            return -1;
+        }
+        entry.fields = parse_entry(entry.line, entry.paths);
+        if (entry.fields == 0) {
+            free(entry.line);
+            continue;
+        }
+        if (*count == capacity) {
+            struct entry* grown;
+
+            capacity = capacity ? capacity * 2 : 1024;
+            if ((grown = realloc(*entries, capacity * sizeof(struct entry)))
+                    == NULL) {
+                free(entry.line);
+                free_entries(*entries, *count);
+                return -1;
+            }
+            *entries = grown;
+        }
+        (*entries)[(*count)++] = entry;
+    }
+    return 0;
+}
+
+/* Plays every game of a batch manifest across worker threads and prints the
+ * same result lines as naval --batch, in manifest order, followed by the
+ * throughput of each thread on stderr.
+ *
+ * @param (int argc) (number of arguments)
+ * @param (char* argv[]) (array of argument strings)
+ *
+ * @return (int) (0 if the manifest was played)
+ */
+int main(int argc, char* argv[])
+{
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    struct options options = {ENGINE_ARRAY, CPU_SCRIPTED, 0,
+            THINK_MS_DEFAULT, 0};
+    const char* manifest = NULL;
+    struct timespec start;
+    struct entry* entries;
+    struct deque* deques;
+    struct worker* workers;
+    pthread_t* ids;
+    FILE* file;
+    int count;
+    int started = 0;
+    int failed = 0;
+
+    for (int i = 1; i < argc; ) {
+        int parsed = parse_option(argc, argv, &i, &options);
+
+        if (parsed < 0) {
+            manifest = NULL;
+            break;
+        } else if (parsed) {
+            continue;
+        }
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else {
+            manifest = argv[i];
+        }
+        i++;
+    }
+    if (manifest == NULL || threads < 1 || threads > MAX_THREADS) {
+        fprintf(stderr, "Usage: naval-tourney [-j workers] [--engine engine] "
+                "[--cpu cpu] [--cpu-think-ms ms] [--cpu-endgame ships] "
+                "[--threads n] [--stats] manifest\n"
+                "  -j workers   games played at once, one per core by default\n"
+                "  --cpu cpu    scripted, density or mcts, the last two told "
+                "only whether\n"
+                "               each shot missed, hit or sank a ship\n"
+                "  --threads n  search threads of each game's mcts or endgame "
+                "cpu\n");
+        return E_NOT_ENOUGH_PARAMETERS;
+    }
+    if (options.stats) {
+        start_stats();
+    }
+    if ((file = fopen(manifest, "r")) == NULL) {
+        fprintf(stderr, "Missing manifest file\n");
+        return E_NOT_ENOUGH_PARAMETERS;
+    }
+    if (read_entries(file, &entries, &count)) {
+        fclose(file);
+        fprintf(stderr, "Out of memory\n");
+        return E_NOT_ENOUGH_PARAMETERS;
+    }
+    fclose(file);
+
+    // deal the entries out round robin so long games are spread evenly
+    deques = NULL;
+    workers = NULL;
+    ids = NULL;
+    if (posix_memalign((void**)&deques, 64, threads * sizeof(struct deque)) ||
+            posix_memalign((void**)&workers, 64,
+            threads * sizeof(struct worker)) ||
+            (ids = malloc(threads * sizeof(pthread_t))) == NULL) {
+        failed = 1;
+    }
+    for (int t = 0; !failed && t < threads; t++) {
+        deques[t].top = 0;
+        deques[t].bottom = 0;
+        if ((deques[t].items = malloc((count / threads + 1) * sizeof(int)))
+                == NULL) {
+            // the deques from here on are left for the cleanup to skip
+            for (int u = t; u < threads; u++) {
+                deques[u].items = NULL;
+            }
+            failed = 1;
+        }
+    }
+    for (int i = 0; !failed && i < count; i++) {
+        struct deque* deque = &deques[i % threads];
+
+        deque->items[deque->bottom++] = i;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int t = 0; !failed && t < threads; t++) {
+        memset(&workers[t], 0, sizeof(struct worker));
+        workers[t].id = t;
+        workers[t].threads = threads;
+        workers[t].options = &options;
+        workers[t].deques = deques;
+        workers[t].entries = entries;
+        if (pthread_create(&ids[t], NULL, run_worker, &workers[t])) {
+            failed = 1;
+        } else {
+            started++;
+        }
+    }
+    for (int t = 0; t < started; t++) {
+        pthread_join(ids[t], NULL);
+    }
+    if (failed) {
+        fprintf(stderr, "Cannot start %d workers\n", threads);
+        for (int t = 0; deques != NULL && ids != NULL && t < threads; t++) {
+            free(deques[t].items);
+        }
+        free(ids);
+        free(workers);
+        free(deques);
+        free_entries(entries, count);
+        return E_NOT_ENOUGH_PARAMETERS;
+    }
+    double total = elapsed(&start);
+
+    for (int i = 0; i < count; i++) {
+        print_result(i + 1, &entries[i].result, entries[i].error);
+    }
+    for (int t = 0; t < threads; t++) {
+        fprintf(stderr, "thread %d: %ld games, %.0f games/sec\n", t,
+                workers[t].games, workers[t].seconds > 0 ?
+                workers[t].games / workers[t].seconds : 0.0);
+        free(deques[t].items);
+    }
+    fprintf(stderr, "total: %d games, %.0f games/sec\n", count,
+            total > 0 ? count / total : 0.0);
+
+    free(ids);
+    free(workers);
+    free(deques);
+    free_entries(entries, count);
+    return 0;
+}
@@ -0,0 +1,134 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "game.h"
+
+/* Adds a line to the decoded turns, growing the arrays as needed.
+ *
+ * @param (struct naval_turns* turns) (turns being decoded)
+ * @param (const char* line) (line the turn was read from)
+ * @param (size_t length) (length of the line)
+ *
+ * @return (struct naval_turn*) (the new turn, NULL if out of memory)
+ */
+static struct naval_turn* append_turn(struct naval_turns* turns,
+        const char* line, size_t length)
+{
+    if (turns->count == turns->capacity) {
+        int capacity = turns->capacity ? turns->capacity * 2 : 256;
+        struct naval_turn* moves = realloc(turns->moves,
+                capacity * sizeof(struct naval_turn));
+        const char** lines;
+        int* lengths;
+
+        STATS_ALLOC(3);
+        if (moves == NULL) {
+            return NULL;
+        }
+        turns->moves = moves;
+        if ((lines = realloc(turns->lines, capacity * sizeof(char*))) == NULL) {
+            return NULL;
+        }
+        turns->lines = lines;
+        if ((lengths = realloc(turns->lengths, capacity * sizeof(int))) ==
+                NULL) {
+            return NULL;
+        }
+        turns->lengths = lengths;
+        turns->capacity = capacity;
+    }
+    turns->lines[turns->count] = line;
+    turns->lengths[turns->count] = (int)length;
+    return &turns->moves[turns->count++];
+}
+
+/* Decodes every move of a turns text up to the line where the side gives
+ * up. Each move is checked with check_bad_move and check_bad_guess once
+ * here, and moves repeating an earlier one are flagged, since only this
+ * side's shots land on the board it fires at.
+ *
+ * @param (struct naval_turns* turns) (filled in with the decoded moves)
+ * @param (struct naval_text* text) (text of the turns, which must stay open
+ *        while the lines of the turns are used)
+ * @param (const struct naval_game* game) (game with the rules loaded)
+ *
+ * @return (int) (0 on success, -1 if out of memory)
+ */
+int naval_turns_decode(struct naval_turns* turns, struct naval_text* text,
+        const struct naval_game* game)
+{
+    struct positions fired = {NULL, 0, 0};
+    const char* line;
+    size_t length;
+
+    memset(turns, 0, sizeof(*turns));
+    while (naval_text_line(text, &line, &length), length != 0) {
+        struct naval_turn* turn;
+        int x, y;
+
+        if (line == text->line) {
+            // joined across a comment, so it is overwritten by the next one
+            STATS_ALLOC(turns->joined == NULL);
+            if (turns->joined == NULL && (turns->joined =
+                    malloc(text->end - text->next + NAVAL_LINE_MAX)) == NULL) {
+                naval_turns_free(turns);
+                positions_free(&fired);
+                return -1;
+            }
+            line = memcpy(turns->joined + turns->joinedLength, line, length);
+            turns->joinedLength += length;
+        }
+        if ((turn = append_turn(turns, line, length)) == NULL) {
+            naval_turns_free(turns);
+            positions_free(&fired);
+            return -1;
+        }
+        turn->x = turn->y = 0;
+        if (!parse_move(line, length, &x, &y) ||
+                !check_bad_guess(x, y, game->width, game->height)) {
+            turn->kind = SHOT_BAD;
+            continue;
+        }
+        turn->x = x;
+        turn->y = y;
+        switch (positions_add(&fired, SPARSE_KEY(x, y))) {
+            case 0:
+                turn->kind = SHOT_REPEATED;
+                break;
+            case 1:
+                turn->kind = SHOT_MISS;
+                break;
+            default:
+                naval_turns_free(turns);
+                positions_free(&fired);
+                return -1;
+        }
+    }
+    positions_free(&fired);
+    return 0;
+}
+
+/* Frees the arrays of decoded turns.
+ *
+ * @param (struct naval_turns* turns) (turns to be freed)
+ */
+void naval_turns_free(struct naval_turns* turns)
+{
+    free(turns->moves);
+    free(turns->lines);
+    free(turns->lengths);
+    free(turns->joined);
+    memset(turns, 0, sizeof(*turns));
+}
+
+/* Returns the next decoded move, or NULL once the side has given up.
+ *
+ * @param (struct naval_turns* turns) (turns being played)
+ */
+const struct naval_turn* naval_turns_next(struct naval_turns* turns)
+{
+    if (turns->next == turns->count) {
+        return NULL;
+    }
+    return &turns->moves[turns->next++];
+}
@@ -0,0 +1,527 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "naval.h"
+#include "commands.h"
+
+// Maps checked between printing their reports, bounding the reports held
+#define VALIDATE_CHUNK 4096
+// Problems kept of one map; any more are only counted
+#define VALIDATE_PROBLEMS 64
+// Bytes of a tar header or data block
+#define TAR_BLOCK 512
+
+/* One map to be checked: a file to be read or, within a mapped tarball,
+ * its contents.
+ */
+struct entry {
+    char* name;
+    const char* data;
+    size_t length;
+};
+
+// Every map found under the paths given, in the order they are reported
+struct entries {
+    struct entry* items;
+    size_t count;
+    size_t capacity;
+};
+
+/* What one thread checking maps keeps: its own game to place ships on, a
+ * buffer for files read and the reports of the maps it checked, which are
+ * printed in order once the chunk is done.
+ */
+struct validator {
+    struct naval_game* game;
+    char* file;
+    size_t fileCapacity;
+    char* reports;
+    size_t length;
+    size_t capacity;
+};
+
+// A chunk of maps shared out between the validators, one map at a time
+struct chunk {
+    const struct entry* entries;
+    size_t* offsets;
+    size_t* lengths;
+    int* owners;
+    int* invalid;
+    size_t count;
+    size_t next;
+};
+
+// What each thread is given to work on
+struct work {
+    struct validator* validator;
+    struct chunk* chunk;
+    int index;
+};
+
+/* Adds a map to the list, taking ownership of its name.
+ *
+ * @param (struct entries* entries) (maps found so far)
+ * @param (char* name) (name the map is reported under, freed on failure)
+ * @param (const char* data) (contents in a tarball, NULL for a file)
+ * @param (size_t length) (bytes of data)
+ *
+ * @return (int) (0 on success, -1 if out of memory)
+ */
+static int add_entry(struct entries* entries, char* name, const char* data,
+        size_t length)
+{
+    if (name == NULL) {
+        return -1;
+    }
+    if (entries->count == entries->capacity) {
+        size_t capacity = entries->capacity ? 2 * entries->capacity : 1024;
+        struct entry* items = realloc(entries->items,
+                capacity * sizeof(struct entry));
+
+        if (items == NULL) {
+            free(name);
+            return -1;
+        }
+        entries->items = items;
+        entries->capacity = capacity;
+    }
+    entries->items[entries->count].name = name;
+    entries->items[entries->count].data = data;
+    entries->items[entries->count].length = length;
+    entries->count++;
+    return 0;
+}
+
+/* Adds a regular file found by walk_directory.
+ *
+ * @param (void* context) (struct entries of the maps found so far)
+ * @param (const char* path) (path of the file)
+ *
+ * @return (int) (0 on success, E_PLAYER_MAP_MISSING if out of memory)
+ */
+static int add_file(void* context, const char* path)
+{
+    return add_entry(context, strdup(path), NULL, 0) ? E_PLAYER_MAP_MISSING :
+            0;
+}
+
+/* Reads an octal field of a tar header.
+ *
+ * @param (const char* field) (start of the field)
+ * @param (int width) (bytes in the field)
+ *
+ * @return (size_t) (value of the field)
+ */
+static size_t tar_number(const char* field, int width)
+{
+    size_t value = 0;
+
+    for (int i = 0; i < width && field[i] >= '0' && field[i] <= '7'; i++) {
+        value = value * 8 + field[i] - '0';
+    }
+    return value;
+}
+
+/* Adds every regular file of a mapped tar archive, named as though the
+ * archive were a directory. GNU long names are followed; other extended
+ * headers are skipped.
+ *
+ * @param (struct entries* entries) (maps found so far)
+ * @param (const char* path) (path of the archive)
+ * @param (const char* data) (contents of the archive)
+ * @param (size_t length) (bytes of data)
+ *
+ * @return (int) (0 on success, -1 if out of memory)
+ */
+static int add_tar(struct entries* entries, const char* path,
+        const char* data, size_t length)
+{
+    const char* longName = NULL;
+    size_t longLength = 0;
+
+    for (size_t at = 0; at + TAR_BLOCK <= length && data[at] != '\0';) {
+        const char* header = data + at;
+        size_t size = tar_number(header + 124, 12);
+        const char* contents = header + TAR_BLOCK;
+        char type = header[156];
+        char* name;
+
+        at += TAR_BLOCK;
+        if (size > length - at) {
+            size = length - at;
+        }
+        at += (size + TAR_BLOCK - 1) / TAR_BLOCK * TAR_BLOCK;
+        if (type == 'L') {
+            longName = contents;
+            longLength = strnlen(contents, size);
+            continue;
+        }
+        if (type == '0' || type == '\0') {
+            size_t prefix = (longName == NULL) ? strnlen(header + 345, 155) :
+                    0;
+            size_t nameLength = (longName == NULL) ? strnlen(header, 100) :
+                    longLength;
+
+            if ((name = malloc(strlen(path) + prefix + nameLength + 3)) ==
+                    NULL) {
+                return -1;
+            }
+            if (longName != NULL) {
+                sprintf(name, "%s/%.*s", path, (int)nameLength, longName);
+            } else if (prefix > 0) {
+                sprintf(name, "%s/%.*s/%.*s", path, (int)prefix, header + 345,
+                        (int)nameLength, header);
+            } else {
+                sprintf(name, "%s/%.*s", path, (int)nameLength, header);
+            }
+            if (add_entry(entries, name, contents, size)) {
+                return -1;
+            }
+        }
+        longName = NULL;
+    }
+    return 0;
+}
+
+/* Checks whether a mapped file is a tar archive by the magic of its first
+ * header.
+ *
+ * @param (const char* data) (contents of the file)
+ * @param (size_t length) (bytes of data)
+ *
+ * @return (int) (1 if it is an archive, 0 otherwise)
+ */
+static int is_tar(const char* data, size_t length)
+{
+    return length >= TAR_BLOCK && memcmp(data + 257, "ustar", 5) == 0;
+}
+
+/* Appends to the reports of a validator.
+ *
+ * @param (struct validator* validator) (validator writing the report)
+ * @param (const char* format) (printf format of the text)
+ *
+ * @return (int) (0 on success, -1 if out of memory)
+ */
+static int report(struct validator* validator, const char* format, ...)
+        __attribute__((format(printf, 2, 3)));
+
+static int report(struct validator* validator, const char* format, ...)
+{
+    va_list args;
+    int length;
+
+    va_start(args, format);
+    length = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    if (validator->length + length + 1 > validator->capacity) {
+        size_t capacity = 2 * (validator->length + length + 1);
+        char* reports = realloc(validator->reports, capacity);
+
+        if (reports == NULL) {
+            return -1;
+        }
+        validator->reports = reports;
+        validator->capacity = capacity;
+    }
+    va_start(args, format);
+    vsprintf(validator->reports + validator->length, format, args);
+    va_end(args);
+    validator->length += length;
+    return 0;
+}
+
+/* Checks one map and appends a line to the reports for each of its
+ * problems.
+ *
+ * @param (struct validator* validator) (validator checking the map)
+ * @param (const struct entry* entry) (map to be checked)
+ *
+ * @return (int) (1 if the map has problems, 0 if it is valid, -1 if out of
+ *         memory)
+ */
+static int check_entry(struct validator* validator, const struct entry* entry)
+{
+    struct naval_map_problem problems[VALIDATE_PROBLEMS];
+    const char* data = entry->data;
+    size_t length = entry->length;
+    int count;
+    int failed = 0;
+
+    if (data == NULL) {
+        if (read_file(entry->name, &validator->file,
+                &validator->fileCapacity, &length)) {
+            return report(validator, "%s: cannot be read\n", entry->name) ?
+                    -1 : 1;
+        }
+        data = validator->file;
+    }
+    count = naval_check_map(validator->game, PLAYER, data, length, problems,
+            VALIDATE_PROBLEMS);
+    for (int i = 0; i < count && i < VALIDATE_PROBLEMS && !failed; i++) {
+        const struct naval_map_problem* problem = &problems[i];
+
+        switch (problem->kind) {
+            case MAP_LINE:
+                failed = report(validator, "%s:%d: not a position and "
+                        "direction\n", entry->name, problem->line);
+                break;
+            case MAP_OVERLAP:
+                failed = report(validator, "%s:%d: ship %d overlaps another "
+                        "ship\n", entry->name, problem->line, problem->ship);
+                break;
+            case MAP_OOB:
+                failed = report(validator, "%s:%d: ship %d is out of "
+                        "bounds\n", entry->name, problem->line,
+                        problem->ship);
+                break;
+            case MAP_DIRECTION:
+                failed = report(validator, "%s:%d: ship %d has a direction "
+                        "other than N, E, S or W\n", entry->name,
+                        problem->line, problem->ship);
+                break;
+            case MAP_SHIPS:
+                if (problem->line > 0) {
+                    failed = report(validator, "%s:%d: ship count %d where the "
+                            "rules give %d\n", entry->name, problem->line,
+                            problem->ship, naval_ships(validator->game));
+                } else {
+                    failed = report(validator, "%s: ship count %d where the "
+                            "rules give %d\n", entry->name, problem->ship,
+                            naval_ships(validator->game));
+                }
+                break;
+        }
+    }
+    if (!failed && count > VALIDATE_PROBLEMS) {
+        failed = report(validator, "%s: %d more problems\n", entry->name,
+                count - VALIDATE_PROBLEMS);
+    }
+    return failed ? -1 : (count > 0);
+}
+
+/* Checks maps of the chunk until none is left, taking the next one each
+ * time so threads that drew short maps take on more.
+ *
+ * @param (void* arg) (struct work of the thread)
+ *
+ * @return (void*) (NULL on success, the work if out of memory)
+ */
+static void* validate(void* arg)
+{
+    struct work* work = arg;
+    struct chunk* chunk = work->chunk;
+    size_t i;
+
+    while ((i = __atomic_fetch_add(&chunk->next, 1, __ATOMIC_RELAXED)) <
+            chunk->count) {
+        size_t start = work->validator->length;
+
+        if ((chunk->invalid[i] = check_entry(work->validator,
+                &chunk->entries[i])) < 0) {
+            return work;
+        }
+        chunk->offsets[i] = start;
+        chunk->lengths[i] = work->validator->length - start;
+        chunk->owners[i] = work->index;
+    }
+    return NULL;
+}
+
+/* Checks the maps of a chunk on every thread and prints their reports in
+ * the order of the chunk.
+ *
+ * @param (struct validator validators[]) (one validator per thread)
+ * @param (int threads) (number of threads)
+ * @param (struct chunk* chunk) (maps to be checked)
+ * @param (size_t* invalid) (counted up by the maps with problems)
+ *
+ * @return (int) (0 on success, -1 if out of memory)
+ */
+static int validate_chunk(struct validator validators[], int threads,
+        struct chunk* chunk, size_t* invalid)
+{
+    struct work work[threads];
+    pthread_t ids[threads];
+    int started = 0;
+    int failed = 0;
+
+    chunk->next = 0;
+    for (int t = 0; t < threads; t++) {
+        validators[t].length = 0;
+        work[t].validator = &validators[t];
+        work[t].chunk = chunk;
+        work[t].index = t;
+        // the first chunk's work falls to this thread if no other starts
+        if (t > 0 && pthread_create(&ids[t], NULL, validate, &work[t])) {
+            break;
+        }
+        started++;
+    }
+    failed = (validate(&work[0]) != NULL);
+    for (int t = 1; t < started; t++) {
+        void* result;
+
+        pthread_join(ids[t], &result);
+        failed |= (result != NULL);
+    }
+    if (failed) {
+        return -1;
+    }
+    for (size_t i = 0; i < chunk->count; i++) {
+        fwrite(validators[chunk->owners[i]].reports + chunk->offsets[i], 1,
+                chunk->lengths[i], stdout);
+        *invalid += chunk->invalid[i];
+    }
+    return 0;
+}
+
+/* Checks every map under the paths against the rules on all cores and
+ * reports each problem of each map on its own line, as
+ *
+ *     path:line: problem
+ *
+ * in the order of the paths, with directories walked in order of name and
+ * tar archives read as if they were directories. Maps without problems are
+ * not mentioned. How many maps were checked, and how fast, goes to stderr.
+ *
+ * @param (int argc) (number of arguments after validate)
+ * @param (char* argv[]) (arguments after validate: rules, then map
+ *        directories, tar archives or files)
+ * @param (const struct options* options) (settings of the games checked)
+ *
+ * @return (int) (exit code of the naval process: 0 if every map is valid,
+ *         E_PLAYER_MAP if any is not)
+ */
+int run_validate(int argc, char* argv[], const struct options* options)
+{
+    struct entries entries = {NULL, 0, 0};
+    struct validator* validators = NULL;
+    struct chunk chunk;
+    struct naval_game* game;
+    struct timespec start, end;
+    void* maps[argc];
+    size_t mapLengths[argc];
+    size_t invalid = 0;
+    int threads = options->threads;
+    FILE* rules;
+    int error = 0;
+
+    if (argc < 2) {
+        return E_NOT_ENOUGH_PARAMETERS;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if ((rules = fopen(argv[0], "r")) == NULL) {
+        return E_RULES_MISSING;
+    }
+    if ((game = naval_create()) == NULL) {
+        fclose(rules);
+        return E_PLAYER_MAP;
+    }
+    naval_set_engine(game, options->engine);
+    error = naval_load_rules(game, rules);
+    fclose(rules);
+    for (int i = 1; i < argc; i++) {
+        struct stat info;
+        int fd;
+
+        maps[i] = NULL;
+        if (error) {
+            continue;
+        }
+        if (stat(argv[i], &info) != 0) {
+            error = E_PLAYER_MAP_MISSING;
+        } else if (S_ISDIR(info.st_mode)) {
+            error = walk_directory(argv[i], 1, add_file, &entries);
+        } else if ((fd = open(argv[i], O_RDONLY)) < 0) {
+            error = E_PLAYER_MAP_MISSING;
+        } else {
+            mapLengths[i] = info.st_size;
+            maps[i] = (info.st_size > 0) ? mmap(NULL, info.st_size, PROT_READ,
+                    MAP_PRIVATE, fd, 0) : NULL;
+            close(fd);
+            if (maps[i] == MAP_FAILED) {
+                maps[i] = NULL;
+                error = E_PLAYER_MAP_MISSING;
+            } else if (maps[i] != NULL && is_tar(maps[i], mapLengths[i])) {
+                error = add_tar(&entries, argv[i], maps[i], mapLengths[i]) ?
+                        E_PLAYER_MAP_MISSING : 0;
+            } else {
+                error = add_entry(&entries, strdup(argv[i]), maps[i],
+                        mapLengths[i]) ? E_PLAYER_MAP_MISSING : 0;
+            }
+        }
+    }
+
+    if (threads < 1) {
+        threads = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+    memset(&chunk, 0, sizeof(chunk));
+    if (!error && ((validators = calloc(threads, sizeof(struct validator)))
+            == NULL || (chunk.offsets = malloc(VALIDATE_CHUNK *
+            sizeof(size_t))) == NULL || (chunk.lengths = malloc(
+            VALIDATE_CHUNK * sizeof(size_t))) == NULL || (chunk.owners =
+            malloc(VALIDATE_CHUNK * sizeof(int))) == NULL || (chunk.invalid =
+            malloc(VALIDATE_CHUNK * sizeof(int))) == NULL)) {
+        error = E_PLAYER_MAP;
+    }
+    for (int t = 0; !error && t < threads; t++) {
+        if ((validators[t].game = naval_copy(game)) == NULL) {
+            error = E_PLAYER_MAP;
+        }
+    }
+    for (size_t at = 0; !error && at < entries.count; at += chunk.count) {
+        chunk.entries = entries.items + at;
+        chunk.count = entries.count - at;
+        if (chunk.count > VALIDATE_CHUNK) {
+            chunk.count = VALIDATE_CHUNK;
+        }
+        if (validate_chunk(validators, threads, &chunk, &invalid)) {
+            error = E_PLAYER_MAP;
+        }
+    }
+    fflush(stdout);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (!error) {
+        double seconds = (end.tv_sec - start.tv_sec) +
+                (end.tv_nsec - start.tv_nsec) / 1e9;
+
+        fprintf(stderr, "%zu maps, %zu invalid, in %.3f s, %.0f files/sec\n",
+                entries.count, invalid, seconds,
+                (seconds > 0) ? entries.count / seconds : 0);
+        error = invalid ? E_PLAYER_MAP : 0;
+    }
+    for (int t = 0; validators != NULL && t < threads; t++) {
+        naval_destroy(validators[t].game);
+        free(validators[t].file);
+        free(validators[t].reports);
+    }
+    for (int i = 1; i < argc; i++) {
+        if (maps[i] != NULL) {
+            munmap(maps[i], mapLengths[i]);
+        }
+    }
+    for (size_t i = 0; i < entries.count; i++) {
+        free(entries.items[i].name);
+    }
+    free(entries.items);
+    free(validators);
+    free(chunk.offsets);
+    free(chunk.lengths);
+    free(chunk.owners);
+    free(chunk.invalid);
+    naval_destroy(game);
+    return error;
+}